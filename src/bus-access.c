@@ -0,0 +1,268 @@
+/*
+ * src/bus-access.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The access log module of the daemon ----------------------------------------
+
+#include "busd.h"
+
+/**
+ * Creates a new access log, and opens its file for appending.
+ * Access log lines are written out by a background thread of their own,
+ * and dropped (rather than waited for) when the log buffer is full.
+ *
+ * @param sample_rate The share of requests to be logged (0 .. 1).
+ * @param rate_limit  The maximum number of requests logged per second
+ *                    (0 means no limit).
+ * @param rate_burst  The maximum number of requests logged in a burst
+ *                    over the rate limit (0 means as many as per second).
+ * @param buffer_size The number of entries in the log buffer.
+ *
+ * @return The pointer to a newly allocated access log structure
+ *         or <code>NULL</code>, if no requests are to be logged, or the file
+ *         cannot be opened. Should be freed with
+ *         <code>free_access_log()</code>.
+ */
+ACCESS_LOG *new_access_log(const gdouble sample_rate,
+                           const guint   rate_limit,
+                           const guint   rate_burst,
+                           const guint   buffer_size) {
+
+    if (sample_rate <= 0) { return NULL; }
+
+    GError *error = NULL;
+
+    GFile *file = g_file_new_for_path(LOG_DIR ACCESS_LOGFILE);
+    GFileOutputStream *stream = g_file_append_to(file, G_FILE_CREATE_NONE,
+        NULL, &error);
+
+    if (stream == NULL) {
+        g_warning(ERR_CANNOT_OPEN_ACCESS_LOG, error->message);
+
+        g_clear_error(&error);
+        g_object_unref(file);
+
+        return NULL;
+    }
+
+    ACCESS_LOG *access_log = g_new0(ACCESS_LOG, 1);
+
+    access_log->file   = file;
+    access_log->stream = stream;
+    access_log->sink   = new_log_sink((GOutputStream *) stream, FALSE);
+
+    // Dropped lines are only counted, so that the access log holds
+    // nothing but JSON Lines.
+    access_log->sink->raw = TRUE;
+
+    start_log_sink(access_log->sink, buffer_size, LOG_OVERFLOW_DROP);
+
+    access_log->sample_threshold = (sample_rate >= 1)
+        ? G_GUINT64_CONSTANT(1) << 32 : (guint64) (sample_rate * 4294967296.);
+
+    guint burst = (rate_burst > 0) ? rate_burst : MAX(rate_limit, 1);
+
+    if (rate_limit > 0) {
+        access_log->interval  = 1000000000 / rate_limit;
+        access_log->tolerance = access_log->interval * (burst - 1);
+    }
+
+    g_message(       MSG_ACCESS_LOG_ENABLED, MIN(sample_rate, 1), rate_limit,
+        (rate_limit > 0) ? burst : 0);
+    syslog(LOG_INFO, MSG_ACCESS_LOG_ENABLED, MIN(sample_rate, 1), rate_limit,
+        (rate_limit > 0) ? burst : 0);
+
+    return access_log;
+}
+
+// Helper function. Takes a token from the token bucket of the access log.
+// Returns FALSE if there are none left, i.e. the request is over
+// the rate limit.
+static gboolean _take_token(ACCESS_LOG *access_log) {
+    if (access_log->interval == 0) { return TRUE; }
+
+    guint64 now = get_time_ns();
+
+    guint64 refilled = __atomic_load_n(&access_log->refilled,
+        __ATOMIC_RELAXED);
+
+    while (TRUE) {
+        // The bucket is full already, if it got full in the past.
+        guint64 from = MAX(refilled, now);
+
+        if ((from - now) > access_log->tolerance) {
+            g_atomic_int_inc(&access_log->limited);
+
+            return FALSE;
+        }
+
+        if (__atomic_compare_exchange_n(&access_log->refilled, &refilled,
+            from + access_log->interval, TRUE, __ATOMIC_RELAXED,
+            __ATOMIC_RELAXED)) {
+
+            return TRUE;
+        }
+    }
+}
+
+/**
+ * Identifies whether the request is to be written to the access log:
+ * samples it, and then checks it against the rate limit. Should be called
+ * as the request comes in, so that requests not logged cost nothing more.
+ *
+ * @param access_log The pointer to the access log structure.
+ * @param seed       The pointer to the sampling state of the server worker
+ *                   (a non-zero one, updated on each call).
+ *
+ * @return <code>TRUE</code> if the request is to be logged,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean sample_access(ACCESS_LOG *access_log, guint32 *seed) {
+    // Drawing a pseudorandom number (xorshift32), cheaply and locklessly.
+    guint32 x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x <<  5;
+
+    *seed = x;
+
+    return (x < access_log->sample_threshold) && _take_token(access_log);
+}
+
+// Helper function. Escapes the string given as a JSON string into
+// the buffer, cutting it short rather than overflowing the buffer.
+static void _escape_string(const gchar *string,
+                                 gchar *buff,
+                           const gsize  size) {
+
+    gsize length = 0;
+
+    for (const guchar *c = (const guchar *) string;
+        (c != NULL) && (*c != 0); c++) {
+
+        // Control characters and non-ASCII bytes are escaped as they are,
+        // so that the line stays valid whatever the path is.
+        gsize escaped = ((*c == '"') || (*c == '\\')) ? 2
+                      : ((*c < 0x20) || (*c > 0x7e)) ? 6 : 1;
+
+        if ((length + escaped) >= size) { break; }
+
+        if (escaped == 2) { buff[length++] = '\\'; }
+
+        if (escaped == 6) {
+            length += g_snprintf(buff + length, size - length, "\\u%04x",
+                *c);
+        } else {
+            buff[length++] = *c;
+        }
+    }
+
+    buff[length] = 0;
+}
+
+// Helper function. Renders a bus stop ID as a JSON value into the buffer,
+// or returns null, if there is none.
+static const gchar *_render_stop(const guint32 stop_id, gchar *buff) {
+    if (stop_id == 0) { return JSON_NULL; }
+
+    g_snprintf(buff, ACCESS_STOP_SIZE, UINT_FORMAT, stop_id);
+
+    return buff;
+}
+
+/**
+ * Writes the request out to the access log, as a single JSON line.
+ * Should be called once the response is set.
+ *
+ * @param access_log The pointer to the access log structure.
+ * @param entry      The pointer to details of the request.
+ * @param msg        The request message logged.
+ * @param start      When the request handling started (the monotonic clock
+ *                   time in nanoseconds).
+ */
+void log_access(      ACCESS_LOG        *access_log,
+                const ACCESS_ENTRY      *entry,
+                      SoupServerMessage *msg,
+                const guint64            start) {
+
+    gdouble duration = (gdouble) (get_time_ns() - start) / 1e6;
+
+    gchar method[ACCESS_METHOD_SIZE];
+    gchar path[  ACCESS_PATH_SIZE  ];
+    gchar from[  ACCESS_STOP_SIZE  ];
+    gchar to[    ACCESS_STOP_SIZE  ];
+
+    _escape_string(soup_server_message_get_method(msg), method,
+        ACCESS_METHOD_SIZE);
+    _escape_string(g_uri_get_path(soup_server_message_get_uri(msg)), path,
+        ACCESS_PATH_SIZE);
+
+    // Rendering the access log line right on the stack.
+    gchar line[LOG_SLOT_SIZE];
+
+    gint line_len = g_snprintf(line, LOG_SLOT_SIZE, ACCESS_LINE_FORMAT,
+        g_get_real_time() / 1000, method, path,
+        _render_stop(entry->from, from), _render_stop(entry->to, to),
+        soup_server_message_get_status(msg),
+        (entry->result != NULL) ? entry->result : JSON_NULL, duration,
+        soup_server_message_get_response_body(msg)->length);
+
+    if (write_log_sink(access_log->sink, 0, line, line_len)) {
+        g_atomic_int_inc(&access_log->logged);
+    }
+}
+
+/**
+ * Flushes access log lines left in the log buffer (if any), closes
+ * the access log file, and logs how many requests have been logged.
+ * Should be called once server workers are stopped.
+ *
+ * @param access_log The pointer to the access log structure.
+ */
+void close_access_log(ACCESS_LOG *access_log) {
+    if ((access_log == NULL) || (access_log->sink == NULL)) { return; }
+
+    guint dropped = g_atomic_int_get(&access_log->sink->ring->dropped);
+
+    stop_log_sink(access_log->sink);
+
+    g_mutex_clear(&access_log->sink->mutex);
+    g_free(access_log->sink);
+
+    access_log->sink = NULL;
+
+    g_output_stream_close((GOutputStream *) access_log->stream, NULL, NULL);
+
+    g_message(       MSG_ACCESS_LOG_CLOSED, access_log->logged,
+        access_log->limited, dropped);
+    syslog(LOG_INFO, MSG_ACCESS_LOG_CLOSED, access_log->logged,
+        access_log->limited, dropped);
+}
+
+/**
+ * Frees the access log structure, closing it first (if not closed yet).
+ *
+ * @param access_log The pointer to the access log structure.
+ */
+void free_access_log(ACCESS_LOG *access_log) {
+    if (access_log == NULL) { return; }
+
+    close_access_log(access_log);
+
+    g_object_unref(access_log->stream);
+    g_object_unref(access_log->file);
+
+    g_free(access_log);
+}
+
+// vim:set nu et ts=4 sw=4:
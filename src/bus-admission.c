@@ -0,0 +1,184 @@
+/*
+ * src/bus-admission.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The admission control module of the daemon ---------------------------------
+
+#include "busd.h"
+
+// Helper structure to hold an admitted request in flight. Attached
+// to the request message, and released along with it.
+typedef struct {
+    HANDLER_PAYLOAD *handler_payload;
+    guint64          started; // When the request headers have been read.
+} _TICKET;
+
+// The key of the ticket attached to the request message.
+static GQuark _ticket_quark = 0;
+
+// Helper function. Releases the request in flight, once its message
+// is done with.
+static void _release_ticket(_TICKET *ticket) {
+    g_atomic_int_add(&ticket->handler_payload->admission->in_flight, -1);
+
+    g_free(ticket);
+}
+
+/**
+ * Creates a new admission control structure.
+ *
+ * @param max_in_flight  The maximum number of requests in flight
+ *                       in all server workers.
+ * @param max_queue_wait The maximum time (in milliseconds) a request
+ *                       is allowed to wait to be handled.
+ * @param retry_after    The number of seconds clients are told to wait
+ *                       before retrying requests shed.
+ *
+ * @return The pointer to a newly allocated admission control structure
+ *         or <code>NULL</code>, if there are no limits (the admission
+ *         control is disabled). Should be freed with
+ *         <code>free_admission()</code>.
+ */
+ADMISSION_CONTROL *new_admission(const guint max_in_flight,
+                                 const guint max_queue_wait,
+                                 const guint retry_after) {
+
+    if ((max_in_flight == 0) && (max_queue_wait == 0)) { return NULL; }
+
+    _ticket_quark = g_quark_from_static_string(ADMISSION_GROUP);
+
+    ADMISSION_CONTROL *admission = g_new0(ADMISSION_CONTROL, 1);
+
+    admission->max_in_flight  = max_in_flight;
+    admission->max_queue_wait = (guint64) max_queue_wait * 1000000;
+    admission->retry_after    = g_strdup_printf(UINT_FORMAT, retry_after);
+
+    g_message(       MSG_ADMISSION_ENABLED, max_in_flight, max_queue_wait);
+    syslog(LOG_INFO, MSG_ADMISSION_ENABLED, max_in_flight, max_queue_wait);
+
+    return admission;
+}
+
+// Helper function. The got headers signal callback: admits the request
+// once its headers are read, or sheds it right away, before its body
+// gets read and it gets handled, if it exceeds the limit of requests
+// in flight.
+static void _admit_headers(SoupServerMessage *msg,
+                           HANDLER_PAYLOAD   *handler_payload) {
+
+    ADMISSION_CONTROL *admission = handler_payload->admission;
+
+    _TICKET *ticket         = g_new(_TICKET, 1);
+    ticket->handler_payload = handler_payload;
+    ticket->started         = get_time_ns();
+
+    guint in_flight = g_atomic_int_add(&admission->in_flight, 1) + 1;
+
+    // The request stays in flight for as long as its message is alive,
+    // even if it is shed, or the connection is closed meanwhile.
+    g_object_set_qdata_full((GObject *) msg, _ticket_quark, ticket,
+        (GDestroyNotify) _release_ticket);
+
+    if ((admission->max_in_flight > 0)
+        && (in_flight > admission->max_in_flight)) {
+
+        shed_request(msg, handler_payload, SHED_IN_FLIGHT);
+
+        // The request handler is not going to be called for the request.
+        count_request(handler_payload->metrics,
+            SOUP_STATUS_SERVICE_UNAVAILABLE);
+    }
+}
+
+/**
+ * The request started signal callback. Used to admit the incoming request,
+ * or to shed it right away, before it gets handled, if it exceeds any
+ * of the admission control limits. A request starts as soon as
+ * a connection awaits one, idle keep-alive connections included,
+ * so it's admitted only once its headers have arrived: neither idle
+ * connections take requests in flight up, nor the time clients take
+ * between requests counts as waiting to be handled.
+ *
+ * @param server  The Soup web server instance.
+ * @param msg     The request message just started to be read.
+ * @param payload The pointer to a payload data passed from the controller.
+ */
+void admit_request(SoupServer        *server,
+                   SoupServerMessage *msg,
+                   gpointer           payload) {
+
+    g_signal_connect(msg, GOT_HEADERS, G_CALLBACK(_admit_headers), payload);
+}
+
+/**
+ * Identifies whether the request has waited too long to be handled,
+ * since its headers have been read.
+ *
+ * @param admission The pointer to the admission control structure.
+ * @param msg       The request message to be handled.
+ * @param now       The current time of the monotonic clock
+ *                  (in nanoseconds).
+ *
+ * @return <code>TRUE</code> if the request has waited longer than allowed,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_wait_exceeded(const ADMISSION_CONTROL *admission,
+                                SoupServerMessage *msg,
+                          const guint64            now) {
+
+    if (admission->max_queue_wait == 0) { return FALSE; }
+
+    _TICKET *ticket = g_object_get_qdata((GObject *) msg, _ticket_quark);
+
+    return (ticket != NULL)
+        && ((now - ticket->started) > admission->max_queue_wait);
+}
+
+/**
+ * Responds to the request with the prerendered
+ * <code>503 Service Unavailable</code> response, telling the client
+ * when to retry it, and counts the request as shed.
+ *
+ * @param msg             The request message to be shed.
+ * @param handler_payload The pointer to a payload data of the server worker.
+ * @param reason          The reason for the request to be shed.
+ */
+void shed_request(      SoupServerMessage *msg,
+                        HANDLER_PAYLOAD   *handler_payload,
+                  const SHED_REASON        reason) {
+
+    soup_message_headers_replace(
+        soup_server_message_get_response_headers(msg),
+        HDR_RETRY_AFTER_N, handler_payload->admission->retry_after);
+
+    soup_server_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE,
+        NULL);
+
+    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+        RESP_UNAVAILABLE, strlen(RESP_UNAVAILABLE));
+
+    METRIC_ADD(handler_payload->metrics->shed[reason], 1);
+}
+
+/**
+ * Frees the admission control structure.
+ *
+ * @param admission The pointer to the admission control structure.
+ */
+void free_admission(ADMISSION_CONTROL *admission) {
+    if (admission == NULL) { return; }
+
+    g_free(admission->retry_after);
+    g_free(admission);
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,200 @@
+/*
+ * src/bus-bench.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The direct-route engines micro-benchmark -----------------------------------
+
+#include "busd.h"
+
+// The number of heap allocations made so far.
+static guint64 _allocations = 0;
+
+#ifdef __GLIBC__
+// Interposing the heap allocator of the C library to count allocations
+// made by direct-route lookups (all GLib allocations go through it too).
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t size) {
+    _allocations++;
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    _allocations++;
+
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    _allocations++;
+
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+// Helper function. Compares two durations, for sorting.
+static int _cmp_durations(const void *a, const void *b) {
+    guint64 a_ = *(const guint64 *) a;
+    guint64 b_ = *(const guint64 *) b;
+
+    return (a_ > b_) - (a_ < b_);
+}
+
+// Helper function. Parses the command-line argument given,
+// or takes the default value, if it's not there.
+static guint _get_arg(int argc, char *const *argv, const int i,
+                                                  const guint def) {
+
+    if (argc <= i) { return def; }
+
+    guint64 value = g_ascii_strtoull(argv[i], NULL, 10);
+
+    return ((value > 0) && (value <= G_MAXINT32)) ? (guint) value : 0;
+}
+
+// Helper function. Benchmarks the direct-route engine given
+// against the workload of queries, and prints out the results.
+// Routes are parsed anew for each engine, so that it builds only
+// what it needs itself.
+static void _bench_engine(const gchar          *routes_buff,
+                          const gsize           data_size,
+                          const ROUTES_ENGINE   engine,
+                          const QUERY_WORKLOAD *workload,
+                                guint64        *durations) {
+
+    ROUTES_STORE *routes = parse_routes(routes_buff, data_size);
+
+    set_routes_engine(routes, engine, (guint64) DEF_TABLE_LIMIT << 20);
+
+    guint count  = workload->count;
+    guint direct = 0;
+
+    // Warming up caches and branch predictors, and counting direct routes
+    // found, which should be the same for all the engines.
+    for (guint i = 0; i < count; i++) {
+        direct += find_direct_route(routes, workload->from[i],
+                                            workload->to  [i]);
+    }
+
+    // Measuring the throughput and allocations over the whole workload.
+    guint64 allocations = _allocations;
+    guint64 start       = get_time_ns();
+
+    for (guint i = 0; i < count; i++) {
+        find_direct_route(routes, workload->from[i],
+                                  workload->to  [i]);
+    }
+
+    guint64 elapsed = get_time_ns() - start;
+
+    allocations = _allocations - allocations;
+
+    // Measuring the latency of each query separately.
+    for (guint i = 0; i < count; i++) {
+        guint64 query_start = get_time_ns();
+
+        find_direct_route(routes, workload->from[i],
+                                  workload->to  [i]);
+
+        durations[i] = get_time_ns() - query_start;
+    }
+
+    qsort(durations, count, sizeof(guint64), _cmp_durations);
+
+    g_print(MSG_BENCH_RESULT, get_engine_name(routes->engine),
+        (gdouble) elapsed / count,
+        durations[(count - 1) * 50 / 100],
+        durations[(count - 1) * 99 / 100],
+        (gdouble) allocations / count,
+        direct);
+
+    free_routes(routes);
+}
+
+/**
+ * The micro-benchmark entry point. Generates a synthetic routes data store
+ * of the size given, and benchmarks all the direct-route engines against
+ * the same workload of queries (half of them have direct routes):
+ * in nanoseconds per query (on average, at the 50th and 99th percentiles),
+ * and in heap allocations per query.
+ *
+ * @param argc The number of command-line arguments + 1 (the benchmark name).
+ * @param argv The pointer to an array of command-line arguments,
+ *             including the benchmark name: the number of routes,
+ *             of bus stops per route, of distinct bus stops, of queries,
+ *             and the seed of the random number generator (all optional).
+ *
+ * @returns The exit code of the overall termination of the benchmark.
+ */
+int main(int argc, char *const *argv) {
+    guint routes_count    = _get_arg(argc, argv, 1, DEF_BENCH_ROUTES         );
+    guint stops_per_route = _get_arg(argc, argv, 2, DEF_BENCH_STOPS_PER_ROUTE);
+    guint universe        = _get_arg(argc, argv, 3, DEF_BENCH_UNIVERSE       );
+    guint queries         = _get_arg(argc, argv, 4, DEF_BENCH_QUERIES        );
+    guint seed            = _get_arg(argc, argv, 5, DEF_BENCH_SEED           );
+
+    if ((argc > 6) || (routes_count == 0) || (stops_per_route == 0)
+        || (universe == 0) || (queries == 0) || (seed == 0)) {
+
+        g_printerr(ERR_BENCH_USAGE NEW_LINE);
+
+        return EXIT_FAILURE;
+    }
+
+    // Generating routes right into memory.
+    GOutputStream *stream = g_memory_output_stream_new_resizable();
+
+    generate_routes(stream, routes_count, stops_per_route, universe,
+        DEF_BENCH_SKEW, seed, NULL);
+
+    g_output_stream_close(stream, NULL, NULL);
+
+    const gchar *routes_buff = g_memory_output_stream_get_data(
+        (GMemoryOutputStream *) stream);
+    gsize        data_size   = g_memory_output_stream_get_data_size(
+        (GMemoryOutputStream *) stream);
+
+    ROUTES_STORE *routes = parse_routes(routes_buff, data_size);
+
+    set_routes_engine(routes, ENGINE_INDEX, 0);
+
+    QUERY_WORKLOAD *workload = new_workload(routes, queries,
+        DEF_BENCH_HIT_RATIO, seed);
+
+    g_message(MSG_BENCH_ROUTES, routes->routes_count, routes->stops_count,
+        workload->count);
+
+    free_routes(routes);
+
+    guint64 *durations = g_new(guint64, queries);
+
+    g_print(MSG_BENCH_HEADER, ENGINE, "ns/query", "p50, ns", "p99, ns",
+        "allocs/query", "direct");
+
+    for (ROUTES_ENGINE engine = ENGINE_SCAN; engine <= ENGINE_PACKED;
+        engine++) {
+
+        _bench_engine(routes_buff, data_size, engine, workload, durations);
+    }
+
+    g_free(durations);
+
+    free_workload(workload);
+    g_object_unref(stream);
+
+    return EXIT_SUCCESS;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,290 @@
+/*
+ * src/bus-cache.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The response cache module of the daemon ------------------------------------
+
+#include "busd.h"
+
+// Helper function. Gets the home slot of a cache key (Fibonacci hashing).
+static guint _get_home_slot(const ROUTES_CACHE *cache, const guint64 key) {
+    return (guint) ((key * G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)) >> 32)
+        & cache->mask;
+}
+
+// Helper function. Unlinks a cache entry from the LRU list.
+static void _unlink_entry(ROUTES_CACHE *cache, const guint32 slot) {
+    CACHE_ENTRY *entry = &cache->entries[slot];
+
+    if (entry->prev != CACHE_NIL) {
+        cache->entries[entry->prev].next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+
+    if (entry->next != CACHE_NIL) {
+        cache->entries[entry->next].prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+// Helper function. Links a cache entry in at the head of the LRU list,
+// as the most recently used one.
+static void _link_entry(ROUTES_CACHE *cache, const guint32 slot) {
+    CACHE_ENTRY *entry = &cache->entries[slot];
+
+    entry->prev = CACHE_NIL;
+    entry->next = cache->head;
+
+    if (cache->head != CACHE_NIL) { cache->entries[cache->head].prev = slot; }
+    else                          { cache->tail                      = slot; }
+
+    cache->head = slot;
+}
+
+// Helper function. Moves a cache entry to another (empty) slot,
+// keeping its place in the LRU list.
+static void _move_entry(ROUTES_CACHE *cache, const guint32 from,
+                                             const guint32 to) {
+
+    CACHE_ENTRY *entry = &cache->entries[to];
+
+    *entry = cache->entries[from];
+
+    if (entry->prev != CACHE_NIL) { cache->entries[entry->prev].next = to; }
+    else                          { cache->head                      = to; }
+
+    if (entry->next != CACHE_NIL) { cache->entries[entry->next].prev = to; }
+    else                          { cache->tail                      = to; }
+
+    cache->entries[from].key = 0;
+}
+
+// Helper function. Removes a cache entry, shifting the entries that follow
+// it in the same probe sequence back, so that no tombstones are needed.
+static void _remove_entry(ROUTES_CACHE *cache, guint32 slot) {
+    _unlink_entry(cache, slot);
+
+    cache->entries[slot].key = 0;
+    cache->count--;
+
+    guint32 next = slot;
+
+    while (TRUE) {
+        next = (next + 1) & cache->mask;
+
+        guint64 key = cache->entries[next].key & ~CACHE_DIRECT;
+
+        if (key == 0) { break; }
+
+        guint32 home = _get_home_slot(cache, key);
+
+        // Moving the entry back only if its home slot doesn't lie
+        // (cyclically) between the freed slot and the entry itself.
+        gboolean is_movable = (slot <= next)
+            ? ((home <= slot) || (home >  next))
+            : ((home <= slot) && (home >  next));
+
+        if (is_movable) {
+            _move_entry(cache, next, slot);
+
+            slot = next;
+        }
+    }
+}
+
+// Helper function. Drops all cache entries.
+static void _clear_cache(ROUTES_CACHE *cache) {
+    memset(cache->entries, 0, sizeof(CACHE_ENTRY) * (cache->mask + 1));
+
+    cache->count = 0;
+    cache->head  = CACHE_NIL;
+    cache->tail  = CACHE_NIL;
+}
+
+/**
+ * Creates a new response cache for direct-route lookups.
+ * The cache is not thread-safe: it is meant to be owned by a single
+ * server worker.
+ *
+ * @param capacity The maximum number of bus stop pairs to hold.
+ *
+ * @return The pointer to a newly allocated cache structure
+ *         or <code>NULL</code>, if the capacity is 0 (the cache is disabled).
+ *         Should be freed with <code>free_cache()</code>.
+ */
+ROUTES_CACHE *new_cache(const guint capacity) {
+    if (capacity == 0) { return NULL; }
+
+    // Keeping the load factor of the slots table no higher than 1/2.
+    guint slots = 1;
+
+    while (slots < (capacity * 2)) { slots <<= 1; }
+
+    ROUTES_CACHE *cache = g_new0(ROUTES_CACHE, 1);
+
+    cache->capacity = capacity;
+    cache->mask     = slots - 1;
+    cache->entries  = g_new(CACHE_ENTRY, slots);
+
+    _clear_cache(cache);
+
+    return cache;
+}
+
+/**
+ * Looks up the cached result of a direct-route lookup. The cache gets
+ * invalidated first, if it was filled from another snapshot of routes.
+ *
+ * @param cache      The pointer to the cache structure.
+ * @param generation The number of the snapshot of routes being used.
+ * @param from       The starting bus stop point.
+ * @param to         The ending   bus stop point.
+ * @param direct     The pointer to a variable to put the cached result into.
+ *
+ * @return <code>TRUE</code> if the result is found in the cache,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean find_cached_route(      ROUTES_CACHE *cache,
+                           const guint         generation,
+                           const guint32       from,
+                           const guint32       to,
+                                 gboolean     *direct) {
+
+    if (cache->generation != generation) {
+        if (cache->count > 0) {
+            cache->invalidations++;
+
+            _clear_cache(cache);
+        }
+
+        cache->generation = generation;
+    }
+
+    guint64 key  = ((guint64) from << 32) | to;
+    guint32 slot = _get_home_slot(cache, key);
+
+    while (cache->entries[slot].key != 0) {
+        if ((cache->entries[slot].key & ~CACHE_DIRECT) == key) {
+            cache->hits++;
+
+            // Making the entry the most recently used one.
+            if (cache->head != slot) {
+                _unlink_entry(cache, slot);
+                _link_entry  (cache, slot);
+            }
+
+            *direct = (cache->entries[slot].key & CACHE_DIRECT) != 0;
+
+            return TRUE;
+        }
+
+        slot = (slot + 1) & cache->mask;
+    }
+
+    cache->misses++;
+
+    return FALSE;
+}
+
+/**
+ * Puts the result of a direct-route lookup into the cache, evicting
+ * the least recently used entry, if the cache is full. The result
+ * is dropped, if it comes from another snapshot of routes than the one
+ * the cache is filled from (as the lookup may be finished after a reload),
+ * and replaces the cached one, if the pair is there already (as lookups
+ * of the same pair may be finished one after another).
+ *
+ * @param cache      The pointer to the cache structure.
+ * @param generation The number of the snapshot of routes looked up.
+ * @param from       The starting bus stop point.
+ * @param to         The ending   bus stop point.
+ * @param direct     The result of the direct-route lookup.
+ */
+void cache_route(      ROUTES_CACHE *cache,
+                 const guint         generation,
+                 const guint32       from,
+                 const guint32       to,
+                 const gboolean      direct) {
+
+    if (cache->generation != generation) { return; }
+
+    guint64 key  = ((guint64) from << 32) | to;
+    guint32 slot = _get_home_slot(cache, key);
+
+    while (cache->entries[slot].key != 0) {
+        if ((cache->entries[slot].key & ~CACHE_DIRECT) == key) {
+            cache->entries[slot].key = direct ? (key | CACHE_DIRECT) : key;
+
+            if (cache->head != slot) {
+                _unlink_entry(cache, slot);
+                _link_entry  (cache, slot);
+            }
+
+            return;
+        }
+
+        slot = (slot + 1) & cache->mask;
+    }
+
+    if (cache->count == cache->capacity) {
+        cache->evictions++;
+
+        _remove_entry(cache, cache->tail);
+
+        // Entries may have been shifted back into the probe sequence.
+        slot = _get_home_slot(cache, key);
+
+        while (cache->entries[slot].key != 0) {
+            slot = (slot + 1) & cache->mask;
+        }
+    }
+
+    cache->entries[slot].key = direct ? (key | CACHE_DIRECT) : key;
+    cache->count++;
+
+    _link_entry(cache, slot);
+}
+
+/**
+ * Logs the hits, misses, evictions, and invalidations of the cache,
+ * to help size it.
+ *
+ * @param cache The pointer to the cache structure.
+ */
+void report_cache(const ROUTES_CACHE *cache) {
+    if (cache == NULL) { return; }
+
+    guint64 lookups  = cache->hits + cache->misses;
+    gdouble hit_rate = (lookups > 0)
+        ? ((gdouble) cache->hits * 100 / lookups) : 0;
+
+    g_message(       MSG_CACHE_STATS, cache->hits, cache->misses,
+        hit_rate, cache->evictions, cache->invalidations);
+    syslog(LOG_INFO, MSG_CACHE_STATS, cache->hits, cache->misses,
+        hit_rate, cache->evictions, cache->invalidations);
+}
+
+/**
+ * Frees the cache structure.
+ *
+ * @param cache The pointer to the cache structure.
+ */
+void free_cache(ROUTES_CACHE *cache) {
+    if (cache == NULL) { return; }
+
+    g_free(cache->entries);
+    g_free(cache);
+}
+
+// vim:set nu et ts=4 sw=4:
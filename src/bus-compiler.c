@@ -0,0 +1,59 @@
+/*
+ * src/bus-compiler.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The routes data store compiler ---------------------------------------------
+
+#include "busd.h"
+
+/**
+ * The routes data store compiler entry point. Compiles the routes data store
+ * into a routes snapshot, which is then mapped into memory by the daemon
+ * as is, without any parsing or indexing at startup.
+ *
+ * @param argc The number of command-line arguments + 1 (the compiler name).
+ * @param argv The pointer to an array of command-line arguments,
+ *             including the compiler name: the path and filename
+ *             of the routes data store, and the ones of the routes snapshot.
+ *
+ * @returns The exit code of the overall termination of the compiler.
+ */
+int main(int argc, char *const *argv) {
+    if (argc != 3) {
+        g_printerr(ERR_COMPILER_USAGE NEW_LINE);
+
+        return EXIT_FAILURE;
+    }
+
+    // Loading routes: parsing them into a compact array of bus stop IDs,
+    // and building the bus stops index.
+    ROUTES_STORE *routes = load_routes(argv[1], FALSE, ENGINE_INDEX, 0);
+
+    if (routes == NULL) {
+        g_warning(ERR_DATASTORE_NOT_FOUND);
+
+        return EXIT_FAILURE;
+    }
+
+    gboolean is_saved = save_routes(routes, argv[2]);
+
+    if (is_saved) {
+        g_message(MSG_ROUTES_COMPILED, routes->routes_count,
+            routes->stops_count, routes->stop_ids_count);
+    }
+
+    free_routes(routes);
+
+    return is_saved ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -15,22 +15,356 @@
 
 #include "busd.h"
 
+// Helper function. Creates a TCP socket listening on all IPv6 (and IPv4,
+// via dual-stack) interfaces, with the port it is bound to being shared
+// with other sockets of the daemon (SO_REUSEPORT), so that the kernel
+// can distribute incoming connections among them.
+static GSocket *_new_listen_socket(const gushort server_port,
+                                         GError **error) {
+
+    GSocketFamily family = G_SOCKET_FAMILY_IPV6;
+
+    GSocket *socket = g_socket_new(family, G_SOCKET_TYPE_STREAM,
+        G_SOCKET_PROTOCOL_TCP, NULL);
+
+    if (socket == NULL) {
+        family = G_SOCKET_FAMILY_IPV4;
+        socket = g_socket_new(family, G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_TCP, error);
+
+        if (socket == NULL) { return NULL; }
+    } else {
+        g_socket_set_option(socket, IPPROTO_IPV6, IPV6_V6ONLY, FALSE, NULL);
+    }
+
+    GInetAddress   *any_addr = g_inet_address_new_any(family);
+    GSocketAddress *addr     = g_inet_socket_address_new(any_addr,
+        server_port);
+
+    gboolean is_listening
+        =  g_socket_set_option(socket, SOL_SOCKET, SO_REUSEPORT, TRUE, error)
+        && g_socket_bind(socket, addr, TRUE, error)
+        && g_socket_listen(socket, error);
+
+    g_object_unref(addr);
+    g_object_unref(any_addr);
+
+    if (!is_listening) { g_clear_object(&socket); }
+
+    return socket;
+}
+
+// Helper function. Removes the socket file left by a previous run
+// of the daemon (if any), unless there is someone still listening on it.
+static gboolean _remove_stale_socket(const gchar          *path,
+                                           GSocketAddress *addr,
+                                           GError        **error) {
+
+    struct stat st;
+
+    if (lstat(path, &st) != 0) { return TRUE; }
+
+    if (!S_ISSOCK(st.st_mode)) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+            ERR_UNIX_SOCKET_NOT_SOCKET);
+
+        return FALSE;
+    }
+
+    GSocket *probe = g_socket_new(G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_STREAM,
+        G_SOCKET_PROTOCOL_DEFAULT, error);
+
+    if (probe == NULL) { return FALSE; }
+
+    gboolean is_in_use = g_socket_connect(probe, addr, NULL, NULL);
+
+    g_object_unref(probe);
+
+    if (is_in_use) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE,
+            ERR_UNIX_SOCKET_IN_USE);
+
+        return FALSE;
+    }
+
+    unlink(path);
+
+    return TRUE;
+}
+
+// Helper function. Changes the owner of the socket file to the one given
+// as "user", "user:group", or ":group".
+static gboolean _chown_socket(const gchar  *path,
+                              const gchar  *owner,
+                                    GError **error) {
+
+    gchar **names = g_strsplit(owner, ":", 2);
+
+    uid_t uid = (uid_t) -1;
+    gid_t gid = (gid_t) -1;
+
+    gboolean is_owned = TRUE;
+
+    if (*names[0] != '\0') {
+        struct passwd *user = getpwnam(names[0]);
+
+        if (user != NULL) {
+            uid = user->pw_uid;
+        } else {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                ERR_UNKNOWN_USER, names[0]);
+
+            is_owned = FALSE;
+        }
+    }
+
+    if (is_owned && (names[1] != NULL) && (*names[1] != '\0')) {
+        struct group *group = getgrnam(names[1]);
+
+        if (group != NULL) {
+            gid = group->gr_gid;
+        } else {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                ERR_UNKNOWN_GROUP, names[1]);
+
+            is_owned = FALSE;
+        }
+    }
+
+    if (is_owned && (chown(path, uid, gid) != 0)) {
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errno),
+            g_strerror(errno));
+
+        is_owned = FALSE;
+    }
+
+    g_strfreev(names);
+
+    return is_owned;
+}
+
+// Helper function. Sets up the server to listen on a Unix domain socket,
+// with the socket file mode and owner given. Stale socket files are
+// removed beforehand.
+static gboolean _listen_unix_socket(      SoupServer    *server,
+                                    const UNIX_LISTENER *unix_listener,
+                                          GError       **error) {
+
+    struct sockaddr_un native_addr = { .sun_family = AF_UNIX };
+
+    if (strlen(unix_listener->path) >= sizeof(native_addr.sun_path)) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+            ERR_UNIX_SOCKET_PATH_TOO_LONG);
+
+        return FALSE;
+    }
+
+    strcpy(native_addr.sun_path, unix_listener->path);
+
+    GSocketAddress *addr = g_socket_address_new_from_native(&native_addr,
+        sizeof(native_addr));
+
+    if (!_remove_stale_socket(unix_listener->path, addr, error)) {
+        g_object_unref(addr);
+
+        return FALSE;
+    }
+
+    GSocket *socket = g_socket_new(G_SOCKET_FAMILY_UNIX,
+        G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, error);
+
+    gboolean is_listening = (socket != NULL)
+        && g_socket_bind(socket, addr, FALSE, error);
+
+    g_object_unref(addr);
+
+    if (!is_listening) {
+        g_clear_object(&socket);
+
+        return FALSE;
+    }
+
+    // Restricting access to the socket file before accepting connections.
+    if (chmod(unix_listener->path, unix_listener->mode) != 0) {
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errno),
+            g_strerror(errno));
+
+        is_listening = FALSE;
+    }
+
+    is_listening = is_listening
+        && ((unix_listener->owner == NULL)
+        || _chown_socket(unix_listener->path, unix_listener->owner, error))
+        && g_socket_listen(socket, error)
+        && soup_server_listen_socket(server, socket,
+            (SoupServerListenOptions) 0, error);
+
+    if (!is_listening) { unlink(unix_listener->path); }
+
+    g_object_unref(socket);
+
+    return is_listening;
+}
+
+// Helper function. The server worker thread: runs a Soup web server
+// listening on the worker's socket, within the worker's own main context.
+static gpointer _run_worker(SERVER_WORKER *worker) {
+    g_main_context_push_thread_default(worker->context);
+
+    SoupServer *server = soup_server_new(HDR_SERVER_P, EMPTY_STRING, NULL);
+
+    soup_server_add_handler(server, NULL, request_handler,
+                                          worker->handler_payload, NULL);
+
+    if (worker->handler_payload->admission != NULL) {
+        g_signal_connect(server, REQUEST_STARTED, G_CALLBACK(admit_request),
+            worker->handler_payload);
+    }
+
+    g_signal_connect(server, REQUEST_STARTED, G_CALLBACK(cap_request_body),
+        worker->handler_payload);
+
+    GError *error = NULL;
+
+    if (soup_server_listen_socket(server, worker->socket,
+        (SoupServerListenOptions) 0, &error)) {
+
+        g_main_loop_run(worker->loop);
+    } else {
+        g_warning(ERR_CANNOT_START_WORKER, error->message);
+
+        g_clear_error(&error);
+    }
+
+    soup_server_disconnect(server);
+    g_object_unref(server);
+    g_object_unref(worker->socket);
+
+    g_main_context_pop_thread_default(worker->context);
+
+    return NULL;
+}
+
+// Helper function. Sets up the server and additional server workers
+// to listen on sockets bound to the same port, and starts up workers.
+static gboolean _start_workers(      SoupServer      *server,
+                               const gushort          server_port,
+                               const guint            workers_count,
+                               const guint            cache_capacity,
+                                     HANDLER_PAYLOAD *handler_payload,
+                                     _CLEANUP_ARGS   *cleanup_args,
+                                     GError         **error) {
+
+    GSocket **sockets = g_new0(GSocket *, workers_count);
+
+    // Binding all the sockets up front, so that the port conflict
+    // (if any) is reported before any worker is started.
+    for (guint i = 0; i < workers_count; i++) {
+        sockets[i] = _new_listen_socket(server_port, error);
+
+        if (sockets[i] == NULL) {
+            for (guint j = 0; j < i; j++) { g_object_unref(sockets[j]); }
+
+            g_free(sockets);
+
+            return FALSE;
+        }
+    }
+
+    // The server itself is served by the main loop, as the first worker.
+    gboolean is_listening = soup_server_listen_socket(server, sockets[0],
+        (SoupServerListenOptions) 0, error);
+
+    g_object_unref(sockets[0]);
+
+    if (!is_listening) {
+        for (guint i = 1; i < workers_count; i++) {
+            g_object_unref(sockets[i]);
+        }
+
+        g_free(sockets);
+
+        return FALSE;
+    }
+
+    SERVER_WORKER *workers = g_new0(SERVER_WORKER, workers_count - 1);
+
+    for (guint i = 0; i < (workers_count - 1); i++) {
+        SERVER_WORKER *worker = &workers[i];
+
+        // All workers share the same holder of the routes snapshot.
+        worker->handler_payload = malloc(sizeof(HANDLER_PAYLOAD));
+        memcpy(worker->handler_payload, handler_payload,
+            sizeof(HANDLER_PAYLOAD));
+
+        // But each one has its own response cache and metrics,
+        // so it needs no locking.
+        worker->handler_payload->routes_cache = new_cache(cache_capacity);
+        worker->handler_payload->metrics
+            = handler_payload->metrics_registry->workers[i + 1];
+        worker->handler_payload->access_seed = g_random_int() | 1;
+
+        worker->context = g_main_context_new();
+        worker->loop    = g_main_loop_new(worker->context, FALSE);
+        worker->socket  = sockets[i + 1];
+        worker->thread  = g_thread_new(NULL, (GThreadFunc) _run_worker,
+            worker);
+    }
+
+    g_free(sockets);
+
+    cleanup_args->workers       = workers;
+    cleanup_args->workers_count = workers_count - 1;
+
+    g_message(       MSG_WORKERS_STARTED, workers_count);
+    syslog(LOG_INFO, MSG_WORKERS_STARTED, workers_count);
+
+    return TRUE;
+}
+
 /**
  * Starts up the Soup web server and the main loop.
  *
  * @param server_port       The port number used to run the server.
+ * @param workers_count     The number of server workers to run
+ *                          (the main loop itself counts as the first one).
  * @param debug_log_enabled The debug logging enabler.
- * @param routes_list       The pointer to an array containing
- *                          all available routes.
+ * @param cache_capacity    The capacity of the response cache of each
+ *                          server worker (0 disables the cache).
+ * @param offload_threads   The number of threads to perform direct-route
+ *                          lookups in (0 disables offloading).
+ * @param offload_queue     The number of direct-route lookups allowed
+ *                          to wait for the offload pool threads.
+ * @param admission         The pointer to a structure holding admission
+ *                          control limits (<code>NULL</code> if there are
+ *                          none).
+ * @param tracing           The pointer to a structure holding request
+ *                          tracing settings (<code>NULL</code> if tracing
+ *                          is disabled).
+ * @param access_log        The pointer to a structure holding the access
+ *                          log (<code>NULL</code> if requests are not
+ *                          logged).
+ * @param unix_listener     The pointer to a structure holding settings
+ *                          of the Unix domain socket listener.
+ * @param routes_holder     The pointer to a structure holding
+ *                          the current snapshot of all available routes.
  * @param cleanup_args      The pointer to a structure that holds arguments
  *                          for the <code>_cleanup()</code> helper function.
  *
  * @returns A new <code>GMainLoop</code> main loop instance.
  */
-GMainLoop *startup(const gushort        server_port,
-                   const gboolean       debug_log_enabled,
-                         GPtrArray     *routes_list,
-                         _CLEANUP_ARGS *cleanup_args) {
+GMainLoop *startup(const gushort            server_port,
+                   const guint              workers_count,
+                   const gboolean           debug_log_enabled,
+                   const guint              cache_capacity,
+                   const guint              offload_threads,
+                   const guint              offload_queue,
+                         ADMISSION_CONTROL *admission,
+                         REQUEST_TRACING   *tracing,
+                         ACCESS_LOG        *access_log,
+                   const UNIX_LISTENER     *unix_listener,
+                         ROUTES_HOLDER     *routes_holder,
+                         _CLEANUP_ARGS     *cleanup_args) {
 
     // Creating the Soup web server and the main loop.
     SoupServer *server = soup_server_new(HDR_SERVER_P, EMPTY_STRING, NULL);
@@ -54,20 +388,97 @@ GMainLoop *startup(const gushort        server_port,
     // Attaching HTTP request handlers to process incoming requests -----------
     HANDLER_PAYLOAD *handler_payload   = malloc(sizeof(HANDLER_PAYLOAD));
     handler_payload->debug_log_enabled = debug_log_enabled;
-    handler_payload->routes_list       = routes_list;
+    handler_payload->routes_holder     = routes_holder;
+    handler_payload->routes_cache      = new_cache(cache_capacity);
+    handler_payload->metrics_registry  = new_metrics(MAX(workers_count, 1));
+    handler_payload->metrics = handler_payload->metrics_registry->workers[0];
+    handler_payload->offload_pool        = NULL;
+    handler_payload->offload_queue_depth = offload_queue;
+    handler_payload->admission           = admission;
+    handler_payload->tracing             = tracing;
+    handler_payload->access_log          = access_log;
+    handler_payload->access_seed         = g_random_int() | 1;
+
+    // Starting up the pool of threads to hand direct-route lookups over to,
+    // shared by all server workers.
+    if (offload_threads > 0) {
+        GError *error = NULL;
+
+        handler_payload->offload_pool = g_thread_pool_new(offload_handler,
+            NULL, offload_threads, TRUE, &error);
+
+        if (handler_payload->offload_pool != NULL) {
+            g_message(       MSG_OFFLOAD_STARTED, offload_threads,
+                offload_queue);
+            syslog(LOG_INFO, MSG_OFFLOAD_STARTED, offload_threads,
+                offload_queue);
+        } else {
+            g_warning(ERR_CANNOT_START_OFFLOAD_POOL, error->message);
+
+            g_clear_error(&error);
+        }
+    }
+
+    cleanup_args->handler_payload = handler_payload;
 
     soup_server_add_handler(server, NULL, request_handler,
                                           handler_payload, NULL);
+
+    // Shedding requests over the admission control limits as soon as
+    // their headers are read, before any handling work is done on them.
+    if (admission != NULL) {
+        g_signal_connect(server, REQUEST_STARTED, G_CALLBACK(admit_request),
+            handler_payload);
+    }
+
+    // Rejecting oversized batch request bodies while they are being read,
+    // rather than once they are read into memory in full.
+    g_signal_connect(server, REQUEST_STARTED, G_CALLBACK(cap_request_body),
+        handler_payload);
     // ------------------------------------------------------------------------
 
     GError *error = NULL;
 
-    // Setting up the daemon to listen on all TCP IPv4 and IPv6 interfaces.
-    if (soup_server_listen_all(server, server_port,
-        (SoupServerListenOptions) NULL, &error)) {
+    gboolean is_listening = TRUE;
 
-        g_message(       MSG_SERVER_STARTED, server_port);
-        syslog(LOG_INFO, MSG_SERVER_STARTED, server_port);
+    // Setting up the daemon to listen on a Unix domain socket (if any),
+    // for co-located clients, served by the main loop.
+    if (unix_listener->path != NULL) {
+        is_listening = _listen_unix_socket(server, unix_listener, &error);
+
+        if (is_listening) {
+            cleanup_args->unix_socket_path = unix_listener->path;
+        } else {
+            g_warning(ERR_CANNOT_LISTEN_UNIX_SOCKET, unix_listener->path,
+                error->message);
+        }
+    }
+
+    if (is_listening && !unix_listener->only) {
+        if (workers_count > 1) {
+            // Setting up the daemon to run a number of server workers
+            // listening on the same port, each one in its own thread.
+            is_listening = _start_workers(server, server_port,
+                workers_count, cache_capacity, handler_payload, cleanup_args,
+                &error);
+        } else {
+            // Setting up the daemon to listen on all TCP IPv4 and IPv6
+            // interfaces.
+            is_listening = soup_server_listen_all(server, server_port,
+                (SoupServerListenOptions) NULL, &error);
+        }
+    }
+
+    if (is_listening) {
+        if (unix_listener->path != NULL) {
+            g_message(       MSG_UNIX_SOCKET_STARTED, unix_listener->path);
+            syslog(LOG_INFO, MSG_UNIX_SOCKET_STARTED, unix_listener->path);
+        }
+
+        if (!unix_listener->only) {
+            g_message(       MSG_SERVER_STARTED, server_port);
+            syslog(LOG_INFO, MSG_SERVER_STARTED, server_port);
+        }
 
         // Starting up the daemon by running the main loop.
         g_main_loop_run(loop);
@@ -78,6 +489,14 @@ GMainLoop *startup(const gushort        server_port,
 
         g_clear_error(&error);
 
+        cleanup_args->handler_payload = NULL;
+
+        if (handler_payload->offload_pool != NULL) {
+            g_thread_pool_free(handler_payload->offload_pool, TRUE, TRUE);
+        }
+
+        free_metrics(handler_payload->metrics_registry);
+        free_cache(handler_payload->routes_cache);
         free(handler_payload);
 
         _cleanup(cleanup_args);
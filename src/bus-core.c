@@ -37,8 +37,11 @@ int main(int argc, char *const *argv) {
     GFileOutputStream *log_stream = g_file_append_to(logfile,
         G_FILE_CREATE_NONE, NULL, NULL);
 
-    // Registering the log writer callback.
-    g_log_set_writer_func(log_writer, log_stream, NULL);
+    // Registering the log writer callback, writing log entries
+    // out through the log sink.
+    LOG_SINK *log_sink = new_log_sink((GOutputStream *) log_stream, TRUE);
+
+    g_log_set_writer_func(log_writer, log_sink, NULL);
 
     // Opening the system logger.
     openlog(NULL, LOG_CONS | LOG_PID, LOG_DAEMON);
@@ -47,24 +50,114 @@ int main(int argc, char *const *argv) {
     GKeyFile *settings = _get_settings();
 
     gushort server_port = DEF_PORT;
+    guint server_workers = DEF_WORKERS;
+    UNIX_LISTENER unix_listener = { NULL, DEF_UNIX_SOCKET_MODE, NULL, FALSE };
     gboolean debug_log_enabled = TRUE;
     gchar *datastore = EMPTY_STRING;
+    gboolean datastore_monitored = FALSE;
+    gboolean datastore_pruned = FALSE;
+    ROUTES_ENGINE engine = ENGINE_INDEX;
+    guint64 table_limit = (guint64) DEF_TABLE_LIMIT << 20;
+    guint64 transfers_limit = (guint64) DEF_TRANSFERS_LIMIT << 20;
+    guint64 reachable_limit = (guint64) DEF_REACHABLE_LIMIT << 20;
+    guint cache_capacity = 0;
+    guint offload_threads = 0;
+    guint offload_queue = DEF_OFFLOAD_QUEUE_DEPTH;
+    guint max_in_flight = 0;
+    guint max_queue_wait = 0;
+    guint retry_after = DEF_RETRY_AFTER;
+    gboolean server_timing = FALSE;
+    guint slow_threshold = 0;
+    gboolean access_log_enabled = FALSE;
+    gdouble access_sample_rate = 1;
+    guint access_rate_limit = 0;
+    guint access_rate_burst = 0;
+    guint log_buffer_size = DEF_LOG_BUFFER_SIZE;
+    LOG_OVERFLOW log_overflow = LOG_OVERFLOW_DROP;
 
     if (settings != NULL) {
         // Getting the port number used to run the server,
         // from daemon settings.
         server_port = get_server_port(settings);
 
+        // Getting the number of server workers to run.
+        server_workers = get_server_workers(settings);
+
+        // Getting the Unix domain socket to listen on (if any),
+        // along with its file mode and owner.
+        unix_listener.path  = get_unix_socket_path( settings);
+        unix_listener.mode  = get_unix_socket_mode( settings);
+        unix_listener.owner = get_unix_socket_owner(settings);
+        unix_listener.only  = is_unix_socket_only(  settings)
+                           && (unix_listener.path != NULL);
+
         // Identifying whether debug logging is enabled.
         debug_log_enabled = is_debug_log_enabled(settings);
 
+        // Getting the log buffer size and overflow policy.
+        log_buffer_size = get_log_buffer_size(    settings);
+        log_overflow    = get_log_overflow_policy(settings);
+
         // Getting the path and filename of the routes data store
         // from daemon settings.
         datastore = get_routes_datastore(settings);
 
+        // Identifying whether the routes data store has to be monitored
+        // for changes.
+        datastore_monitored = is_datastore_monitored(settings);
+
+        // Identifying whether duplicate and dominated routes
+        // have to be pruned.
+        datastore_pruned = is_datastore_pruned(settings);
+
+        // Getting the direct-route engine and the memory limit
+        // for its precomputed table from daemon settings.
+        engine      = get_routes_engine(settings);
+        table_limit = get_table_memory_limit(settings);
+
+        // Getting the memory limit for the route-to-route transfers graph.
+        transfers_limit = get_transfers_memory_limit(settings);
+
+        // Getting the memory limit for the reachable bus stops sets.
+        reachable_limit = get_reachable_memory_limit(settings);
+
+        // Getting the capacity of the response cache of each server worker.
+        cache_capacity = get_cache_capacity(settings);
+
+        // Getting the number of threads to hand direct-route lookups over
+        // to, and the number of lookups allowed to wait for them.
+        offload_threads = get_offload_pool_size(  settings);
+        offload_queue   = get_offload_queue_depth(settings);
+
+        // Getting admission control limits, over which requests are shed.
+        max_in_flight  = get_max_in_flight( settings);
+        max_queue_wait = get_max_queue_wait(settings);
+        retry_after    = get_retry_after(   settings);
+
+        // Getting request tracing settings: whether phase timings are sent
+        // back, and how slow a request has to be to get logged.
+        server_timing  = is_server_timing_enabled(  settings);
+        slow_threshold = get_slow_request_threshold(settings);
+
+        // Getting access log settings: whether requests are logged at all,
+        // the share of them sampled, and how many of them per second.
+        access_log_enabled = is_access_log_enabled( settings);
+        access_sample_rate = get_access_sample_rate(settings);
+        access_rate_limit  = get_access_rate_limit( settings);
+        access_rate_burst  = get_access_rate_burst( settings);
+
         g_free(settings);
     }
 
+    // From now on, log entries are written out by a background thread.
+    start_log_sink(log_sink, log_buffer_size, log_overflow);
+
+    // Opening the access log (if enabled), written out by a background
+    // thread of its own, apart from the logfile.
+    ACCESS_LOG *access_log = access_log_enabled ? new_access_log(
+        access_sample_rate, access_rate_limit, access_rate_burst,
+        log_buffer_size) : NULL;
+
     if ((datastore == NULL) || (g_utf8_strlen(datastore, -1) == 0)) {
         datastore = g_strdup(SAMPLE_ROUTES);
     }
@@ -72,9 +165,15 @@ int main(int argc, char *const *argv) {
     GFile *data = g_file_new_for_path(datastore);
 
     _CLEANUP_ARGS *_cleanup_args = malloc(sizeof(_CLEANUP_ARGS));
-    _cleanup_args->log_stream    = log_stream;
-    _cleanup_args->logfile       = logfile;
-    _cleanup_args->loop          = NULL;
+    _cleanup_args->log_stream      = log_stream;
+    _cleanup_args->log_sink        = log_sink;
+    _cleanup_args->logfile         = logfile;
+    _cleanup_args->access_log      = access_log;
+    _cleanup_args->loop            = NULL;
+    _cleanup_args->handler_payload = NULL;
+    _cleanup_args->workers         = NULL;
+    _cleanup_args->workers_count   = 0;
+    _cleanup_args->unix_socket_path = NULL;
 
     if (!g_file_query_exists(data, NULL)) {
         g_warning(ERR_DATASTORE_NOT_FOUND);
@@ -88,57 +187,73 @@ int main(int argc, char *const *argv) {
         exit(EXIT_FAILURE);
     }
 
-    GFileInputStream *routes = g_file_read(data, NULL, NULL);
+    g_object_unref(data);
 
-    // Querying for the size of the routes data store.
-    GFileInfo *data_info = g_file_query_info(data,
-        G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    // Loading routes: parsing them into a compact array of bus stop IDs,
+    // and building whatever the direct-route engine needs.
+    ROUTES_STORE *routes_store = load_routes(datastore, datastore_pruned,
+        engine, table_limit);
 
-    // Getting the size of the routes data store.
-    goffset data_size = g_file_info_get_size(data_info);
+    if (routes_store == NULL) {
+        g_warning(ERR_DATASTORE_NOT_FOUND);
 
-    // Reading routes from the routes data store.
-    gchar *routes_buff = g_malloc(data_size);
-    g_input_stream_read((GInputStream *) routes, routes_buff, data_size,
-        NULL, NULL);
+        g_free(datastore);
 
-    gchar **routes_list = g_strsplit(routes_buff, NEW_LINE, 0);
-    guint routes_len = g_strv_length(routes_list) - 1;
+        _cleanup(_cleanup_args);
+        free(_cleanup_args);
 
-//  for (guint i = 0; i < routes_len; i++) {
-//      g_debug(LOG_FORMAT, routes_list[i]);
-//  }
+        exit(EXIT_FAILURE);
+    }
 
-    // |Like|  routes_list =   new ArrayList();
-    GPtrArray *routes_gary = g_ptr_array_new();
+    // Linking routes to one another, to search for transfers between them.
+    link_routes(routes_store, transfers_limit);
 
-    GRegex *route_id_regex = g_regex_new(ROUTE_ID_REGEX, 0, 0, NULL);
+    // Collecting the bus stops reachable directly from each bus stop.
+    reach_stops(routes_store, reachable_limit);
 
-    for (guint i = 0; i < routes_len; i++) {
-        gchar *route_ = g_strconcat(routes_list[i], SPACE, NULL);
-        gchar *route  = g_regex_replace(route_id_regex, route_, -1, 0,
-            EMPTY_STRING, 0, NULL);
+    // Publishing routes as the first snapshot, to be replaced
+    // by subsequent reloads of the routes data store.
+    ROUTES_HOLDER *routes_holder = g_new0(ROUTES_HOLDER, 1);
+    routes_holder->datastore     = datastore;
+    routes_holder->prune         = datastore_pruned;
+    routes_holder->engine        = engine;
+    routes_holder->table_limit   = table_limit;
+    routes_holder->transfers_limit = transfers_limit;
+    routes_holder->reachable_limit = reachable_limit;
 
-        g_ptr_array_add(routes_gary, route);
+    publish_routes(routes_holder, routes_store);
 
-//      g_debug("%u" SPACE EQUALS SPACE LOG_FORMAT, (i + 1),
-//          (gchar *) g_ptr_array_index(routes_gary, i));
+    // Reloading the routes data store on SIGHUP and, optionally,
+    // each time it gets changed.
+    g_unix_signal_add(SIGHUP, (GSourceFunc) reload_routes, routes_holder);
 
-        g_free(route_);
-    }
+    if (datastore_monitored) { monitor_routes(routes_holder); }
+
+    ADMISSION_CONTROL *admission = new_admission(max_in_flight,
+        max_queue_wait, retry_after);
+
+    REQUEST_TRACING *tracing = new_tracing(server_timing, slow_threshold);
 
     // Starting up the Soup web server and the main loop.
     GMainLoop *loop __attribute__ ((unused)) = startup(server_port,
-        debug_log_enabled, routes_gary, _cleanup_args);
-
-    g_regex_unref(route_id_regex);
-    g_ptr_array_unref(routes_gary);
-    g_strfreev(routes_list);
-    g_free(routes_buff);
-    g_object_unref(data_info);
-    g_input_stream_close((GInputStream *) routes, NULL, NULL);
-    g_object_unref(routes);
-    g_object_unref(data);
+        server_workers, debug_log_enabled, cache_capacity, offload_threads,
+        offload_queue, admission, tracing, access_log, &unix_listener,
+        routes_holder, _cleanup_args);
+
+    g_clear_object(&routes_holder->monitor);
+
+    // Letting a reload in progress (if any) finish off.
+    while (g_atomic_int_get(&routes_holder->reload_state) != RELOAD_IDLE) {
+        g_usleep(G_USEC_PER_SEC / 100);
+    }
+
+    unref_routes(routes_holder->routes);
+    g_free(routes_holder);
+    free_admission(admission);
+    free_tracing(tracing);
+    free_access_log(access_log);
+    g_free(unix_listener.owner);
+    g_free(unix_listener.path);
     g_free(datastore);
 }
 
@@ -0,0 +1,190 @@
+/*
+ * src/bus-generator.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The synthetic routes data store generator ----------------------------------
+
+#include "busd.h"
+
+// Helper structure to hold parameters of the synthetic routes data store.
+typedef struct {
+    guint   routes_count;
+    guint   stops_per_route;
+    guint32 universe;
+    gdouble skew;
+    guint32 seed;
+} _GEN_ARGS;
+
+// Helper type. The function writing the contents of an output file out.
+typedef gboolean (*_FILE_WRITER)(GOutputStream *, gconstpointer, GError **);
+
+// Helper function. Writes the synthetic routes data store out.
+static gboolean _write_routes(GOutputStream  *stream,
+                              gconstpointer   data,
+                              GError        **error) {
+
+    const _GEN_ARGS *args = data;
+
+    return generate_routes(stream, args->routes_count, args->stops_per_route,
+        args->universe, args->skew, args->seed, error);
+}
+
+// Helper function. Writes the query workload out.
+static gboolean _write_queries(GOutputStream  *stream,
+                               gconstpointer   data,
+                               GError        **error) {
+
+    return write_workload(stream, data, error);
+}
+
+// Helper function. Writes the file given out through the writer function
+// given. An existing file gets replaced only if the new one is written out
+// completely.
+static gboolean _write_file(const gchar        *path,
+                            const _FILE_WRITER  writer,
+                                  gconstpointer data) {
+
+    GFile        *file        = g_file_new_for_path(path);
+    GCancellable *cancellable = g_cancellable_new();
+    GError       *error       = NULL;
+
+    GFileOutputStream *out = g_file_replace(file, NULL, FALSE,
+        G_FILE_CREATE_REPLACE_DESTINATION, NULL, &error);
+
+    gboolean is_written = (out != NULL)
+        && writer((GOutputStream *) out, data, &error);
+
+    if (out != NULL) {
+        // Discarding a partially written file.
+        if (!is_written) { g_cancellable_cancel(cancellable); }
+
+        is_written = g_output_stream_close((GOutputStream *) out,
+            cancellable, is_written ? &error : NULL) && is_written;
+
+        g_object_unref(out);
+    }
+
+    if (!is_written) {
+        g_warning(ERR_CANNOT_WRITE_FILE, path, (error != NULL)
+            ? error->message : path);
+
+        g_clear_error(&error);
+    }
+
+    g_object_unref(cancellable);
+    g_object_unref(file);
+
+    return is_written;
+}
+
+/**
+ * The routes data store generator entry point. Generates a synthetic
+ * routes data store of the size and the shape given, then loads it back
+ * and generates a matching workload of direct-route queries,
+ * with the share of queries having direct routes given.
+ *
+ * @param argc The number of command-line arguments + 1 (the generator name).
+ * @param argv The pointer to an array of command-line arguments,
+ *             including the generator name: options (see
+ *             <code>busgen --help</code>), the path and filename
+ *             of the routes data store, and the ones of the query workload.
+ *
+ * @returns The exit code of the overall termination of the generator.
+ */
+int main(int argc, char **argv) {
+    gint    routes_count    = DEF_GEN_ROUTES;
+    gint    stops_per_route = DEF_GEN_STOPS_PER_ROUTE;
+    gint    universe        = DEF_GEN_UNIVERSE;
+    gdouble skew            = DEF_GEN_SKEW;
+    gint    queries         = DEF_GEN_QUERIES;
+    gdouble hit_ratio       = DEF_GEN_HIT_RATIO;
+    gint    seed            = DEF_GEN_SEED;
+
+    GOptionEntry options[] = {
+        { GEN_OPT_ROUTES,    'r', 0, G_OPTION_ARG_INT,    &routes_count,
+            GEN_OPT_ROUTES_HELP,    GEN_OPT_N },
+        { GEN_OPT_STOPS,     's', 0, G_OPTION_ARG_INT,    &stops_per_route,
+            GEN_OPT_STOPS_HELP,     GEN_OPT_N },
+        { GEN_OPT_UNIVERSE,  'u', 0, G_OPTION_ARG_INT,    &universe,
+            GEN_OPT_UNIVERSE_HELP,  GEN_OPT_N },
+        { GEN_OPT_SKEW,      'k', 0, G_OPTION_ARG_DOUBLE, &skew,
+            GEN_OPT_SKEW_HELP,      GEN_OPT_X },
+        { GEN_OPT_QUERIES,   'q', 0, G_OPTION_ARG_INT,    &queries,
+            GEN_OPT_QUERIES_HELP,   GEN_OPT_N },
+        { GEN_OPT_HIT_RATIO, 'H', 0, G_OPTION_ARG_DOUBLE, &hit_ratio,
+            GEN_OPT_HIT_RATIO_HELP, GEN_OPT_X },
+        { GEN_OPT_SEED,      'S', 0, G_OPTION_ARG_INT,    &seed,
+            GEN_OPT_SEED_HELP,      GEN_OPT_N },
+        { NULL }
+    };
+
+    GOptionContext *context = g_option_context_new(GEN_USAGE);
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    GError *error = NULL;
+
+    gboolean is_parsed = g_option_context_parse(context, &argc, &argv,
+        &error);
+
+    // The total number of bus stops has to fit in 32-bit route offsets.
+    if (!is_parsed || (argc != 3) || (routes_count < 1)
+        || (stops_per_route < 1) || (universe < 1) || (universe == G_MAXINT32)
+        || (((guint64) routes_count * stops_per_route) >= G_MAXUINT32)
+        || (skew < 0) || (queries < 0) || (hit_ratio < 0) || (hit_ratio > 1)) {
+
+        gchar *help = g_option_context_get_help(context, TRUE, NULL);
+
+        g_printerr(LOG_FORMAT, (error != NULL) ? error->message : help);
+
+        g_free(help);
+        g_clear_error(&error);
+        g_option_context_free(context);
+
+        return EXIT_FAILURE;
+    }
+
+    g_option_context_free(context);
+
+    _GEN_ARGS args = { routes_count, stops_per_route, universe, skew, seed };
+
+    if (!_write_file(argv[1], _write_routes, &args)) {
+        return EXIT_FAILURE;
+    }
+
+    // Loading the routes data store back, to draw queries from it,
+    // and to check whether they have direct routes, or not.
+    ROUTES_STORE *routes = load_routes(argv[1], FALSE, ENGINE_INDEX, 0);
+
+    if (routes == NULL) {
+        g_warning(ERR_DATASTORE_NOT_FOUND);
+
+        return EXIT_FAILURE;
+    }
+
+    QUERY_WORKLOAD *workload = new_workload(routes, queries, hit_ratio,
+        seed);
+
+    gboolean is_written = _write_file(argv[2], _write_queries, workload);
+
+    if (is_written) {
+        g_message(MSG_ROUTES_GENERATED, routes->routes_count,
+            routes->stops_count, routes->stop_ids_count, workload->count);
+    }
+
+    free_workload(workload);
+    free_routes(routes);
+
+    return is_written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -15,28 +15,824 @@
 
 #include "busd.h"
 
+// Helper function. Parses a request param into a bus stop ID, without
+// any intermediate allocations. Leading spaces are skipped, and parsing
+// stops at the first non-digit character.
+// Returns 0 if the param is missing or out of the allowed range.
+static guint32 _parse_stop_id(const gchar *param) {
+    if (param == NULL) { return 0; }
+
+    while (g_ascii_isspace(*param)) { param++; }
+
+    guint64 stop_id = 0;
+
+    while (g_ascii_isdigit(*param)) {
+        stop_id = (stop_id * 10) + (*param++ - '0');
+
+        if (stop_id > G_MAXINT32) { return 0; }
+    }
+
+    return stop_id;
+}
+
+// Helper function. Logs the URI of a request that cannot be served.
+static void _debug_uri(SoupServerMessage *msg) {
+    gchar *uri = g_uri_to_string(soup_server_message_get_uri(msg));
+
+    g_debug(LOG_FORMAT, uri);
+
+    g_free(uri);
+}
+
+// Helper function. Gets a bus stop ID out of a JSON node.
+// Returns 0 if the node is missing, is not an integer number
+// (rather than truncating a fractional one), or is out of the allowed range.
+static guint32 _json_stop_id(JsonNode *node) {
+    if ((node == NULL)
+        || (json_node_get_node_type(node) != JSON_NODE_VALUE)
+        || (json_node_get_value_type(node) != G_TYPE_INT64)) {
+
+        return 0;
+    }
+
+    gint64 stop_id = json_node_get_int(node);
+
+    if ((stop_id < 1) || (stop_id > G_MAXINT32)) { return 0; }
+
+    return stop_id;
+}
+
+// Helper function. Responds to the batch request with a prerendered
+// 413 Request Entity Too Large response.
+static void _reject_batch_body(SoupServerMessage *msg) {
+    _debug_uri(msg);
+
+    soup_server_message_set_status(msg,
+        SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE, NULL);
+
+    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+        RESP_BATCH_TOO_LARGE, strlen(RESP_BATCH_TOO_LARGE));
+}
+
+// Helper structure to hold the size of a batch request body read so far,
+// along with the payload of the server worker reading it.
+typedef struct {
+    HANDLER_PAYLOAD *handler_payload;
+    goffset          length;
+} _BODY_CAP;
+
+// Helper function. The got chunk signal callback: rejects the batch
+// request as soon as its body (sent in chunks, with no length declared
+// upfront) exceeds the allowed size. The rest of the body is read
+// and dropped rather than kept, and the request handler is not called.
+static void _cap_body_chunk(SoupServerMessage *msg,
+                            GBytes            *chunk,
+                            _BODY_CAP         *cap) {
+
+    if (soup_server_message_get_status(msg) != SOUP_STATUS_NONE) { return; }
+
+    cap->length += g_bytes_get_size(chunk);
+
+    if (cap->length <= MAX_BATCH_BODY_SIZE) { return; }
+
+    SoupMessageBody *body = soup_server_message_get_request_body(msg);
+
+    soup_message_body_set_accumulate(body, FALSE);
+    soup_message_body_truncate(body);
+
+    _reject_batch_body(msg);
+
+    // The request handler is not going to be called for the request.
+    count_request(cap->handler_payload->metrics,
+        SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE);
+}
+
+// Helper function. The got headers signal callback: rejects the batch
+// request right away, before its body gets read, if its declared length
+// exceeds the allowed size, or otherwise keeps track of the body size
+// while it is being read.
+static void _cap_body_headers(SoupServerMessage *msg,
+                              HANDLER_PAYLOAD   *handler_payload) {
+
+    // Shed already (if at all) by the admission control.
+    if (soup_server_message_get_status(msg) != SOUP_STATUS_NONE) { return; }
+
+    if ((g_strcmp0(soup_server_message_get_method(msg), HTTP_POST) != 0)
+        || (g_strcmp0(soup_server_message_get_path(msg), SLASH REST_PREFIX
+                      SLASH REST_DIRECT SLASH REST_BATCH) != 0)) {
+
+        return;
+    }
+
+    SoupMessageHeaders *req_headers
+        = soup_server_message_get_request_headers(msg);
+
+    if ((soup_message_headers_get_encoding(req_headers)
+        == SOUP_ENCODING_CONTENT_LENGTH)
+        && (soup_message_headers_get_content_length(req_headers)
+        > MAX_BATCH_BODY_SIZE)) {
+
+        _reject_batch_body(msg);
+
+        // The request handler is not going to be called for the request.
+        count_request(handler_payload->metrics,
+            SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE);
+
+        return;
+    }
+
+    _BODY_CAP *cap       = g_new0(_BODY_CAP, 1);
+    cap->handler_payload = handler_payload;
+
+    g_signal_connect_data(msg, GOT_CHUNK, G_CALLBACK(_cap_body_chunk), cap,
+        (GClosureNotify) g_free, (GConnectFlags) 0);
+}
+
 /**
- * The default request handler callback.
- * Used to process the incoming request.
+ * The request started signal callback. Used to cap the size of the body
+ * of the incoming batch request: it gets rejected as soon as its headers
+ * declare a body over the limit, or as soon as as much of its body
+ * has arrived, rather than once the whole body is read into memory.
  *
  * @param server  The Soup web server instance.
- * @param msg     The request message to be processed.
- * @param path    The path  component of request message URI.
- * @param query   The query component of request message URI.
+ * @param msg     The request message just started to be read.
  * @param payload The pointer to a payload data passed from the controller.
  */
-void request_handler(      SoupServer        *server,
-                           SoupServerMessage *msg,
-                     const char              *path,
-                           GHashTable        *query,
-                           gpointer           payload) {
+void cap_request_body(SoupServer        *server,
+                      SoupServerMessage *msg,
+                      gpointer           payload) {
+
+    g_signal_connect(msg, GOT_HEADERS, G_CALLBACK(_cap_body_headers),
+        payload);
+}
+
+// Helper function. Processes the batch request: parses the request body
+// (a JSON array of bus stop pairs), performs the routes processing
+// for all the pairs at once, and renders the JSON array of results.
+static void _batch_request_handler(SoupServerMessage *msg,
+                                   HANDLER_PAYLOAD   *handler_payload,
+                                   REQUEST_TRACE     *trace) {
+
+    SoupMessageBody *body = soup_server_message_get_request_body(msg);
+
+    // Rejecting oversized bodies before they get flattened and parsed,
+    // should any get past the checks made while they are being read.
+    if (body->length > MAX_BATCH_BODY_SIZE) {
+        _reject_batch_body(msg);
+
+        return;
+    }
+
+    GBytes *req_body = soup_message_body_flatten(body);
+
+    gsize req_len = 0;
+    const gchar *req_data = g_bytes_get_data(req_body, &req_len);
+
+    JsonParser *json_parser = json_parser_new();
+    JsonArray  *json_pairs  = NULL;
+
+    if ((req_data != NULL) && json_parser_load_from_data(json_parser,
+        req_data, req_len, NULL)) {
+
+        JsonNode *json_root = json_parser_get_root(json_parser);
+
+        if ((json_root != NULL)
+            && (json_node_get_node_type(json_root) == JSON_NODE_ARRAY)) {
+
+            json_pairs = json_node_get_array(json_root);
+        }
+    }
+
+    guint pairs_count = (json_pairs != NULL)
+                      ? json_array_get_length(json_pairs) : 0;
+
+    if (pairs_count > MAX_BATCH_PAIRS) {
+        _debug_uri(msg);
+
+        soup_server_message_set_status(msg,
+            SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE, NULL);
+
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_BATCH_TOO_LARGE, strlen(RESP_BATCH_TOO_LARGE));
+
+        g_object_unref(json_parser);
+        g_bytes_unref(req_body);
+
+        return;
+    }
+
+    guint32 *from = g_new(guint32, pairs_count);
+    guint32 *to   = g_new(guint32, pairs_count);
+
+    gboolean is_request_malformed = (json_pairs == NULL);
+
+    // Pairs might be given either as [from, to] or as {from, to}.
+    for (guint i = 0; (i < pairs_count) && !is_request_malformed; i++) {
+        JsonNode *json_pair = json_array_get_element(json_pairs, i);
+
+        from[i] = to[i] = 0;
+
+        if (json_node_get_node_type(json_pair) == JSON_NODE_ARRAY) {
+            JsonArray *pair = json_node_get_array(json_pair);
+
+            if (json_array_get_length(pair) == 2) {
+                from[i] = _json_stop_id(json_array_get_element(pair, 0));
+                to[i]   = _json_stop_id(json_array_get_element(pair, 1));
+            }
+        } else if (json_node_get_node_type(json_pair) == JSON_NODE_OBJECT) {
+            JsonObject *pair = json_node_get_object(json_pair);
+
+            from[i] = _json_stop_id(json_object_get_member(pair, FROM));
+            to[i]   = _json_stop_id(json_object_get_member(pair, TO  ));
+        }
+
+        if ((from[i] < 1) || (to[i] < 1)) { is_request_malformed = TRUE; }
+    }
+
+    g_object_unref(json_parser);
+    g_bytes_unref(req_body);
+
+    TRACE(trace, PHASE_PARSE);
+
+    if (is_request_malformed) {
+        _debug_uri(msg);
+
+        soup_server_message_set_status(msg, SOUP_STATUS_BAD_REQUEST, NULL);
+
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_BATCH_MALFORMED, strlen(RESP_BATCH_MALFORMED));
+
+        g_free(to  );
+        g_free(from);
+
+        return;
+    }
+
+    if (handler_payload->debug_log_enabled) {
+        g_debug(         REST_BATCH EQUALS UINT_FORMAT, pairs_count);
+        syslog(LOG_DEBUG,REST_BATCH EQUALS UINT_FORMAT, pairs_count);
+
+        TRACE(trace, PHASE_LOG);
+    }
+
+    gboolean *direct = g_new(gboolean, pairs_count);
+
+    ROUTES_STORE *routes = acquire_routes(handler_payload->routes_holder);
+
+    // Performing the routes processing for all the pairs at once.
+    find_direct_routes(routes, from, to, pairs_count, direct);
+
+    unref_routes(routes);
+
+    TRACE(trace, PHASE_LOOKUP);
+
+    GString *json_body = g_string_sized_new(pairs_count * RESP_BUFF_SIZE / 2);
+
+    g_string_append_c(json_body, '[');
+
+    for (guint i = 0; i < pairs_count; i++) {
+        if (i > 0) { g_string_append_c(json_body, ','); }
+
+        g_string_append_printf(json_body, RESP_DIRECT_FORMAT, from[i], to[i],
+            direct[i] ? JSON_TRUE : JSON_FALSE);
+    }
+
+    g_string_append_c(json_body, ']');
+
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+    gsize json_len = json_body->len;
+
+    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_TAKE,
+        g_string_free(json_body, FALSE), json_len);
+
+    g_free(direct);
+    g_free(to    );
+    g_free(from  );
+
+    TRACE(trace, PHASE_RENDER);
+}
+
+// Helper function. Serves the GET /metrics request.
+static void _metrics_request_handler(SoupServerMessage *msg,
+                                     HANDLER_PAYLOAD   *handler_payload,
+                                     REQUEST_TRACE     *trace) {
+
+    ROUTES_STORE *routes = acquire_routes(handler_payload->routes_holder);
+
+    GString *body = render_metrics(handler_payload->metrics_registry, routes);
+
+    unref_routes(routes);
+
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+    gsize body_len = body->len;
+
+    soup_server_message_set_response(msg, MIME_TYPE_METRICS,
+        SOUP_MEMORY_TAKE, g_string_free(body, FALSE), body_len);
+
+    TRACE(trace, PHASE_RENDER);
+}
+
+// Helper function. Parses the maximum number of transfers request param.
+// Returns the default one if the param is missing, or TRANSFERS_NOT_FOUND
+// if it's not a number in the allowed range.
+static guint _parse_max_transfers(const gchar *param) {
+    if (param == NULL) { return DEF_MAX_TRANSFERS; }
+
+    while (g_ascii_isspace(*param)) { param++; }
+
+    if (!g_ascii_isdigit(*param)) { return TRANSFERS_NOT_FOUND; }
+
+    guint max = 0;
+
+    while (g_ascii_isdigit(*param)) {
+        max = (max * 10) + (*param++ - '0');
+
+        if (max > MAX_TRANSFERS) { return TRANSFERS_NOT_FOUND; }
+    }
+
+    return max;
+}
+
+// Helper function. Serves the GET /route/transfers request: finds
+// the minimal number of transfers between two bus stop points,
+// and renders it along with the itinerary found.
+static void _transfers_request_handler(SoupServerMessage *msg,
+                                       GHashTable        *query,
+                                       HANDLER_PAYLOAD   *handler_payload,
+                                       REQUEST_TRACE     *trace,
+                                       ACCESS_ENTRY      *entry) {
+
+    gchar *from_ = NULL;
+    gchar *to_   = NULL;
+    gchar *max_  = NULL;
+
+    if (query != NULL) {
+        from_ = g_hash_table_lookup(query, FROM);
+        to_   = g_hash_table_lookup(query, TO  );
+        max_  = g_hash_table_lookup(query, MAX_);
+    }
+
+    guint32 from = _parse_stop_id(from_);
+    guint32 to   = _parse_stop_id(to_  );
+    guint   max  = _parse_max_transfers(max_);
+
+    if (entry != NULL) { entry->from = from; entry->to = to; }
+
+    TRACE(trace, PHASE_PARSE);
+
+    if ((from < 1) || (to < 1) || (max == TRANSFERS_NOT_FOUND)) {
+        _debug_uri(msg);
+
+        soup_server_message_set_status(msg, SOUP_STATUS_BAD_REQUEST, NULL);
+
+        if (max == TRANSFERS_NOT_FOUND) {
+            soup_server_message_set_response(msg, MIME_TYPE,
+                SOUP_MEMORY_STATIC, RESP_BAD_MAX_TRANSFERS,
+                strlen(RESP_BAD_MAX_TRANSFERS));
+        } else {
+            soup_server_message_set_response(msg, MIME_TYPE,
+                SOUP_MEMORY_STATIC, RESP_BAD_REQUEST,
+                strlen(RESP_BAD_REQUEST));
+        }
+
+        return;
+    }
+
+    if (handler_payload->debug_log_enabled) {
+        g_debug(         REST_TRANSFERS SPACE UINT_FORMAT SPACE V_BAR SPACE
+            UINT_FORMAT SPACE V_BAR SPACE UINT_FORMAT, from, to, max);
+        syslog(LOG_DEBUG,REST_TRANSFERS SPACE UINT_FORMAT SPACE V_BAR SPACE
+            UINT_FORMAT SPACE V_BAR SPACE UINT_FORMAT, from, to, max);
+
+        TRACE(trace, PHASE_LOG);
+    }
+
+    TRANSFER_LEG legs[MAX_TRANSFERS + 1];
+
+    ROUTES_STORE *routes = acquire_routes(handler_payload->routes_holder);
+
+    // Transfers may be turned off by their memory limit.
+    if (!routes->transferable) {
+        unref_routes(routes);
+
+        soup_server_message_set_status(msg, SOUP_STATUS_NOT_FOUND, NULL);
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_NOT_FOUND, strlen(RESP_NOT_FOUND));
+
+        return;
+    }
+
+    guint transfers = find_transfers(routes, from, to, max, legs);
+
+    unref_routes(routes);
+
+    TRACE(trace, PHASE_LOOKUP);
+
+    GString *json_body = g_string_sized_new(RESP_BUFF_SIZE
+                                          * (MAX_TRANSFERS + 2));
+
+    g_string_append_printf(json_body, RESP_TRANSFERS_FORMAT, from, to);
+
+    if (transfers == TRANSFERS_NOT_FOUND) {
+        g_string_append(json_body, JSON_NULL "," RESP_ITINERARY);
+    } else {
+        g_string_append_printf(json_body, UINT_FORMAT "," RESP_ITINERARY,
+            transfers);
+
+        for (guint i = 0; i <= transfers; i++) {
+            if (i > 0) { g_string_append_c(json_body, ','); }
+
+            g_string_append_printf(json_body, RESP_LEG_FORMAT,
+                legs[i].route, legs[i].from, legs[i].to);
+        }
+    }
+
+    g_string_append(json_body, "]}");
+
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+    gsize json_len = json_body->len;
+
+    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_TAKE,
+        g_string_free(json_body, FALSE), json_len);
+
+    TRACE(trace, PHASE_RENDER);
+}
+
+// Helper structure to hold a reachable bus stops response being streamed,
+// along with the snapshot of routes it comes from.
+typedef struct {
+    ROUTES_STORE *routes;
+    STOPS_CURSOR  cursor;
+    guint         left;    // The number of bus stops still allowed.
+    gboolean      started; // Whether any bus stop has been rendered.
+    gboolean      done;    // Whether the response body is complete.
+} _REACHABLE_STREAM;
+
+// Helper function. Frees the reachable bus stops response stream,
+// releasing the snapshot of routes it comes from.
+static void _free_stream(_REACHABLE_STREAM *stream) {
+    unref_routes(stream->routes);
+
+    g_free(stream);
+}
+
+// Helper function. Renders the next chunk of the reachable bus stops
+// response body, and completes the body once the last bus stop is there.
+// Gets called each time the chunk before is written out, so that
+// no more than a chunk of the response is held in memory at a time.
+static void _write_reachable(SoupServerMessage *msg,
+                             _REACHABLE_STREAM *stream) {
+
+    if (stream->done) { return; }
+
+    const guint32 *stop_ids = stream->routes->stop_ids;
+
+    GString *chunk = g_string_sized_new(RESP_CHUNK_SIZE + RESP_BUFF_SIZE);
+
+    guint32 stops[PACK_BLOCK_SIZE];
+
+    while ((chunk->len < RESP_CHUNK_SIZE) && (stream->left > 0)) {
+        guint count = unpack_stops(&stream->cursor, stops);
+
+        if (count == 0) { stream->left = 0; }
+
+        count = MIN(count, stream->left);
+
+        for (guint i = 0; i < count; i++) {
+            if (stream->started) { g_string_append_c(chunk, ','); }
+
+            g_string_append_printf(chunk, UINT_FORMAT, stop_ids[stops[i]]);
+
+            stream->started = TRUE;
+        }
+
+        stream->left -= count;
+    }
+
+    if (stream->left == 0) {
+        g_string_append(chunk, "]}");
+
+        stream->done = TRUE;
+    }
+
+    SoupMessageBody *body = soup_server_message_get_response_body(msg);
+
+    gsize chunk_len = chunk->len;
+
+    soup_message_body_append(body, SOUP_MEMORY_TAKE,
+        g_string_free(chunk, FALSE), chunk_len);
+
+    if (stream->done) { soup_message_body_complete(body); }
+}
+
+// Helper function. Serves the GET /route/reachable request: finds all
+// the bus stops reachable directly from a bus stop point, and streams
+// them out (up to the limit given, if any) as a JSON array, chunk
+// by chunk, in ascending order.
+static void _reachable_request_handler(SoupServerMessage *msg,
+                                       GHashTable        *query,
+                                       HANDLER_PAYLOAD   *handler_payload,
+                                       REQUEST_TRACE     *trace,
+                                       ACCESS_ENTRY      *entry) {
+
+    gchar *from_  = NULL;
+    gchar *limit_ = NULL;
+
+    if (query != NULL) {
+        from_  = g_hash_table_lookup(query, FROM );
+        limit_ = g_hash_table_lookup(query, LIMIT);
+    }
+
+    guint32 from  = _parse_stop_id(from_);
+    guint   limit = (limit_ != NULL) ? _parse_stop_id(limit_) : G_MAXUINT;
+
+    if (entry != NULL) { entry->from = from; }
+
+    TRACE(trace, PHASE_PARSE);
+
+    if ((from < 1) || (limit < 1)) {
+        _debug_uri(msg);
+
+        soup_server_message_set_status(msg, SOUP_STATUS_BAD_REQUEST, NULL);
+
+        if (limit < 1) {
+            soup_server_message_set_response(msg, MIME_TYPE,
+                SOUP_MEMORY_STATIC, RESP_BAD_LIMIT, strlen(RESP_BAD_LIMIT));
+        } else {
+            soup_server_message_set_response(msg, MIME_TYPE,
+                SOUP_MEMORY_STATIC, RESP_BAD_REQUEST,
+                strlen(RESP_BAD_REQUEST));
+        }
+
+        return;
+    }
+
+    if (handler_payload->debug_log_enabled) {
+        g_debug(         REST_REACHABLE SPACE UINT_FORMAT SPACE V_BAR SPACE
+            UINT_FORMAT, from, limit);
+        syslog(LOG_DEBUG,REST_REACHABLE SPACE UINT_FORMAT SPACE V_BAR SPACE
+            UINT_FORMAT, from, limit);
+
+        TRACE(trace, PHASE_LOG);
+    }
+
+    // The snapshot of routes stays pinned until the response is streamed.
+    _REACHABLE_STREAM *stream = g_new0(_REACHABLE_STREAM, 1);
+    stream->routes = acquire_routes(handler_payload->routes_holder);
+    stream->left   = limit;
+
+    // Reachable bus stops may be turned off by their memory limit.
+    if (!find_reachable(stream->routes, from, &stream->cursor)) {
+        _free_stream(stream);
+
+        soup_server_message_set_status(msg, SOUP_STATUS_NOT_FOUND, NULL);
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_NOT_FOUND, strlen(RESP_NOT_FOUND));
+
+        return;
+    }
+
+    TRACE(trace, PHASE_LOOKUP);
+
+    SoupMessageHeaders *resp_headers
+        = soup_server_message_get_response_headers(msg);
+
+    soup_message_headers_set_encoding(resp_headers, SOUP_ENCODING_CHUNKED);
+    soup_message_headers_set_content_type(resp_headers, MIME_TYPE, NULL);
+
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+    gchar *head = g_strdup_printf(RESP_REACHABLE_FORMAT, from);
+
+    soup_message_body_append(soup_server_message_get_response_body(msg),
+        SOUP_MEMORY_TAKE, head, strlen(head));
+
+    // Only the first chunk is rendered before the handler is done with.
+    _write_reachable(msg, stream);
+
+    TRACE(trace, PHASE_RENDER);
+
+    if (stream->done) {
+        _free_stream(stream);
+
+        return;
+    }
+
+    g_object_set_data_full((GObject *) msg, REST_REACHABLE, stream,
+        (GDestroyNotify) _free_stream);
+
+    g_signal_connect(msg, WROTE_CHUNK, G_CALLBACK(_write_reachable), stream);
+}
+
+// Helper structure to hold a direct-route lookup handed over
+// to the offload pool, along with the paused request it belongs to.
+typedef struct {
+    SoupServerMessage *msg;
+    GMainContext      *context; // The server worker's one, to resume in.
+    HANDLER_PAYLOAD   *handler_payload;
+    ROUTES_STORE      *routes;
+    guint              generation; // The snapshot of routes looked up.
+    guint32            from;
+    guint32            to;
+    gboolean           direct;
+    gboolean           shed;    // Whether it has waited too long.
+    guint64            start;   // When the request handling started.
+    guint64            elapsed; // The time taken by the lookup itself.
+    gboolean           traced;  // Whether the request is being traced.
+    REQUEST_TRACE      trace;
+    gboolean           logged;  // Whether the request is to be logged.
+    ACCESS_ENTRY       entry;
+} _OFFLOAD_JOB;
+
+// Helper function. Renders the direct-route lookup result
+// as the response to the request.
+static void _render_direct_route(      SoupServerMessage *msg,
+                                 const guint32            from,
+                                 const guint32            to,
+                                 const gboolean           direct) {
+
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+    // Rendering the response body right on the stack.
+    gchar json_body[RESP_BUFF_SIZE];
+
+    gint json_len = g_snprintf(json_body, RESP_BUFF_SIZE, RESP_DIRECT_FORMAT,
+        from, to, direct ? JSON_TRUE : JSON_FALSE);
+
+    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_COPY,
+        json_body, json_len);
+}
+
+// Helper function. Counts the request by its response status, and puts
+// the time taken to handle it into the request latency histogram.
+static void _count_request(      HANDLER_PAYLOAD   *handler_payload,
+                                 SoupServerMessage *msg,
+                           const guint64            start) {
 
-    const char *uri = g_uri_to_string(soup_server_message_get_uri(msg));
+    count_request(handler_payload->metrics,
+        soup_server_message_get_status(msg));
+
+    observe_latency(&handler_payload->metrics->request_duration,
+        get_time_ns() - start);
+}
+
+// Helper function. Frees the offload job, once it is done with
+// (or dropped along with the main context it was to be resumed in).
+static void _free_job(_OFFLOAD_JOB *job) {
+    g_object_unref(job->msg);
+    g_main_context_unref(job->context);
+
+    g_free(job);
+}
+
+// Helper function. Resumes the request paused for the offloaded lookup.
+// Runs in the server worker's own main context, so the response cache
+// and metrics are still updated by the server worker itself only.
+static gboolean _resume_request(_OFFLOAD_JOB *job) {
+    HANDLER_PAYLOAD *handler_payload = job->handler_payload;
+
+    REQUEST_TRACE *trace = job->traced ? &job->trace : NULL;
+
+    // Waiting for the server worker to resume the request counts
+    // as queueing as well.
+    TRACE(trace, PHASE_QUEUE);
+
+    if (job->shed) {
+        shed_request(job->msg, handler_payload, SHED_QUEUE_WAIT);
+
+        if (trace != NULL) {
+            finish_trace(handler_payload->tracing, trace, job->msg);
+        }
+
+        if (job->logged) {
+            log_access(handler_payload->access_log, &job->entry, job->msg,
+                job->start);
+        }
+
+        soup_server_message_unpause(job->msg);
+
+        _count_request(handler_payload, job->msg, job->start);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    observe_latency(&handler_payload->metrics->lookup_duration,
+        job->elapsed);
+
+    // The cache may have moved on to a newer snapshot of routes
+    // meanwhile, and then the result is not cached.
+    if (handler_payload->routes_cache != NULL) {
+        cache_route(handler_payload->routes_cache, job->generation,
+            job->from, job->to, job->direct);
+
+        TRACE(trace, PHASE_CACHE);
+    }
+
+    _render_direct_route(job->msg, job->from, job->to, job->direct);
+
+    TRACE(trace, PHASE_RENDER);
+
+    if (trace != NULL) {
+        finish_trace(handler_payload->tracing, trace, job->msg);
+    }
+
+    if (job->logged) {
+        job->entry.result = job->direct ? JSON_TRUE : JSON_FALSE;
+
+        log_access(handler_payload->access_log, &job->entry, job->msg,
+            job->start);
+    }
+
+    soup_server_message_unpause(job->msg);
+
+    _count_request(handler_payload, job->msg, job->start);
+
+    return G_SOURCE_REMOVE;
+}
+
+// Helper function. Hands the direct-route lookup over to the offload pool,
+// pausing the request meanwhile. Returns FALSE if offloading is disabled,
+// or the pool queue is full, so that the lookup is to be performed
+// right away instead.
+static gboolean _offload_lookup(      SoupServerMessage *msg,
+                                      HANDLER_PAYLOAD   *handler_payload,
+                                      ROUTES_STORE      *routes,
+                                const guint32            from,
+                                const guint32            to,
+                                const guint64            start,
+                                const REQUEST_TRACE     *trace,
+                                const ACCESS_ENTRY      *entry) {
+
+    GThreadPool *pool = handler_payload->offload_pool;
+
+    if ((pool == NULL) || (g_thread_pool_unprocessed(pool)
+        >= handler_payload->offload_queue_depth)) {
+
+        return FALSE;
+    }
+
+    _OFFLOAD_JOB *job    = g_new(_OFFLOAD_JOB, 1);
+    job->msg             = g_object_ref(msg);
+    job->context         = g_main_context_ref_thread_default();
+    job->handler_payload = handler_payload;
+    job->routes          = routes;
+    job->generation      = routes->generation;
+    job->from            = from;
+    job->to              = to;
+    job->start           = start;
+    job->traced          = (trace != NULL);
+
+    job->logged          = (entry != NULL);
+
+    // The trace goes along with the job, to be carried on by the pool,
+    // and so do details of the request to be logged.
+    if (trace != NULL) { job->trace = *trace; }
+    if (entry != NULL) { job->entry = *entry; }
+
+    soup_server_message_pause(msg);
+
+    g_thread_pool_push(pool, job, NULL);
+
+    return TRUE;
+}
+
+// Helper function. Routes the incoming request to its handler.
+// Returns TRUE if the request has been paused, to be resumed
+// once the offload pool is done with it.
+static gboolean _route_request(      SoupServerMessage *msg,
+                               const char              *path,
+                                     GHashTable        *query,
+                                     gpointer           payload,
+                               const guint64            start,
+                                     REQUEST_TRACE     *trace,
+                                     ACCESS_ENTRY      *entry) {
 
     const char *method = soup_server_message_get_method(msg);
     SoupMessageHeaders *resp_headers
         = soup_server_message_get_response_headers(msg);
 
+    // POST /route/direct/batch
+    if (g_strcmp0(path, SLASH REST_PREFIX SLASH REST_DIRECT
+                        SLASH REST_BATCH) == 0) {
+
+        if (g_strcmp0(method, HTTP_POST) != 0) {
+            soup_message_headers_append(resp_headers, HDR_ALLOW_N,
+                HDR_ALLOW_V_BATCH);
+
+            soup_server_message_set_status(msg,
+                SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+
+            return FALSE;
+        }
+
+        _batch_request_handler(msg, payload, trace);
+
+        return FALSE;
+    }
+
     if ((g_strcmp0(   method, HTTP_HEAD) != 0)
         && (g_strcmp0(method, HTTP_GET ) != 0)) {
 
@@ -45,34 +841,40 @@ void request_handler(      SoupServer        *server,
         soup_server_message_set_status(msg,
             SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
 
-        return;
+        return FALSE;
+    }
+
+    // GET /metrics
+    if (g_strcmp0(path, SLASH REST_METRICS) == 0) {
+        _metrics_request_handler(msg, payload, trace);
+
+        return FALSE;
+    }
+
+    // GET /route/transfers
+    if (g_strcmp0(path, SLASH REST_PREFIX SLASH REST_TRANSFERS) == 0) {
+        _transfers_request_handler(msg, query, payload, trace, entry);
+
+        return FALSE;
     }
 
-    JsonObject    *json_object = json_object_new();
-    JsonNode      *json_node   = json_node_new(JSON_NODE_OBJECT);
-    JsonGenerator *json_gen    = json_generator_new();
-    GString       *json_body   = g_string_new(NULL);
+    // GET /route/reachable
+    if (g_strcmp0(path, SLASH REST_PREFIX SLASH REST_REACHABLE) == 0) {
+        _reachable_request_handler(msg, query, payload, trace, entry);
+
+        return FALSE;
+    }
 
     // GET /route/direct
     if (g_strcmp0(path, SLASH REST_PREFIX SLASH REST_DIRECT) != 0) {
-        g_debug(LOG_FORMAT, uri);
+        _debug_uri(msg);
 
         soup_server_message_set_status(msg, SOUP_STATUS_NOT_FOUND, NULL);
 
-        json_object_set_string_member(json_object, ERROR_JSON_KEY,
-            ERROR_JSON_VAL_NOT_FOUND);
-        json_node = json_node_init_object(json_node, json_object);
-        json_generator_set_root(json_gen, json_node);
-        json_body = json_generator_to_gstring(json_gen, json_body);
-
-        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_COPY,
-            json_body->str, json_body->len);
-
-        g_string_free(json_body, TRUE);
-        json_node_free(json_node);
-        json_object_unref(json_object);
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_NOT_FOUND, strlen(RESP_NOT_FOUND));
 
-        return;
+        return FALSE;
     }
 
     gchar *from_ = EMPTY_STRING;
@@ -84,13 +886,14 @@ void request_handler(      SoupServer        *server,
     }
 
     HANDLER_PAYLOAD *handler_payload = payload;
-    gboolean debug_log_enabled = handler_payload->debug_log_enabled;
 
-    if (debug_log_enabled) {
+    if (handler_payload->debug_log_enabled) {
 g_debug(         FROM EQUALS LOG_FORMAT SPACE V_BAR SPACE TO EQUALS LOG_FORMAT,
                  from_,                                   to_);
 syslog(LOG_DEBUG,FROM EQUALS LOG_FORMAT SPACE V_BAR SPACE TO EQUALS LOG_FORMAT,
                  from_,                                   to_);
+
+        TRACE(trace, PHASE_LOG);
     }
 
     // ------------------------------------------------------------------------
@@ -98,8 +901,8 @@ syslog(LOG_DEBUG,FROM EQUALS LOG_FORMAT SPACE V_BAR SPACE TO EQUALS LOG_FORMAT,
     // ------------------------------------------------------------------------
     gboolean is_request_malformed = FALSE;
 
-    unsigned from = g_ascii_strtoull(from_, NULL, 10);
-    unsigned to   = g_ascii_strtoull(to_,   NULL, 10);
+    guint32 from = _parse_stop_id(from_);
+    guint32 to   = _parse_stop_id(to_  );
 
     if ((from < 1) || (to < 1)) {
         is_request_malformed = TRUE;
@@ -108,61 +911,377 @@ syslog(LOG_DEBUG,FROM EQUALS LOG_FORMAT SPACE V_BAR SPACE TO EQUALS LOG_FORMAT,
     // --- Parsing and validating request params - End ------------------------
     // ------------------------------------------------------------------------
 
+    if (entry != NULL) { entry->from = from; entry->to = to; }
+
+    TRACE(trace, PHASE_PARSE);
+
     if (is_request_malformed) {
-        g_debug(LOG_FORMAT, uri);
+        _debug_uri(msg);
 
         soup_server_message_set_status(msg, SOUP_STATUS_BAD_REQUEST, NULL);
 
-        json_object_set_string_member(json_object, ERROR_JSON_KEY,
-            ERR_REQ_PARAMS_MUST_BE_POSITIVE_INTS);
-        json_node = json_node_init_object(json_node, json_object);
-        json_generator_set_root(json_gen, json_node);
-        json_body = json_generator_to_gstring(json_gen, json_body);
+        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_STATIC,
+            RESP_BAD_REQUEST, strlen(RESP_BAD_REQUEST));
 
-        soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_COPY,
-            json_body->str, json_body->len);
+        return FALSE;
+    }
 
-        g_string_free(json_body, TRUE);
-        json_node_free(json_node);
-        json_object_unref(json_object);
+    // Pinning the current snapshot of routes for the request,
+    // so that a concurrent reload doesn't free it meanwhile.
+    ROUTES_STORE *routes = acquire_routes(handler_payload->routes_holder);
+    ROUTES_CACHE *routes_cache = handler_payload->routes_cache;
 
-        return;
+    gboolean direct;
+
+    // Consulting the response cache first (if enabled).
+    gboolean cached = (routes_cache != NULL) && find_cached_route(
+        routes_cache, routes->generation, from, to, &direct);
+
+    TRACE(trace, PHASE_CACHE);
+
+    if (!cached) {
+        // Handing the lookup over to the offload pool (if enabled),
+        // so that the server worker keeps serving other requests
+        // meanwhile. The snapshot of routes stays pinned until
+        // the lookup is done.
+        if (_offload_lookup(msg, handler_payload, routes, from, to, start,
+            trace, entry)) {
+
+            return TRUE;
+        }
+
+        guint64 lookup_start = get_time_ns();
+
+        // Performing the routes processing to find out the direct route.
+        direct = find_direct_route(routes, from, to);
+
+        observe_latency(&handler_payload->metrics->lookup_duration,
+            get_time_ns() - lookup_start);
+
+        TRACE(trace, PHASE_LOOKUP);
+
+        if (routes_cache != NULL) {
+            cache_route(routes_cache, routes->generation, from, to,
+                direct);
+
+            TRACE(trace, PHASE_CACHE);
+        }
     }
 
-    GPtrArray *routes_list = handler_payload->routes_list;
+    unref_routes(routes);
 
-    int len_from_ = snprintf(NULL, 0, INT_FORMAT, from);
-    int len_to_   = snprintf(NULL, 0, INT_FORMAT, to  );
-            from_ = malloc(len_from_ + 1);
-            to_   = malloc(len_to_   + 1);
-    snprintf(from_, (len_from_ + 1),  INT_FORMAT, from);
-    snprintf(to_,   (len_to_   + 1),  INT_FORMAT, to  );
+    if (entry != NULL) { entry->result = direct ? JSON_TRUE : JSON_FALSE; }
 
-    // Performing the routes processing to find out the direct route.
-    gboolean direct = find_direct_route(
-        debug_log_enabled,
-        routes_list,
-        from_,
-        to_);
+    _render_direct_route(msg, from, to, direct);
 
-    free(to_  );
-    free(from_);
+    TRACE(trace, PHASE_RENDER);
 
-    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+    return FALSE;
+}
+
+/**
+ * The default request handler callback.
+ * Used to process the incoming request.
+ *
+ * @param server  The Soup web server instance.
+ * @param msg     The request message to be processed.
+ * @param path    The path  component of request message URI.
+ * @param query   The query component of request message URI.
+ * @param payload The pointer to a payload data passed from the controller.
+ */
+void request_handler(      SoupServer        *server,
+                           SoupServerMessage *msg,
+                     const char              *path,
+                           GHashTable        *query,
+                           gpointer           payload) {
 
-    json_object_set_int_member(    json_object, FROM,        from  );
-    json_object_set_int_member(    json_object, TO,          to    );
-    json_object_set_boolean_member(json_object, REST_DIRECT, direct);
-    json_node = json_node_init_object(json_node, json_object);
-    json_generator_set_root(json_gen, json_node);
-    json_body = json_generator_to_gstring(json_gen, json_body);
+    guint64 start = get_time_ns();
 
-    soup_server_message_set_response(msg, MIME_TYPE, SOUP_MEMORY_COPY,
-        json_body->str, json_body->len);
+    HANDLER_PAYLOAD *handler_payload = payload;
+
+    // Tracing the request (if enabled) right on the stack.
+    REQUEST_TRACE trace_, *trace = NULL;
+
+    if (handler_payload->tracing != NULL) {
+        trace = &trace_;
+
+        start_trace(trace, start);
+    }
+
+    // Sampling the request for the access log (if enabled) right away,
+    // so that requests not logged aren't kept track of at all.
+    ACCESS_ENTRY entry_ = { 0, 0, NULL }, *entry = NULL;
+
+    if ((handler_payload->access_log != NULL) && sample_access(
+        handler_payload->access_log, &handler_payload->access_seed)) {
+
+        entry = &entry_;
+    }
+
+    if (handler_payload->admission != NULL) {
+        // Requests shed as soon as their headers were read are responded
+        // to already.
+        if (soup_server_message_get_status(msg) != SOUP_STATUS_NONE) {
+            return;
+        }
+
+        if (is_wait_exceeded(handler_payload->admission, msg, start)) {
+            shed_request(msg, handler_payload, SHED_QUEUE_WAIT);
+
+            if (trace != NULL) {
+                finish_trace(handler_payload->tracing, trace, msg);
+            }
+
+            if (entry != NULL) {
+                log_access(handler_payload->access_log, entry, msg, start);
+            }
+
+            _count_request(handler_payload, msg, start);
+
+            return;
+        }
+    }
+
+    // A paused request gets counted (traced and logged) once it is resumed.
+    if (!_route_request(msg, path, query, payload, start, trace, entry)) {
+        if (trace != NULL) {
+            finish_trace(handler_payload->tracing, trace, msg);
+        }
+
+        if (entry != NULL) {
+            log_access(handler_payload->access_log, entry, msg, start);
+        }
+
+        _count_request(payload, msg, start);
+    }
+}
 
-    g_string_free(json_body, TRUE);
-    json_node_free(json_node);
-    json_object_unref(json_object);
+/**
+ * The offload pool thread function. Used to perform the direct-route lookup
+ * of a paused request, and to resume the request afterwards, from within
+ * the main context of the server worker it belongs to.
+ *
+ * @param data      The pointer to the offloaded lookup.
+ * @param user_data Not used.
+ */
+void offload_handler(gpointer data, gpointer user_data) {
+    _OFFLOAD_JOB *job = data;
+
+    const ADMISSION_CONTROL *admission = job->handler_payload->admission;
+
+    guint64 start = get_time_ns();
+
+    // The pool thread owns the job (and its trace) for the time being.
+    REQUEST_TRACE *trace = job->traced ? &job->trace : NULL;
+
+    TRACE(trace, PHASE_QUEUE);
+
+    // Skipping the lookup that has waited in the pool queue too long,
+    // its request is to be shed instead.
+    job->shed = (admission != NULL) && (admission->max_queue_wait > 0)
+        && ((start - job->start) > admission->max_queue_wait);
+
+    if (!job->shed) {
+        job->direct = find_direct_route(job->routes, job->from, job->to);
+
+        job->elapsed = get_time_ns() - start;
+
+        TRACE(trace, PHASE_LOOKUP);
+    }
+
+    unref_routes(job->routes);
+
+    // Always deferring the resumption to the server worker's main loop,
+    // even if the main context is not acquired by it at the moment.
+    GSource *source = g_idle_source_new();
+
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, (GSourceFunc) _resume_request, job,
+        (GDestroyNotify) _free_job);
+    g_source_attach(source, job->context);
+    g_source_unref(source);
+}
+
+// Helper function. Compares two 64-bit keys, for sorting.
+static int _cmp_keys(const void *a, const void *b) {
+    guint64 a_ = *(const guint64 *) a;
+    guint64 b_ = *(const guint64 *) b;
+
+    return (a_ > b_) - (a_ < b_);
+}
+
+// Helper function. Identifies whether the direct route is present
+// by scanning bus stops sequences of all the routes, one by one.
+static gboolean _find_direct_route_scan(const ROUTES_STORE *routes,
+                                        const guint32       from,
+                                        const guint32       to) {
+
+    gboolean direct = FALSE;
+
+    guint routes_count = routes->routes_count;
+
+    for (guint i = 0; i < routes_count; i++) {
+        const guint32 *route = routes->stops + routes->offsets[i    ];
+        const guint32 *end   = routes->stops + routes->offsets[i + 1];
+        const guint32 *stop  = route;
+
+        // Pinning in the starting bus stop point, if it's found.
+        while ((stop < end) && (*stop != from)) { stop++; }
+
+        if (stop == end) { continue; }
+
+        // Next, searching for the ending bus stop point
+        // on the current route, beginning at the pinned point.
+        while (++stop < end) {
+            if (*stop == to) { direct = TRUE; break; }
+        }
+
+        if (direct) { break; }
+    }
+
+    return direct;
+}
+
+// Helper function. Identifies whether the direct route is present
+// by merging postings of both bus stop points from the bus stops index:
+// it is there if both points occur on the same route, and the starting
+// point goes before the ending one.
+static gboolean _find_direct_route_index(const ROUTES_STORE *routes,
+                                         const guint32       from,
+                                         const guint32       to) {
+
+    guint from_idx = find_stop(routes, from);
+    guint to_idx   = find_stop(routes, to  );
+
+    if ((from_idx == STOP_NOT_FOUND) || (to_idx == STOP_NOT_FOUND)) {
+        return FALSE;
+    }
+
+    const STOP_POSTING *postings = routes->postings;
+    const guint32      *offsets  = routes->postings_offsets;
+
+    const STOP_POSTING *from_    = postings + offsets[from_idx    ];
+    const STOP_POSTING *from_end = postings + offsets[from_idx + 1];
+    const STOP_POSTING *to_      = postings + offsets[to_idx      ];
+    const STOP_POSTING *to_end   = postings + offsets[to_idx   + 1];
+
+    while ((from_ < from_end) && (to_ < to_end)) {
+        if      (from_->route < to_->route) { from_++; }
+        else if (from_->route > to_->route) { to_++;   }
+        else {
+            guint32 route = from_->route;
+
+            // Pinning in the earliest starting point and the latest
+            // ending point on the current route.
+            while (((to_ + 1) < to_end) && (to_[1].route == route)) { to_++; }
+
+            if (from_->position < to_->position) { return TRUE; }
+
+            while ((from_ < from_end) && (from_->route == route)) { from_++; }
+
+            to_++;
+        }
+    }
+
+    return FALSE;
+}
+
+// Helper function. Identifies whether the direct route is present
+// by looking up the precomputed table of directly connected bus stops.
+static gboolean _find_direct_route_table(const ROUTES_STORE *routes,
+                                         const guint32       from,
+                                         const guint32       to) {
+
+    if (routes->table_bitmap != NULL) {
+        guint from_idx = find_stop(routes, from);
+        guint to_idx   = find_stop(routes, to  );
+
+        if ((from_idx == STOP_NOT_FOUND) || (to_idx == STOP_NOT_FOUND)) {
+            return FALSE;
+        }
+
+        const guint64 *row = routes->table_bitmap
+                           + ((gsize) from_idx * routes->table_row_words);
+
+        return (row[to_idx >> 6] >> (to_idx & 63)) & 1;
+    }
+
+    guint64 key = ((guint64) from << 32) | to;
+    gsize   lo  = 0, hi = routes->table_count;
+
+    while (lo < hi) {
+        gsize mid = lo + ((hi - lo) >> 1);
+
+        if (routes->table[mid] < key) { lo = mid + 1; }
+        else                          { hi = mid;     }
+    }
+
+    return (lo < routes->table_count) && (routes->table[lo] == key);
+}
+
+// Helper function. Identifies whether the direct route is present
+// by searching all bus stops sequences at once for the starting bus stop
+// point with the vectorized search kernel, and then searching the rest
+// of each route it's found on for the ending bus stop point.
+static gboolean _find_direct_route_simd(const ROUTES_STORE *routes,
+                                        const guint32       from,
+                                        const guint32       to) {
+
+    const guint32 *stops   = routes->stops;
+    const guint32 *offsets = routes->offsets;
+
+    gsize stops_count = routes->stops_count;
+    gsize stop        = 0;
+
+    while ((stop = stop + routes->search_stop(stops + stop,
+        stops_count - stop, from)) < stops_count) {
+
+        // Pinning in the route the starting bus stop point is found on.
+        guint lo = 0, hi = routes->routes_count;
+
+        while (lo < hi) {
+            guint mid = lo + ((hi - lo) >> 1);
+
+            if (offsets[mid + 1] <= stop) { lo = mid + 1; }
+            else                          { hi = mid;     }
+        }
+
+        gsize end = offsets[lo + 1];
+
+        // Next, searching for the ending bus stop point on the route,
+        // beginning right after the starting one.
+        stop++;
+
+        if (routes->search_stop(stops + stop, end - stop, to) < (end - stop)) {
+            return TRUE;
+        }
+
+        // Further occurrences of the starting point on the same route
+        // can't give any more, so going on with the next route.
+        stop = end;
+    }
+
+    return FALSE;
+}
+
+// Helper function. Identifies whether the direct route is present
+// by scanning compressed bus stops sequences of all the routes, one by one,
+// decoding bus stops on the fly.
+static gboolean _find_direct_route_packed(const ROUTES_STORE *routes,
+                                          const guint32       from,
+                                          const guint32       to) {
+
+    guint routes_count = routes->routes_count;
+
+    for (guint i = 0; i < routes_count; i++) {
+        guint position;
+
+        if (find_packed_route(routes, i, from, to, &position)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 }
 
 /**
@@ -170,64 +1289,186 @@ syslog(LOG_DEBUG,FROM EQUALS LOG_FORMAT SPACE V_BAR SPACE TO EQUALS LOG_FORMAT,
  * and return whether a particular interval between two bus stop points
  * given is direct (i.e. contains in any of the routes), or not.
  *
- * @param debug_log_enabled The debug logging enabler.
- * @param routes_list       A list containing all available routes.
- * @param from              The starting bus stop point.
- * @param to                The ending   bus stop point.
+ * @param routes A structure containing all available routes.
+ * @param from   The starting bus stop point.
+ * @param to     The ending   bus stop point.
  *
  * @return <code>TRUE</code> if the direct route is found,
  *         <code>FALSE</code> otherwise.
  */
-gboolean find_direct_route(const gboolean   debug_log_enabled,
-                           const GPtrArray *routes_list,
-                           const gchar     *from,
-                           const gchar     *to) {
+gboolean find_direct_route(const ROUTES_STORE *routes,
+                           const guint32       from,
+                           const guint32       to) {
+
+    // Two bus stop points in a route cannot point up to the same value.
+    if (from == to) { return FALSE; }
 
-//  guint routes_len = routes_list->len;
+    switch (routes->engine) {
+    case ENGINE_TABLE:
+        return _find_direct_route_table( routes, from, to);
+    case ENGINE_INDEX:
+        return _find_direct_route_index( routes, from, to);
+    case ENGINE_SIMD:
+        return _find_direct_route_simd(  routes, from, to);
+    case ENGINE_PACKED:
+        return _find_direct_route_packed(routes, from, to);
+    default:
+        return _find_direct_route_scan(  routes, from, to);
+    }
+}
 
-//  for (guint i = 0; i < routes_len; i++) {
-//      g_debug("%u" SPACE EQUALS SPACE LOG_FORMAT, (i + 1),
-//          (gchar *) g_ptr_array_index(routes_list, i));
-//  }
+// Helper structure to hold a batch of intervals grouped for a single pass
+// over the routes, along with the results to put.
+typedef struct {
+    const guint32 *from;
+    const guint32 *to;
+    guint          count;
+    gboolean      *direct;
+    GHashTable    *from_groups; // Starting points to their (1-based) groups.
+    guint         *from_group;  // The group of each interval's start.
+    GHashTable    *to_groups;   // Ending points to their runs in `by_to`.
+    guint64       *by_to;       // Sorted `(to << 32) | interval` keys.
+    guint         *seen_on;     // The (1-based) last route of each group.
+} _BATCH;
 
-    gboolean direct = FALSE;
+// Helper function. Matches the next bus stop of the route given
+// against the batch of intervals: resolves intervals ending at it, whose
+// starting points have already been seen on the route, and then marks
+// the route as seen by intervals starting at it.
+static inline void _visit_stop(      _BATCH  *batch,
+                               const guint32  stop,
+                               const guint    route) {
 
-    // Two bus stop points in a route cannot point up to the same value.
-    if (g_strcmp0(from, to) == 0) { return direct; }
+    gpointer run = g_hash_table_lookup(batch->to_groups,
+        GUINT_TO_POINTER(stop));
 
-    gchar *route = EMPTY_STRING, *route_from = EMPTY_STRING;
+    if (run != NULL) {
+        for (guint k = GPOINTER_TO_UINT(run) - 1; (k < batch->count)
+            && ((batch->by_to[k] >> 32) == stop); k++) {
 
-    guint routes_count = routes_list->len;
+            guint j = batch->by_to[k] & G_MAXUINT32;
 
-    for (guint i = 0; i < routes_count; i++) {
-        route = g_ptr_array_index(routes_list, i);
+            if (batch->seen_on[batch->from_group[j]] == (route + 1)) {
+                batch->direct[j] = (batch->from[j] != batch->to[j]);
+            }
+        }
+    }
 
-        if (debug_log_enabled) {
-            g_debug(INT_FORMAT SPACE EQUALS SPACE LOG_FORMAT, (i + 1), route);
+    gpointer group = g_hash_table_lookup(batch->from_groups,
+        GUINT_TO_POINTER(stop));
+
+    if (group != NULL) {
+        batch->seen_on[GPOINTER_TO_UINT(group) - 1] = route + 1;
+    }
+}
+
+/**
+ * Performs the routes processing to identify whether each one of the given
+ * intervals between two bus stop points is direct, or not.
+ *
+ * With the scan, SIMD, and packed engines, all the intervals are evaluated
+ * in a single pass over the routes: intervals are grouped by their starting
+ * (and ending) bus stop points, so that each route is visited (and, when
+ * packed, decompressed block by block) once per batch rather than once
+ * per interval. The index and table engines answer each interval on its own
+ * through their own lookups, which is already cheaper than a full pass.
+ *
+ * @param routes A structure containing all available routes.
+ * @param from   The starting bus stop points.
+ * @param to     The ending   bus stop points.
+ * @param count  The number of intervals.
+ * @param direct The array to put results into: each element is set
+ *               to <code>TRUE</code> if the direct route is found,
+ *               <code>FALSE</code> otherwise.
+ */
+void find_direct_routes(const ROUTES_STORE *routes,
+                        const guint32      *from,
+                        const guint32      *to,
+                        const guint         count,
+                              gboolean     *direct) {
+
+    if ((routes->engine == ENGINE_INDEX) || (routes->engine == ENGINE_TABLE)) {
+        for (guint i = 0; i < count; i++) {
+            direct[i] = find_direct_route(routes, from[i], to[i]);
         }
 
-        if (g_regex_match_simple(g_strconcat(SEQ1_REGEX, from, SEQ2_REGEX,
-            NULL), route, 0, 0)) {
+        return;
+    }
 
-            // Pinning in the starting bus stop point, if it's found.
-            // Next, searching for the ending bus stop point
-            // on the current route, beginning at the pinned point.
-            route_from = g_strrstr(route, from);
+    _BATCH batch = { from, to, count, direct };
 
-            if (debug_log_enabled) {
-                g_debug(LOG_FORMAT SPACE V_BAR SPACE LOG_FORMAT,
-                    from, route_from);
-            }
+    // Grouping intervals by their starting bus stop points: each distinct
+    // point gets a slot to hold the last route it was seen on.
+    batch.from_groups = g_hash_table_new(g_direct_hash, g_direct_equal);
+    batch.from_group  = g_new(guint, count);
+
+    guint groups = 0;
+
+    // Grouping intervals by their ending bus stop points: each distinct
+    // point maps to the run of intervals ending at it, in the `by_to` order.
+    batch.to_groups = g_hash_table_new(g_direct_hash, g_direct_equal);
+    batch.by_to     = g_new(guint64, count);
+
+    for (guint i = 0; i < count; i++) {
+        direct[i]      = FALSE;
+        batch.by_to[i] = ((guint64) to[i] << 32) | i;
+
+        gpointer group = g_hash_table_lookup(batch.from_groups,
+            GUINT_TO_POINTER(from[i]));
 
-            if (g_regex_match_simple(g_strconcat(SEQ1_REGEX, to, SEQ2_REGEX,
-                NULL), route_from, 0, 0)) {
+        if (group == NULL) {
+            group = GUINT_TO_POINTER(++groups);
 
-                direct = TRUE; break;
+            g_hash_table_insert(batch.from_groups, GUINT_TO_POINTER(from[i]),
+                group);
+        }
+
+        batch.from_group[i] = GPOINTER_TO_UINT(group) - 1;
+    }
+
+    qsort(batch.by_to, count, sizeof(guint64), _cmp_keys);
+
+    for (guint i = 0; i < count; i++) {
+        if ((i == 0) || ((batch.by_to[i] >> 32)
+                      != (batch.by_to[i - 1] >> 32))) {
+
+            g_hash_table_insert(batch.to_groups,
+                GUINT_TO_POINTER(batch.by_to[i] >> 32),
+                GUINT_TO_POINTER(i + 1));
+        }
+    }
+
+    batch.seen_on = g_new0(guint, groups);
+
+    for (guint i = 0; i < routes->routes_count; i++) {
+        if (routes->engine == ENGINE_PACKED) {
+            STOPS_CURSOR cursor;
+            guint32      block[PACK_BLOCK_SIZE];
+            guint        block_count;
+
+            open_stops(&cursor, routes->packed + routes->packed_offsets[i],
+                routes->offsets[i + 1] - routes->offsets[i]);
+
+            while ((block_count = unpack_stops(&cursor, block)) > 0) {
+                for (guint k = 0; k < block_count; k++) {
+                    _visit_stop(&batch, block[k], i);
+                }
             }
+
+            continue;
         }
+
+        const guint32 *stop = routes->stops + routes->offsets[i    ];
+        const guint32 *end  = routes->stops + routes->offsets[i + 1];
+
+        for (; stop < end; stop++) { _visit_stop(&batch, *stop, i); }
     }
 
-    return direct;
+    g_free(batch.seen_on);
+    g_free(batch.by_to);
+    g_free(batch.from_group);
+    g_hash_table_unref(batch.to_groups);
+    g_hash_table_unref(batch.from_groups);
 }
 
 // vim:set nu et ts=4 sw=4:
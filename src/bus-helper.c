@@ -17,6 +17,8 @@
 
 /**
  * The log writer callback. Gets called on every message logging attempt.
+ * Only puts the message into the log sink: formatting the log line
+ * and writing it out are done later, by the log sink's background thread.
  *
  * @param log_level The log level of the message.
  * @param fields    An array of fields forming the message.
@@ -32,64 +34,18 @@ GLogWriterOutput log_writer(      GLogLevelFlags  log_level,
                                   gsize           n_fields,
                                   gpointer        user_data) {
 
-    GFileOutputStream *log_stream = user_data;
+    LOG_SINK *log_sink = user_data;
 
     for (gsize i = 0; i < n_fields; i++) {
         if (g_strcmp0(fields[i].key, LOG_KEY_MESSAGE) == 0) {
-            FILE  *stream = NULL;
-            gchar *llevel = NULL;
+            gsize length = (fields[i].length < 0)
+                ? strlen(fields[i].value) : (gsize) fields[i].length;
 
-            if (log_level == G_LOG_LEVEL_WARNING) {
-                stream = stderr;
-                llevel = LOG_LEVEL_WARN;
-            }
-
-            if (log_level == G_LOG_LEVEL_DEBUG) {
-                stream = stdout;
-                llevel = LOG_LEVEL_DEBUG;
-            }
+            if (!write_log_sink(log_sink, log_level & G_LOG_LEVEL_MASK,
+                fields[i].value, length)) {
 
-            if (log_level == G_LOG_LEVEL_MESSAGE) {
-                stream = stdout;
-                llevel = LOG_LEVEL_INFO;
+                return G_LOG_WRITER_UNHANDLED;
             }
-
-GDateTime *date_time = g_date_time_new_now_local();
-gchar *year   = g_strdup_printf(DTM_FORMAT, g_date_time_get_year        (date_time));
-gchar *month  = g_strdup_printf(DTM_FORMAT, g_date_time_get_month       (date_time));
-gchar *day    = g_strdup_printf(DTM_FORMAT, g_date_time_get_day_of_month(date_time));
-gchar *hour   = g_strdup_printf(DTM_FORMAT, g_date_time_get_hour        (date_time));
-gchar *minute = g_strdup_printf(DTM_FORMAT, g_date_time_get_minute      (date_time));
-gchar *second = g_strdup_printf(DTM_FORMAT, g_date_time_get_second      (date_time));
-
-            gchar *message = g_strconcat("[", year,
-                                         "-", month,
-                                         "-", day,
-                                        "][", hour,
-                                         ":", minute,
-                                         ":", second,
-                                        "][", llevel,
-            (log_level == G_LOG_LEVEL_DEBUG)
-                   ? (      "]" SPACE SPACE)
-                   : (SPACE "]" SPACE SPACE), fields[i].value, NEW_LINE, NULL);
-
-            // Writing the log message to an output stream.
-            fprintf(stream, LOG_FORMAT, message);
-
-            // Writing the log message to a logfile.
-            gssize nbytes = g_output_stream_write((GOutputStream *) log_stream,
-                message, strlen(message), NULL, NULL);
-
-            g_free(message);
-
-            g_free(second);
-            g_free(minute);
-            g_free(hour  );
-            g_free(day   );
-            g_free(month );
-            g_free(year  );
-
-            if (nbytes == -1) { return G_LOG_WRITER_UNHANDLED; }
         }
     }
 
@@ -121,6 +77,121 @@ gushort get_server_port(GKeyFile *settings) {
     }
 }
 
+/**
+ * Retrieves the number of server workers to run, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The number of server workers (each one runs in its own thread).
+ */
+guint get_server_workers(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint workers
+        = g_key_file_get_integer(settings, SERVER_GROUP, SERVER_WORKERS,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return DEF_WORKERS;
+    }
+
+    if ((workers < 0) || (workers > MAX_WORKERS)) {
+        g_warning(ERR_WORKERS_VALID_MUST_BE_POSITIVE_INT); return DEF_WORKERS;
+    }
+
+    // Running one worker per CPU, if requested so.
+    if (workers == 0) { workers = MIN(g_get_num_processors(), MAX_WORKERS); }
+
+    return workers;
+}
+
+/**
+ * Retrieves the path of the Unix domain socket to listen on,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The path of the socket file, or <code>NULL</code>,
+ *         if the server doesn't listen on a Unix domain socket.
+ */
+gchar *get_unix_socket_path(GKeyFile *settings) {
+    gchar *path = g_key_file_get_string(settings, SERVER_GROUP,
+        UNIX_SOCKET_PATH, NULL);
+
+    if ((path != NULL) && (*path == '\0')) { g_clear_pointer(&path, g_free); }
+
+    return path;
+}
+
+/**
+ * Retrieves the file mode of the Unix domain socket file,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The file mode (permission bits) of the socket file.
+ */
+guint get_unix_socket_mode(GKeyFile *settings) {
+    gchar *mode_ = g_key_file_get_string(settings, SERVER_GROUP,
+        UNIX_SOCKET_MODE, NULL);
+
+    if (mode_ == NULL) { return DEF_UNIX_SOCKET_MODE; }
+
+    gchar   *end  = NULL;
+    guint64  mode = g_ascii_strtoull(mode_, &end, 8);
+
+    gboolean is_valid = (end != mode_) && (*end == '\0') && (mode <= 0777);
+
+    g_free(mode_);
+
+    if (!is_valid) {
+        g_warning(ERR_UNIX_SOCKET_MODE_VALID_MUST_BE_OCTAL);
+
+        return DEF_UNIX_SOCKET_MODE;
+    }
+
+    return mode;
+}
+
+/**
+ * Retrieves the owner of the Unix domain socket file, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The owner of the socket file: "user", "user:group",
+ *         or ":group", or <code>NULL</code>, if it is to be left as is.
+ */
+gchar *get_unix_socket_owner(GKeyFile *settings) {
+    gchar *owner = g_key_file_get_string(settings, SERVER_GROUP,
+        UNIX_SOCKET_OWNER, NULL);
+
+    if ((owner != NULL) && (*owner == '\0')) {
+        g_clear_pointer(&owner, g_free);
+    }
+
+    return owner;
+}
+
+/**
+ * Identifies whether the server listens on the Unix domain socket only
+ * (and not on TCP interfaces) by retrieving the corresponding setting
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return <code>TRUE</code> if TCP interfaces are not to be listened on,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_unix_socket_only(GKeyFile *settings) {
+    return g_key_file_get_boolean(settings, SERVER_GROUP, UNIX_SOCKET_ONLY,
+        NULL);
+}
+
 /**
  * Identifies whether debug logging is enabled by retrieving
  * the corresponding setting from daemon settings.
@@ -140,6 +211,58 @@ gboolean is_debug_log_enabled(GKeyFile *settings) {
     return debug_log_enabled;
 }
 
+/**
+ * Retrieves the number of entries in the log buffer, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The number of log entries the log buffer can hold.
+ */
+guint get_log_buffer_size(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint log_buffer_size
+        = g_key_file_get_integer(settings, LOGGER_GROUP, LOG_BUFFER, &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return DEF_LOG_BUFFER_SIZE;
+    }
+
+    if ((log_buffer_size < 1) || (log_buffer_size > MAX_LOG_BUFFER_SIZE)) {
+        g_warning(ERR_LOG_BUFFER_VALID_MUST_BE_POSITIVE_INT);
+
+        return DEF_LOG_BUFFER_SIZE;
+    }
+
+    return log_buffer_size;
+}
+
+/**
+ * Retrieves the log buffer overflow policy, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The log buffer overflow policy.
+ */
+LOG_OVERFLOW get_log_overflow_policy(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gchar *policy_name = g_key_file_get_string(settings, LOGGER_GROUP,
+        LOG_OVERFLOW_POLICY, &error);
+
+    LOG_OVERFLOW policy = LOG_OVERFLOW_DROP;
+
+    if (g_strcmp0(policy_name, LOG_OVERFLOW_BLOCK_NAME) == 0) {
+        policy = LOG_OVERFLOW_BLOCK;
+    }
+
+    g_free(policy_name);
+
+    return policy;
+}
+
 /**
  * Retrieves the path and filename of the routes data store
  * from daemon settings.
@@ -187,6 +310,452 @@ gchar *get_routes_datastore(GKeyFile *settings) {
     return datastore;
 }
 
+/**
+ * Identifies whether the routes data store has to be monitored for changes
+ * (to reload it each time it gets changed) by retrieving the corresponding
+ * setting from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return <code>TRUE</code> if the routes data store has to be monitored,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_datastore_monitored(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gboolean datastore_monitored
+        = g_key_file_get_boolean(settings, ROUTES_GROUP, MONITOR, &error);
+
+    return datastore_monitored;
+}
+
+/**
+ * Identifies whether duplicate and dominated routes have to be pruned
+ * while loading the routes data store, by retrieving the corresponding
+ * setting from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return <code>TRUE</code> if routes have to be pruned,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_datastore_pruned(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gboolean datastore_pruned
+        = g_key_file_get_boolean(settings, ROUTES_GROUP, PRUNE, &error);
+
+    return datastore_pruned;
+}
+
+/**
+ * Retrieves the direct-route engine to be used, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The direct-route engine. Defaults to the index engine,
+ *         if the setting is not defined or unknown.
+ */
+ROUTES_ENGINE get_routes_engine(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gchar *engine_name
+        = g_key_file_get_string(settings, ROUTES_GROUP, ENGINE, &error);
+
+    ROUTES_ENGINE engine = ENGINE_INDEX;
+
+    if      (g_strcmp0(engine_name, ENGINE_SCAN_NAME ) == 0) {
+        engine = ENGINE_SCAN;
+    }
+    else if (g_strcmp0(engine_name, ENGINE_TABLE_NAME) == 0) {
+        engine = ENGINE_TABLE;
+    }
+    else if (g_strcmp0(engine_name, ENGINE_SIMD_NAME ) == 0) {
+        engine = ENGINE_SIMD;
+    }
+    else if (g_strcmp0(engine_name, ENGINE_PACKED_NAME) == 0) {
+        engine = ENGINE_PACKED;
+    }
+
+    g_free(engine_name);
+
+    return engine;
+}
+
+/**
+ * Retrieves the memory limit for the precomputed table of directly
+ * connected bus stops, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The memory limit in bytes.
+ */
+guint64 get_table_memory_limit(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint table_limit
+        = g_key_file_get_integer(settings, ROUTES_GROUP, TABLE_LIMIT, &error);
+
+    if (error != NULL) {
+        g_clear_error(&error);
+
+        table_limit = DEF_TABLE_LIMIT;
+    }
+
+    if (table_limit < 0) { table_limit = 0; }
+
+    return (guint64) table_limit << 20;
+}
+
+/**
+ * Retrieves the memory limit for the route-to-route transfers graph,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The memory limit in bytes.
+ */
+guint64 get_transfers_memory_limit(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint transfers_limit = g_key_file_get_integer(settings, ROUTES_GROUP,
+        TRANSFERS_LIMIT, &error);
+
+    if (error != NULL) {
+        g_clear_error(&error);
+
+        transfers_limit = DEF_TRANSFERS_LIMIT;
+    }
+
+    if (transfers_limit < 0) { transfers_limit = 0; }
+
+    return (guint64) transfers_limit << 20;
+}
+
+/**
+ * Retrieves the memory limit for the sets of bus stops reachable directly
+ * from each bus stop, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The memory limit in bytes.
+ */
+guint64 get_reachable_memory_limit(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint reachable_limit = g_key_file_get_integer(settings, ROUTES_GROUP,
+        REACHABLE_LIMIT, &error);
+
+    if (error != NULL) {
+        g_clear_error(&error);
+
+        reachable_limit = DEF_REACHABLE_LIMIT;
+    }
+
+    if (reachable_limit < 0) { reachable_limit = 0; }
+
+    return (guint64) reachable_limit << 20;
+}
+
+/**
+ * Retrieves the capacity of the response cache, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The maximum number of bus stop pairs the response cache
+ *         of a server worker holds (0 means the cache is disabled).
+ */
+guint get_cache_capacity(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint capacity
+        = g_key_file_get_integer(settings, CACHE_GROUP, CACHE_CAPACITY,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return 0;
+    }
+
+    if ((capacity < 0) || (capacity > MAX_CACHE_CAPACITY)) {
+        g_warning(ERR_CACHE_VALID_MUST_BE_POSITIVE_INT); return 0;
+    }
+
+    return capacity;
+}
+
+/**
+ * Identifies whether requests have to be written to the access log
+ * by retrieving the corresponding setting from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return <code>TRUE</code> if requests have to be logged,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_access_log_enabled(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gboolean access_log_enabled
+        = g_key_file_get_boolean(settings, ACCESS_GROUP, ACCESS_ENABLED,
+            &error);
+
+    return access_log_enabled;
+}
+
+/**
+ * Retrieves the share of requests written to the access log,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The share of requests sampled, in the range 0 .. 1.
+ *         Defaults to all of them, if the setting is not defined.
+ */
+gdouble get_access_sample_rate(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gdouble sample_rate
+        = g_key_file_get_double(settings, ACCESS_GROUP, ACCESS_SAMPLE_RATE,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return 1;
+    }
+
+    if ((sample_rate < 0) || (sample_rate > 1)) {
+        g_warning(ERR_ACCESS_SAMPLE_RATE_MUST_BE_FRACTION); return 1;
+    }
+
+    return sample_rate;
+}
+
+// Helper function. Retrieves the access log setting given,
+// from daemon settings.
+static guint _get_access_setting(      GKeyFile *settings,
+                                 const gchar    *key,
+                                 const guint     def) {
+
+    GError *error = NULL;
+
+    gint value = g_key_file_get_integer(settings, ACCESS_GROUP, key, &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return def;
+    }
+
+    if (value < 0) {
+        g_warning(ERR_ACCESS_VALID_MUST_BE_POSITIVE_INT, key, def);
+
+        return def;
+    }
+
+    return value;
+}
+
+/**
+ * Retrieves the maximum number of requests written to the access log
+ * per second, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The maximum number of requests logged per second
+ *         (0 means no limit).
+ */
+guint get_access_rate_limit(GKeyFile *settings) {
+    return _get_access_setting(settings, ACCESS_RATE_LIMIT, 0);
+}
+
+/**
+ * Retrieves the maximum number of requests written to the access log
+ * in a burst, over the rate limit, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The maximum number of requests logged in a burst
+ *         (0 means as many as per second).
+ */
+guint get_access_rate_burst(GKeyFile *settings) {
+    return _get_access_setting(settings, ACCESS_RATE_BURST, 0);
+}
+
+/**
+ * Identifies whether request phase timings have to be sent back
+ * in the <code>Server-Timing</code> response header, by retrieving
+ * the corresponding setting from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return <code>TRUE</code> if the header has to be sent,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean is_server_timing_enabled(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gboolean server_timing
+        = g_key_file_get_boolean(settings, TRACING_GROUP, SERVER_TIMING,
+            &error);
+
+    return server_timing;
+}
+
+/**
+ * Retrieves the threshold of request handling time, over which requests
+ * are logged as slow, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The threshold (in milliseconds). 0 means slow requests
+ *         are not logged.
+ */
+guint get_slow_request_threshold(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint threshold
+        = g_key_file_get_integer(settings, TRACING_GROUP, SLOW_THRESHOLD,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return 0;
+    }
+
+    if (threshold < 0) {
+        g_warning(ERR_SLOW_REQUEST_VALID_MUST_BE_POSITIVE_INT); return 0;
+    }
+
+    return threshold;
+}
+
+// Helper function. Retrieves the admission control setting given,
+// from daemon settings.
+static guint _get_admission_setting(      GKeyFile *settings,
+                                    const gchar    *key,
+                                    const guint     def) {
+
+    GError *error = NULL;
+
+    gint value = g_key_file_get_integer(settings, ADMISSION_GROUP, key,
+        &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return def;
+    }
+
+    if (value < 0) {
+        g_warning(ERR_ADMISSION_VALID_MUST_BE_POSITIVE_INT, key, def);
+
+        return def;
+    }
+
+    return value;
+}
+
+/**
+ * Retrieves the maximum number of requests in flight in all server workers,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The maximum number of requests in flight (0 means no limit).
+ */
+guint get_max_in_flight(GKeyFile *settings) {
+    return _get_admission_setting(settings, MAX_IN_FLIGHT, 0);
+}
+
+/**
+ * Retrieves the maximum time a request is allowed to wait to be handled,
+ * from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The maximum queue wait time in milliseconds (0 means no limit).
+ */
+guint get_max_queue_wait(GKeyFile *settings) {
+    return _get_admission_setting(settings, MAX_QUEUE_WAIT, 0);
+}
+
+/**
+ * Retrieves the number of seconds clients are told to wait before retrying
+ * requests shed by the admission control, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The value of the Retry-After header (in seconds).
+ */
+guint get_retry_after(GKeyFile *settings) {
+    return _get_admission_setting(settings, RETRY_AFTER, DEF_RETRY_AFTER);
+}
+
+/**
+ * Retrieves the number of threads in the offload pool, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The number of threads to perform direct-route lookups in
+ *         (0 means lookups are performed by server workers themselves).
+ */
+guint get_offload_pool_size(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint pool_size
+        = g_key_file_get_integer(settings, OFFLOAD_GROUP, OFFLOAD_POOL_SIZE,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return 0;
+    }
+
+    if ((pool_size < 0) || (pool_size > MAX_OFFLOAD_POOL_SIZE)) {
+        g_warning(ERR_OFFLOAD_POOL_VALID_MUST_BE_POSITIVE_INT); return 0;
+    }
+
+    return pool_size;
+}
+
+/**
+ * Retrieves the depth of the offload pool queue, from daemon settings.
+ *
+ * @param settings The pointer to a structure containing key-value pairs
+ *                 of individual settings.
+ *
+ * @return The number of direct-route lookups allowed to wait in the queue.
+ */
+guint get_offload_queue_depth(GKeyFile *settings) {
+    GError *error = NULL;
+
+    gint queue_depth
+        = g_key_file_get_integer(settings, OFFLOAD_GROUP, OFFLOAD_QUEUE_DEPTH,
+            &error);
+
+    if (error != NULL) {
+        g_clear_error(&error); return DEF_OFFLOAD_QUEUE_DEPTH;
+    }
+
+    if ((queue_depth < 1) || (queue_depth > MAX_OFFLOAD_QUEUE_DEPTH)) {
+        g_warning(ERR_OFFLOAD_QUEUE_VALID_MUST_BE_POSITIVE_INT);
+
+        return DEF_OFFLOAD_QUEUE_DEPTH;
+    }
+
+    return queue_depth;
+}
+
 // Helper function. Used to get the daemon settings.
 GKeyFile *_get_settings() {
     GKeyFile *settings = g_key_file_new();
@@ -209,11 +778,84 @@ GKeyFile *_get_settings() {
     return settings;
 }
 
+// Helper function. Stops the main loop of a server worker.
+static gboolean _quit_worker(GMainLoop *loop) {
+    g_main_loop_quit(loop);
+
+    return G_SOURCE_REMOVE;
+}
+
 // Helper function. Makes final pointers cleanups/unrefs, closes streams, etc.
 void _cleanup(_CLEANUP_ARGS *cleanup_args) {
+    SERVER_WORKER *workers = cleanup_args->workers;
+
+    // Stopping server workers. The quit request is dispatched
+    // from within the worker's own main context, so it cannot get lost
+    // even if the worker's main loop isn't running yet.
+    for (guint i = 0; i < cleanup_args->workers_count; i++) {
+        g_main_context_invoke(workers[i].context,
+            (GSourceFunc) _quit_worker, workers[i].loop);
+    }
+
+    // Waiting for server workers to finish requests in progress,
+    // before closing the logfile they might still write to.
+    for (guint i = 0; i < cleanup_args->workers_count; i++) {
+        g_thread_join(workers[i].thread);
+
+        g_main_loop_unref(workers[i].loop);
+        g_main_context_unref(workers[i].context);
+
+        report_cache(workers[i].handler_payload->routes_cache);
+        free_cache(  workers[i].handler_payload->routes_cache);
+
+        free(workers[i].handler_payload);
+    }
+
+    g_free(workers);
+
+    cleanup_args->workers       = NULL;
+    cleanup_args->workers_count = 0;
+
+    // Letting lookups handed over to the offload pool finish off.
+    // Requests they belong to are not going to be resumed, as server
+    // workers are no longer running.
+    if ((cleanup_args->handler_payload != NULL)
+        && (cleanup_args->handler_payload->offload_pool != NULL)) {
+
+        g_thread_pool_free(cleanup_args->handler_payload->offload_pool,
+            FALSE, TRUE);
+
+        cleanup_args->handler_payload->offload_pool = NULL;
+    }
+
+    // The main loop's own response cache is only used from this thread,
+    // and the metrics of server workers are no longer updated.
+    if (cleanup_args->handler_payload != NULL) {
+        report_cache(cleanup_args->handler_payload->routes_cache);
+        free_cache(  cleanup_args->handler_payload->routes_cache);
+        free_metrics(cleanup_args->handler_payload->metrics_registry);
+
+        cleanup_args->handler_payload->routes_cache     = NULL;
+        cleanup_args->handler_payload->metrics_registry = NULL;
+    }
+
+    // Removing the Unix domain socket file, so that it doesn't get left
+    // stale.
+    if (cleanup_args->unix_socket_path != NULL) {
+        unlink(cleanup_args->unix_socket_path);
+
+        cleanup_args->unix_socket_path = NULL;
+    }
+
+    // Flushing access log lines left in its log buffer (if any).
+    close_access_log(cleanup_args->access_log);
+
     g_message(       MSG_SERVER_STOPPED);
     syslog(LOG_INFO, MSG_SERVER_STOPPED);
 
+    // Flushing log entries left in the log buffer (if any).
+    stop_log_sink(cleanup_args->log_sink);
+
     // Closing the system logger.
     closelog();
 
@@ -0,0 +1,301 @@
+/*
+ * src/bus-load.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The HTTP load generator ----------------------------------------------------
+
+#include "busd.h"
+
+#define LOAD_HOST "127.0.0.1"
+#define LOAD_REQUEST_FORMAT "GET " SLASH REST_PREFIX SLASH REST_DIRECT \
+    "?" FROM EQUALS UINT_FORMAT "&" TO EQUALS UINT_FORMAT " HTTP/1.1\r\n" \
+    "Host: " LOAD_HOST "\r\n\r\n"
+#define LOAD_STATUS_OK      "HTTP/1.1 200 "
+#define LOAD_HEADERS_END    "\r\n\r\n"
+#define LOAD_CONTENT_LENGTH "\r\nContent-Length:"
+
+// The structure to hold a connection of the load generator, which sends
+// requests one after another, each one right after the previous response.
+typedef struct {
+          GThread        *thread;
+          gushort         port;
+          gint64          deadline;    // When to stop sending requests.
+    const QUERY_WORKLOAD *workload;
+          guint           next_query;  // Connections start at different ones.
+          GArray         *durations;   // Response times (in nanoseconds).
+          guint64         failed;      // Requests failed.
+          GError         *error;       // The reason the connection failed.
+} LOAD_CONNECTION;
+
+// Helper function. Receives the whole HTTP response, relying on its
+// Content-Length header, since the daemon doesn't use chunked encoding
+// for its responses.
+static gboolean _receive_response(GSocket  *socket,
+                                  gboolean *is_ok,
+                                  GError  **error) {
+
+    gchar buff[LOAD_BUFF_SIZE + 1];
+    gsize received = 0;
+    gsize expected = 0;
+
+    while ((expected == 0) || (received < expected)) {
+        if (received == LOAD_BUFF_SIZE) { return FALSE; }
+
+        gssize len = g_socket_receive(socket, buff + received,
+            LOAD_BUFF_SIZE - received, NULL, error);
+
+        if (len <= 0) { return FALSE; }
+
+        received += len;
+
+        if (expected > 0) { continue; }
+
+        buff[received] = '\0';
+
+        const gchar *headers_end = strstr(buff, LOAD_HEADERS_END);
+
+        if (headers_end == NULL) { continue; }
+
+        const gchar *content_length = g_strstr_len(buff, headers_end - buff,
+            LOAD_CONTENT_LENGTH);
+
+        expected = (headers_end - buff) + strlen(LOAD_HEADERS_END)
+            + ((content_length != NULL) ? g_ascii_strtoull(content_length
+            + strlen(LOAD_CONTENT_LENGTH), NULL, 10) : 0);
+    }
+
+    *is_ok = g_str_has_prefix(buff, LOAD_STATUS_OK);
+
+    return TRUE;
+}
+
+// Helper function. Runs the connection of the load generator:
+// sends requests until the deadline, timing each one.
+static gpointer _run_connection(LOAD_CONNECTION *connection) {
+    GSocket *socket = g_socket_new(G_SOCKET_FAMILY_IPV4,
+        G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &connection->error);
+
+    if (socket == NULL) { return NULL; }
+
+    GSocketAddress *address = g_inet_socket_address_new_from_string(
+        LOAD_HOST, connection->port);
+
+    gboolean is_connected = g_socket_connect(socket, address, NULL,
+        &connection->error);
+
+    g_object_unref(address);
+
+    if (!is_connected) {
+        g_object_unref(socket);
+
+        return NULL;
+    }
+
+    // Sending each request right away, rather than waiting for more data.
+    g_socket_set_option(socket, IPPROTO_TCP, TCP_NODELAY, 1, NULL);
+
+    const QUERY_WORKLOAD *workload = connection->workload;
+
+    guint i = connection->next_query;
+    gchar request[RESP_BUFF_SIZE];
+
+    while (g_get_monotonic_time() < connection->deadline) {
+        gint request_len = g_snprintf(request, RESP_BUFF_SIZE,
+            LOAD_REQUEST_FORMAT, workload->from[i], workload->to[i]);
+
+        i = (i + 1) % workload->count;
+
+        guint64  start = get_time_ns();
+        gboolean is_ok = FALSE;
+
+        // A short send means the daemon has closed the connection.
+        if ((g_socket_send(socket, request, request_len, NULL,
+            &connection->error) != request_len)
+            || !_receive_response(socket, &is_ok, &connection->error)) {
+
+            connection->failed++;
+
+            break;
+        }
+
+        guint64 duration = get_time_ns() - start;
+
+        g_array_append_val(connection->durations, duration);
+
+        if (!is_ok) { connection->failed++; }
+    }
+
+    g_socket_close(socket, NULL);
+    g_object_unref(socket);
+
+    return NULL;
+}
+
+// Helper function. Compares two durations, for sorting.
+static int _cmp_durations(const void *a, const void *b) {
+    guint64 a_ = *(const guint64 *) a;
+    guint64 b_ = *(const guint64 *) b;
+
+    return (a_ > b_) - (a_ < b_);
+}
+
+// Helper function. Gets the percentile of durations given (in microseconds).
+static gdouble _get_percentile(const GArray  *durations,
+                               const gdouble  percentile) {
+
+    if (durations->len == 0) { return 0; }
+
+    guint i = (guint) ((durations->len - 1) * percentile / 100);
+
+    return (gdouble) g_array_index(durations, guint64, i) / 1000;
+}
+
+// Helper function. Retrieves the server port number from daemon settings,
+// so that the daemon started as is would be found.
+static gushort _get_port() {
+    GKeyFile *settings = g_key_file_new();
+
+    gint port = DEF_PORT;
+
+    if (g_key_file_load_from_file(settings, SETTINGS, G_KEY_FILE_NONE,
+        NULL)) {
+
+        port = g_key_file_get_integer(settings, SERVER_GROUP, SERVER_PORT,
+            NULL);
+
+        if ((port < MIN_PORT) || (port > MAX_PORT)) { port = DEF_PORT; }
+    }
+
+    g_key_file_free(settings);
+
+    return port;
+}
+
+/**
+ * The HTTP load generator entry point. Runs a closed-loop load against
+ * the daemon started on localhost: each connection sends direct-route
+ * requests one after another, drawn from a workload of queries
+ * against the routes data store given, for a number of seconds.
+ * Reports the throughput and response time percentiles.
+ *
+ * @param argc The number of command-line arguments + 1 (the generator name).
+ * @param argv The pointer to an array of command-line arguments,
+ *             including the generator name: the number of connections,
+ *             of seconds, and the path and filename of the routes
+ *             data store (all optional).
+ *
+ * @returns The exit code of the overall termination of the generator.
+ */
+int main(int argc, char *const *argv) {
+    guint connections_count = (argc > 1)
+        ? (guint) g_ascii_strtoull(argv[1], NULL, 10) : DEF_LOAD_CONNECTIONS;
+    guint seconds = (argc > 2)
+        ? (guint) g_ascii_strtoull(argv[2], NULL, 10) : DEF_LOAD_SECONDS;
+    const gchar *datastore = (argc > 3) ? argv[3] : SAMPLE_ROUTES;
+
+    if ((argc > 4) || (connections_count == 0)
+        || (connections_count > MAX_WORKERS) || (seconds == 0)) {
+
+        g_printerr(ERR_LOAD_USAGE NEW_LINE);
+
+        return EXIT_FAILURE;
+    }
+
+    ROUTES_STORE *routes = load_routes(datastore, FALSE, ENGINE_INDEX, 0);
+
+    if (routes == NULL) {
+        g_warning(ERR_DATASTORE_NOT_FOUND);
+
+        return EXIT_FAILURE;
+    }
+
+    QUERY_WORKLOAD *workload = new_workload(routes, DEF_LOAD_QUERIES,
+        DEF_BENCH_HIT_RATIO, DEF_BENCH_SEED);
+
+    free_routes(routes);
+
+    gushort port = _get_port();
+
+    g_message(MSG_LOAD_STARTED, port, connections_count, seconds);
+
+    LOAD_CONNECTION *connections = g_new0(LOAD_CONNECTION, connections_count);
+
+    gint64 start    = g_get_monotonic_time();
+    gint64 deadline = start + ((gint64) seconds * G_USEC_PER_SEC);
+
+    for (guint i = 0; i < connections_count; i++) {
+        LOAD_CONNECTION *connection = &connections[i];
+
+        connection->port       = port;
+        connection->deadline   = deadline;
+        connection->workload   = workload;
+        connection->next_query = (i * workload->count) / connections_count;
+        connection->durations  = g_array_new(FALSE, FALSE, sizeof(guint64));
+        connection->thread     = g_thread_new(NULL,
+            (GThreadFunc) _run_connection, connection);
+    }
+
+    GArray  *durations = g_array_new(FALSE, FALSE, sizeof(guint64));
+    guint64  failed    = 0;
+    gboolean is_failed = FALSE;
+
+    for (guint i = 0; i < connections_count; i++) {
+        LOAD_CONNECTION *connection = &connections[i];
+
+        g_thread_join(connection->thread);
+
+        g_array_append_vals(durations, connection->durations->data,
+            connection->durations->len);
+
+        failed += connection->failed;
+
+        if (connection->error != NULL) {
+            // Reporting the reason once, as it's mostly the same one.
+            if (!is_failed) {
+                g_warning(ERR_CONNECTION_FAILED, port,
+                    connection->error->message);
+            }
+
+            is_failed = TRUE;
+
+            g_clear_error(&connection->error);
+        }
+
+        g_array_free(connection->durations, TRUE);
+    }
+
+    gdouble elapsed = (gdouble) (g_get_monotonic_time() - start)
+        / G_USEC_PER_SEC;
+
+    g_array_sort(durations, _cmp_durations);
+
+    g_print(MSG_LOAD_RESULT, (guint64) durations->len, failed, elapsed,
+        durations->len / elapsed,
+        _get_percentile(durations, 50  ),
+        _get_percentile(durations, 90  ),
+        _get_percentile(durations, 99  ),
+        _get_percentile(durations, 99.9),
+        _get_percentile(durations, 100 ));
+
+    // Failing if no request got through at all (e.g. the daemon
+    // isn't running).
+    gboolean is_loaded = durations->len > 0;
+
+    g_array_free(durations, TRUE);
+    g_free(connections);
+
+    free_workload(workload);
+
+    return is_loaded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,473 @@
+/*
+ * src/bus-logger.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The asynchronous logger module of the daemon -------------------------------
+
+#include "busd.h"
+
+/**
+ * Creates a new log ring: a bounded lock-free multi-producer
+ * single-consumer queue of preallocated log entries.
+ *
+ * @param size The number of entries (rounded up to a power of two,
+ *             2 at least, so that sequence numbers of a free entry
+ *             and of a ready one never coincide).
+ *
+ * @return The pointer to a newly allocated log ring.
+ *         Should be freed with <code>free_log_ring()</code>.
+ */
+LOG_RING *new_log_ring(const guint size) {
+    guint size_ = 2;
+
+    while (size_ < size) { size_ <<= 1; }
+
+    LOG_RING *ring = g_new0(LOG_RING, 1);
+
+    ring->mask  = size_ - 1;
+    ring->slots = g_new(LOG_SLOT, size_);
+
+    // Each entry is free to be taken at its own position.
+    for (guint i = 0; i < size_; i++) { ring->slots[i].sequence = (gint) i; }
+
+    g_mutex_init(&ring->mutex);
+    g_cond_init( &ring->cond );
+
+    return ring;
+}
+
+// Helper function. Wakes the consumer up, to free some room
+// in the log ring. Only gets called when the log ring is filling up,
+// so the lock taken is out of the way of putting entries in.
+static void _wake_consumer(LOG_RING *ring) {
+    g_mutex_lock(&ring->mutex);
+
+    ring->wakeup = TRUE;
+
+    g_cond_signal(&ring->cond);
+    g_mutex_unlock(&ring->mutex);
+}
+
+/**
+ * Puts an entry into the log ring. Can be called from any thread.
+ * The text is truncated to <code>LOG_SLOT_SIZE</code> bytes.
+ *
+ * @param ring     The pointer to the log ring.
+ * @param overflow What to do if the log ring is full.
+ * @param level    The log level of the entry (0 for a raw line).
+ * @param text     The text of the entry (not necessarily NUL-terminated).
+ * @param length   The length of the text in bytes.
+ *
+ * @return <code>TRUE</code> if the entry is put into the log ring,
+ *         <code>FALSE</code> if it is dropped.
+ */
+gboolean push_log_ring(      LOG_RING       *ring,
+                       const LOG_OVERFLOW    overflow,
+                       const GLogLevelFlags  level,
+                       const gchar          *text,
+                       const gsize           length) {
+
+    guint     position = g_atomic_int_get(&ring->tail);
+    LOG_SLOT *slot;
+
+    // Claiming the entry at the tail position, competing with other
+    // producers for it.
+    while (TRUE) {
+        slot = &ring->slots[position & ring->mask];
+
+        gint diff = (gint) ((guint) g_atomic_int_get(&slot->sequence)
+            - position);
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange(&ring->tail,
+                (gint) position, (gint) (position + 1))) {
+
+                break;
+            }
+        } else if (diff < 0) {
+            // The entry hasn't been consumed yet: the log ring is full.
+            _wake_consumer(ring);
+
+            if (overflow == LOG_OVERFLOW_DROP) {
+                g_atomic_int_inc(&ring->dropped);
+
+                return FALSE;
+            }
+
+            g_thread_yield();
+        }
+
+        position = g_atomic_int_get(&ring->tail);
+    }
+
+    slot->level  = level;
+    slot->time   = g_get_real_time() / G_USEC_PER_SEC;
+    slot->length = MIN(length, LOG_SLOT_SIZE);
+
+    memcpy(slot->text, text, slot->length);
+
+    // Publishing the entry to the consumer.
+    g_atomic_int_set(&slot->sequence, (gint) (position + 1));
+
+    // Waking the consumer up as soon as the log ring gets half full,
+    // rather than waiting for it to get full.
+    if ((position - (guint) g_atomic_int_get(&ring->head))
+        == ((ring->mask + 1) >> 1)) {
+
+        _wake_consumer(ring);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Gets the entry at the head of the log ring. Should only be called
+ * from the (single) consumer thread.
+ *
+ * @param ring The pointer to the log ring.
+ *
+ * @return The pointer to the entry at the head of the log ring
+ *         or <code>NULL</code>, if the log ring is empty. Should be released
+ *         with <code>release_log_ring()</code> once consumed.
+ */
+LOG_SLOT *peek_log_ring(LOG_RING *ring) {
+    guint head = ring->head;
+
+    LOG_SLOT *slot = &ring->slots[head & ring->mask];
+
+    gint diff = (gint) ((guint) g_atomic_int_get(&slot->sequence)
+        - (head + 1));
+
+    return (diff < 0) ? NULL : slot;
+}
+
+/**
+ * Releases the entry at the head of the log ring, so that it can be
+ * taken by producers again.
+ *
+ * @param ring The pointer to the log ring.
+ */
+void release_log_ring(LOG_RING *ring) {
+    guint head = ring->head;
+
+    LOG_SLOT *slot = &ring->slots[head & ring->mask];
+
+    g_atomic_int_set(&slot->sequence, (gint) (head + ring->mask + 1));
+    g_atomic_int_set(&ring->head,     (gint) (head + 1));
+}
+
+/**
+ * Waits for the log ring to get filled up (half full, at least),
+ * or for the timeout to expire, whichever comes first. Should only be
+ * called from the (single) consumer thread, when the log ring is empty.
+ *
+ * @param ring    The pointer to the log ring.
+ * @param timeout The timeout (in microseconds).
+ */
+void wait_log_ring(LOG_RING *ring, const gint64 timeout) {
+    gint64 end_time = g_get_monotonic_time() + timeout;
+
+    g_mutex_lock(&ring->mutex);
+
+    while (!ring->wakeup) {
+        if (!g_cond_wait_until(&ring->cond, &ring->mutex, end_time)) {
+            break;
+        }
+    }
+
+    ring->wakeup = FALSE;
+
+    g_mutex_unlock(&ring->mutex);
+}
+
+/**
+ * Frees the log ring.
+ *
+ * @param ring The pointer to the log ring.
+ */
+void free_log_ring(LOG_RING *ring) {
+    if (ring == NULL) { return; }
+
+    g_mutex_clear(&ring->mutex);
+    g_cond_clear( &ring->cond );
+
+    g_free(ring->slots);
+    g_free(ring);
+}
+
+// Helper function. Renders a log entry as a log line into the buffer,
+// refreshing the cached timestamp prefix once per second only.
+// Returns the length of the log line.
+static gsize _render_entry(      LOG_SINK       *sink,
+                           const GLogLevelFlags  level,
+                           const gint64          time,
+                           const gchar          *text,
+                           const gsize           length,
+                                 gchar          *buffer) {
+
+    if (level == 0) {
+        memcpy(buffer, text, length); buffer[length] = NEW_LINE[0];
+
+        return length + 1;
+    }
+
+    if (time != sink->prefix_time) {
+        GDateTime *date_time = g_date_time_new_from_unix_local(time);
+
+        sink->prefix_length = g_snprintf(sink->prefix, LOG_PREFIX_SIZE,
+            LOG_PREFIX_FORMAT,
+            g_date_time_get_year        (date_time),
+            g_date_time_get_month       (date_time),
+            g_date_time_get_day_of_month(date_time),
+            g_date_time_get_hour        (date_time),
+            g_date_time_get_minute      (date_time),
+            g_date_time_get_second      (date_time));
+
+        g_date_time_unref(date_time);
+
+        sink->prefix_time = time;
+    }
+
+    const gchar *llevel = (level & G_LOG_LEVEL_DEBUG)
+        ? ("[" LOG_LEVEL_DEBUG       "]" SPACE SPACE)
+        : (level & (G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO))
+        ? ("[" LOG_LEVEL_INFO  SPACE "]" SPACE SPACE)
+        : ("[" LOG_LEVEL_WARN  SPACE "]" SPACE SPACE);
+
+    gsize llevel_length = strlen(llevel);
+    gsize line_length   = 0;
+
+    memcpy(buffer + line_length, sink->prefix, sink->prefix_length);
+    line_length += sink->prefix_length;
+    memcpy(buffer + line_length, llevel,       llevel_length);
+    line_length += llevel_length;
+    memcpy(buffer + line_length, text,         length);
+    line_length += length;
+
+    buffer[line_length++] = NEW_LINE[0];
+
+    return line_length;
+}
+
+// Helper function. Writes log lines out to the console (if enabled).
+// Log levels are split between stdout and stderr.
+static void _echo_lines(      LOG_SINK       *sink,
+                        const GLogLevelFlags  level,
+                        const gchar          *lines,
+                        const gsize           length) {
+
+    if (!sink->console || (level == 0)) { return; }
+
+    fwrite(lines, 1, length, (level & (G_LOG_LEVEL_DEBUG
+        | G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO)) ? stdout : stderr);
+}
+
+// Helper function. Appends a log entry to the batch of log lines,
+// writing the batch out to the log stream first, if it is full.
+static void _batch_entry(      LOG_SINK       *sink,
+                               gchar          *batch,
+                               gsize          *batch_length,
+                         const GLogLevelFlags  level,
+                         const gint64          time,
+                         const gchar          *text,
+                         const gsize           length) {
+
+    // Making room for the longest possible log line.
+    if ((*batch_length + LOG_LINE_SIZE) > LOG_BATCH_SIZE) {
+        g_output_stream_write_all(sink->stream, batch, *batch_length,
+            NULL, NULL, NULL);
+
+        *batch_length = 0;
+    }
+
+    gchar *line = batch + *batch_length;
+
+    gsize line_length = _render_entry(sink, level, time, text, length, line);
+
+    _echo_lines(sink, level, line, line_length);
+
+    *batch_length += line_length;
+}
+
+// Helper function. Flushes batches of log entries from the log ring
+// to the log stream in the background, until the log sink is stopped
+// and there are no more producers left.
+static gpointer _flush_log_sink(LOG_SINK *sink) {
+    gchar *batch = g_malloc(LOG_BATCH_SIZE);
+    guint  dropped_reported = 0;
+
+    while (TRUE) {
+        // Finishing off after this batch only when no producer could still
+        // be putting entries into the log ring.
+        gboolean is_finishing = !g_atomic_int_get(&sink->running)
+            && (g_atomic_int_get(&sink->writers) == 0);
+
+        gsize batch_length = 0;
+        guint entries      = 0;
+
+        g_mutex_lock(&sink->mutex);
+
+        LOG_SLOT *slot;
+
+        while ((slot = peek_log_ring(sink->ring)) != NULL) {
+            _batch_entry(sink, batch, &batch_length, slot->level, slot->time,
+                slot->text, slot->length);
+
+            release_log_ring(sink->ring);
+
+            entries++;
+        }
+
+        // Reporting log entries dropped since the last batch (if any),
+        // unless the log stream is meant to hold raw lines only.
+        guint dropped = g_atomic_int_get(&sink->ring->dropped);
+
+        if (!sink->raw && (dropped != dropped_reported)) {
+            gchar text[LOG_SLOT_SIZE];
+
+            gsize length = g_snprintf(text, LOG_SLOT_SIZE,
+                ERR_LOG_ENTRIES_DROPPED, dropped - dropped_reported);
+
+            _batch_entry(sink, batch, &batch_length, G_LOG_LEVEL_WARNING,
+                g_get_real_time() / G_USEC_PER_SEC, text, length);
+
+            dropped_reported = dropped;
+        }
+
+        if (batch_length > 0) {
+            g_output_stream_write_all(sink->stream, batch, batch_length,
+                NULL, NULL, NULL);
+
+            if (sink->console) { fflush(stdout); }
+        }
+
+        g_mutex_unlock(&sink->mutex);
+
+        if (is_finishing) { break; }
+
+        if (entries == 0) { wait_log_ring(sink->ring, LOG_FLUSH_INTERVAL); }
+    }
+
+    g_free(batch);
+
+    return NULL;
+}
+
+/**
+ * Creates a new log sink. Until started, log entries are written out
+ * synchronously, right in the thread they come from.
+ *
+ * @param stream  The output stream to write log lines to.
+ * @param console Whether log lines also have to be written to the console.
+ *
+ * @return The pointer to a newly allocated log sink.
+ */
+LOG_SINK *new_log_sink(GOutputStream *stream, const gboolean console) {
+    LOG_SINK *sink = g_new0(LOG_SINK, 1);
+
+    sink->stream      = stream;
+    sink->console     = console;
+    sink->prefix_time = -1;
+
+    g_mutex_init(&sink->mutex);
+
+    return sink;
+}
+
+/**
+ * Starts writing log entries out asynchronously: from now on, log entries
+ * are put into the log ring and flushed in batches by a background thread.
+ *
+ * @param sink     The pointer to the log sink.
+ * @param size     The number of entries in the log ring.
+ * @param overflow What to do if the log ring is full.
+ */
+void start_log_sink(      LOG_SINK     *sink,
+                    const guint         size,
+                    const LOG_OVERFLOW  overflow) {
+
+    sink->ring     = new_log_ring(size);
+    sink->overflow = overflow;
+
+    g_atomic_int_set(&sink->running, TRUE);
+
+    sink->thread = g_thread_new(NULL, (GThreadFunc) _flush_log_sink, sink);
+}
+
+/**
+ * Writes a log entry out to the log sink: puts it into the log ring,
+ * if the log sink is started, or writes it out right away otherwise.
+ *
+ * @param sink   The pointer to the log sink.
+ * @param level  The log level of the entry (0 for a raw line).
+ * @param text   The text of the entry (not necessarily NUL-terminated).
+ * @param length The length of the text in bytes.
+ *
+ * @return <code>TRUE</code> if the entry is written out (or queued),
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean write_log_sink(      LOG_SINK       *sink,
+                        const GLogLevelFlags  level,
+                        const gchar          *text,
+                        const gsize           length) {
+
+    gboolean is_written;
+
+    g_atomic_int_inc(&sink->writers);
+
+    if (g_atomic_int_get(&sink->running)) {
+        is_written = push_log_ring(sink->ring, sink->overflow, level, text,
+            length);
+    } else {
+        gchar line[LOG_LINE_SIZE];
+
+        g_mutex_lock(&sink->mutex);
+
+        gsize line_length = _render_entry(sink, level,
+            g_get_real_time() / G_USEC_PER_SEC, text,
+            MIN(length, LOG_SLOT_SIZE), line);
+
+        _echo_lines(sink, level, line, line_length);
+
+        is_written = g_output_stream_write_all(sink->stream, line,
+            line_length, NULL, NULL, NULL);
+
+        g_mutex_unlock(&sink->mutex);
+    }
+
+    g_atomic_int_add(&sink->writers, -1);
+
+    return is_written;
+}
+
+/**
+ * Stops writing log entries out asynchronously: waits for the background
+ * thread to flush all the entries left in the log ring, and gets back
+ * to writing log entries out synchronously.
+ *
+ * @param sink The pointer to the log sink.
+ */
+void stop_log_sink(LOG_SINK *sink) {
+    if (sink->thread == NULL) { return; }
+
+    g_atomic_int_set(&sink->running, FALSE);
+
+    g_thread_join(sink->thread);
+
+    sink->thread = NULL;
+
+    free_log_ring(sink->ring);
+
+    sink->ring = NULL;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,374 @@
+/*
+ * src/bus-metrics.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The metrics module of the daemon -------------------------------------------
+
+#include "busd.h"
+
+// HTTP status codes requests are counted by (the last one is for all
+// the other codes).
+static const guint _status_codes[STATUS_CODES] = {
+    200, 400, 404, 405, 413, 503
+};
+
+// Reasons for requests to be shed, as they are labeled in metrics.
+static const gchar *_shed_reasons[SHED_REASONS] = {
+    "in_flight", "queue_wait"
+};
+
+// Phases of request handling, as they are named in the Server-Timing header.
+static const gchar *_trace_phases[TRACE_PHASES] = {
+    "log", "parse", "cache", "queue", "lookup", "render"
+};
+
+/**
+ * Gets the current time of the monotonic clock, with nanosecond
+ * resolution, for timing request handling phases.
+ *
+ * @return The current monotonic time in nanoseconds.
+ */
+guint64 get_time_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((guint64) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+/**
+ * Creates a new registry of metrics of all server workers.
+ *
+ * @param workers_count The number of server workers
+ *                      (the main loop itself counts as the first one).
+ *
+ * @return The pointer to a newly allocated registry of metrics.
+ *         Should be freed with <code>free_metrics()</code>.
+ */
+METRICS_REGISTRY *new_metrics(const guint workers_count) {
+    METRICS_REGISTRY *registry = g_new0(METRICS_REGISTRY, 1);
+
+    registry->workers_count = workers_count;
+    registry->workers       = g_new(SERVER_METRICS *, workers_count);
+
+    // Allocating metrics of each server worker separately, so that
+    // the workers don't write to the same cache lines.
+    for (guint i = 0; i < workers_count; i++) {
+        registry->workers[i] = g_new0(SERVER_METRICS, 1);
+    }
+
+    return registry;
+}
+
+/**
+ * Counts the request by its HTTP status code.
+ *
+ * @param metrics The pointer to the metrics of the server worker.
+ * @param status  The HTTP status code of the response.
+ */
+void count_request(SERVER_METRICS *metrics, const guint status) {
+    guint i = 0;
+
+    while ((i < STATUS_CODES) && (_status_codes[i] != status)) { i++; }
+
+    METRIC_ADD(metrics->requests[i], 1);
+}
+
+/**
+ * Puts the duration observed into the latency histogram. Bucket bounds
+ * are powers of two (in nanoseconds), so the bucket is found
+ * by the number of significant bits in the duration.
+ *
+ * @param histogram The pointer to the latency histogram.
+ * @param duration  The duration observed (in nanoseconds).
+ */
+void observe_latency(LATENCY_HISTOGRAM *histogram, const guint64 duration) {
+    gint bucket = (duration > 1)
+        ? ((gint) g_bit_storage(duration - 1) - HIST_MIN_SHIFT) : 0;
+
+    bucket = CLAMP(bucket, 0, HIST_BUCKETS);
+
+    METRIC_ADD(histogram->buckets[bucket], 1       );
+    METRIC_ADD(histogram->count,           1       );
+    METRIC_ADD(histogram->sum,             duration);
+}
+
+// Helper function. Renders the latency histogram, summed up over all
+// server workers, in the Prometheus text exposition format.
+static void _render_histogram(      GString          *body,
+                              const METRICS_REGISTRY *registry,
+                              const gchar            *name,
+                              const gchar            *help,
+                              const gsize             offset) {
+
+    guint64 buckets[HIST_BUCKETS + 1] = { 0 };
+    guint64 count = 0, sum = 0;
+
+    for (guint i = 0; i < registry->workers_count; i++) {
+        const LATENCY_HISTOGRAM *histogram = (const LATENCY_HISTOGRAM *)
+            ((const gchar *) registry->workers[i] + offset);
+
+        for (guint j = 0; j <= HIST_BUCKETS; j++) {
+            buckets[j] += METRIC_GET(histogram->buckets[j]);
+        }
+
+        count += METRIC_GET(histogram->count);
+        sum   += METRIC_GET(histogram->sum  );
+    }
+
+    g_string_append_printf(body, METRICS_HELP_FORMAT METRICS_TYPE_FORMAT,
+        name, help, name, METRICS_TYPE_HISTOGRAM);
+
+    guint64 cumulative = 0;
+
+    for (guint j = 0; j < HIST_BUCKETS; j++) {
+        cumulative += buckets[j];
+
+        g_string_append_printf(body, METRICS_BUCKET_FORMAT, name,
+            (gdouble) (G_GUINT64_CONSTANT(1) << (HIST_MIN_SHIFT + j)) / 1e9,
+            cumulative);
+    }
+
+    g_string_append_printf(body, METRICS_INF_BUCKET_FORMAT, name, count);
+    g_string_append_printf(body, METRICS_SUM_FORMAT,        name,
+        (gdouble) sum / 1e9);
+    g_string_append_printf(body, METRICS_COUNT_FORMAT,      name, count);
+}
+
+// Helper function. Renders a single gauge.
+static void _render_gauge(      GString *body,
+                          const gchar   *name,
+                          const gchar   *help,
+                          const gdouble  value) {
+
+    g_string_append_printf(body, METRICS_HELP_FORMAT METRICS_TYPE_FORMAT
+        METRICS_VALUE_FORMAT, name, help, name, METRICS_TYPE_GAUGE,
+        name, value);
+}
+
+/**
+ * Renders all the metrics in the Prometheus text exposition format.
+ * Counters of server workers are summed up on the fly.
+ *
+ * @param registry The pointer to the registry of metrics.
+ * @param routes   The pointer to the current snapshot of routes.
+ *
+ * @return The newly allocated string holding the metrics rendered.
+ */
+GString *render_metrics(const METRICS_REGISTRY *registry,
+                        const ROUTES_STORE     *routes) {
+
+    GString *body = g_string_sized_new(METRICS_BUFF_SIZE);
+
+    // Request counts by HTTP status code.
+    g_string_append_printf(body, METRICS_HELP_FORMAT METRICS_TYPE_FORMAT,
+        METRIC_REQUESTS, METRIC_REQUESTS_HELP,
+        METRIC_REQUESTS, METRICS_TYPE_COUNTER);
+
+    for (guint j = 0; j <= STATUS_CODES; j++) {
+        guint64 requests = 0;
+
+        for (guint i = 0; i < registry->workers_count; i++) {
+            requests += METRIC_GET(registry->workers[i]->requests[j]);
+        }
+
+        if (j < STATUS_CODES) {
+            g_string_append_printf(body, METRICS_CODE_FORMAT,
+                METRIC_REQUESTS, _status_codes[j], requests);
+        } else {
+            g_string_append_printf(body, METRICS_OTHER_CODE_FORMAT,
+                METRIC_REQUESTS, requests);
+        }
+    }
+
+    // Requests shed by the admission control, by reason.
+    g_string_append_printf(body, METRICS_HELP_FORMAT METRICS_TYPE_FORMAT,
+        METRIC_SHED, METRIC_SHED_HELP, METRIC_SHED, METRICS_TYPE_COUNTER);
+
+    for (guint j = 0; j < SHED_REASONS; j++) {
+        guint64 shed = 0;
+
+        for (guint i = 0; i < registry->workers_count; i++) {
+            shed += METRIC_GET(registry->workers[i]->shed[j]);
+        }
+
+        g_string_append_printf(body, METRICS_REASON_FORMAT, METRIC_SHED,
+            _shed_reasons[j], shed);
+    }
+
+    _render_histogram(body, registry, METRIC_REQUEST_DURATION,
+        METRIC_REQUEST_DURATION_HELP, G_STRUCT_OFFSET(SERVER_METRICS,
+        request_duration));
+
+    _render_histogram(body, registry, METRIC_LOOKUP_DURATION,
+        METRIC_LOOKUP_DURATION_HELP, G_STRUCT_OFFSET(SERVER_METRICS,
+        lookup_duration));
+
+    // The current snapshot of routes.
+    _render_gauge(body, METRIC_ROUTES, METRIC_ROUTES_HELP,
+        routes->routes_count);
+    _render_gauge(body, METRIC_STOPS, METRIC_STOPS_HELP,
+        routes->stops_count);
+    _render_gauge(body, METRIC_STOPS_INDEXED, METRIC_STOPS_INDEXED_HELP,
+        routes->stop_ids_count);
+    _render_gauge(body, METRIC_SNAPSHOT, METRIC_SNAPSHOT_HELP,
+        routes->generation);
+    _render_gauge(body, METRIC_LOAD_DURATION, METRIC_LOAD_DURATION_HELP,
+        (gdouble) routes->load_duration  / G_USEC_PER_SEC);
+    _render_gauge(body, METRIC_INDEX_DURATION, METRIC_INDEX_DURATION_HELP,
+        (gdouble) routes->index_duration / G_USEC_PER_SEC);
+
+    return body;
+}
+
+/**
+ * Frees the registry of metrics.
+ *
+ * @param registry The pointer to the registry of metrics.
+ */
+void free_metrics(METRICS_REGISTRY *registry) {
+    if (registry == NULL) { return; }
+
+    for (guint i = 0; i < registry->workers_count; i++) {
+        g_free(registry->workers[i]);
+    }
+
+    g_free(registry->workers);
+    g_free(registry);
+}
+
+/**
+ * Creates a new request tracing settings structure.
+ *
+ * @param server_timing  Whether request phase timings are to be sent back
+ *                       in the Server-Timing header.
+ * @param slow_threshold The time (in milliseconds) of request handling,
+ *                       over which requests are logged as slow
+ *                       (0 means none are logged).
+ *
+ * @return The pointer to a newly allocated request tracing settings
+ *         structure or <code>NULL</code>, if there is nothing to trace
+ *         requests for (the request tracing is disabled). Should be freed
+ *         with <code>free_tracing()</code>.
+ */
+REQUEST_TRACING *new_tracing(const gboolean server_timing,
+                             const guint    slow_threshold) {
+
+    if (!server_timing && (slow_threshold == 0)) { return NULL; }
+
+    REQUEST_TRACING *tracing = g_new0(REQUEST_TRACING, 1);
+
+    tracing->server_timing  = server_timing;
+    tracing->slow_threshold = (guint64) slow_threshold * 1000000;
+
+    g_message(       MSG_TRACING_ENABLED, server_timing ? JSON_TRUE
+        : JSON_FALSE, slow_threshold);
+    syslog(LOG_INFO, MSG_TRACING_ENABLED, server_timing ? JSON_TRUE
+        : JSON_FALSE, slow_threshold);
+
+    return tracing;
+}
+
+/**
+ * Starts tracing the request.
+ *
+ * @param trace The pointer to the trace of the request.
+ * @param start When the request handling started (in nanoseconds).
+ */
+void start_trace(REQUEST_TRACE *trace, const guint64 start) {
+    memset(trace->phases, 0, sizeof(trace->phases));
+
+    trace->start = start;
+    trace->last  = start;
+}
+
+/**
+ * Ends the current phase of the request handling, adding the time spent
+ * since the phase before ended to the phase given. Should be called
+ * through the <code>TRACE()</code> macro.
+ *
+ * @param trace The pointer to the trace of the request.
+ * @param phase The phase just ended.
+ */
+void trace_phase(REQUEST_TRACE *trace, const TRACE_PHASE phase) {
+    guint64 now = get_time_ns();
+
+    trace->phases[phase] += now - trace->last;
+    trace->last           = now;
+}
+
+/**
+ * Finishes tracing the request: sends the time spent in each phase
+ * (and in all of them) back in the Server-Timing header, if enabled,
+ * and logs the same timings along with the request URI, if the request
+ * took longer than the slow request threshold. Should be called
+ * before the response headers are written out.
+ *
+ * @param tracing The pointer to the request tracing settings.
+ * @param trace   The pointer to the trace of the request.
+ * @param msg     The request message traced.
+ */
+void finish_trace(const REQUEST_TRACING   *tracing,
+                        REQUEST_TRACE     *trace,
+                        SoupServerMessage *msg) {
+
+    guint64 total = get_time_ns() - trace->start;
+
+    gboolean slow = (tracing->slow_threshold > 0)
+                 && (total > tracing->slow_threshold);
+
+    if (!tracing->server_timing && !slow) { return; }
+
+    // Rendering timings right on the stack.
+    gchar timing[SERVER_TIMING_SIZE];
+    gint  timing_len = 0;
+
+    for (guint i = 0; i < TRACE_PHASES; i++) {
+        if (trace->phases[i] == 0) { continue; }
+
+        timing_len += g_snprintf(timing + timing_len,
+            SERVER_TIMING_SIZE - timing_len, SERVER_TIMING_FORMAT,
+            (timing_len > 0) ? SERVER_TIMING_SEP : EMPTY_STRING,
+            _trace_phases[i], (gdouble) trace->phases[i] / 1e6);
+    }
+
+    g_snprintf(timing + timing_len, SERVER_TIMING_SIZE - timing_len,
+        SERVER_TIMING_FORMAT, (timing_len > 0) ? SERVER_TIMING_SEP
+        : EMPTY_STRING, SERVER_TIMING_TOTAL, (gdouble) total / 1e6);
+
+    if (tracing->server_timing) {
+        soup_message_headers_replace(
+            soup_server_message_get_response_headers(msg),
+            HDR_SERVER_TIMING_N, timing);
+    }
+
+    if (slow) {
+        gchar *uri = g_uri_to_string(soup_server_message_get_uri(msg));
+        guint  status = soup_server_message_get_status(msg);
+
+        g_message(       MSG_SLOW_REQUEST, uri, status, timing);
+        syslog(LOG_INFO, MSG_SLOW_REQUEST, uri, status, timing);
+
+        g_free(uri);
+    }
+}
+
+/**
+ * Frees the request tracing settings structure.
+ *
+ * @param tracing The pointer to the request tracing settings.
+ */
+void free_tracing(REQUEST_TRACING *tracing) {
+    g_free(tracing);
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,328 @@
+/*
+ * src/bus-packed.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The compressed routes module of the daemon ---------------------------------
+
+#include "busd.h"
+
+// Helper function. Turns the difference between two consecutive bus stop
+// IDs into an unsigned number, small for small differences either way
+// (zigzag encoding: 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...).
+static guint32 _zigzag(const guint32 prev, const guint32 stop) {
+    gint32 delta = (gint32) (stop - prev);
+
+    return ((guint32) delta << 1) ^ (guint32) (delta >> 31);
+}
+
+// Helper function. Bit-packs the block of bus stops following the one
+// given into the buffer given, if any, each stop as the difference from
+// the previous one. Returns the size of the block: the byte holding
+// its width (in bits), followed by the differences.
+static gsize _pack_block(      guint32  prev,
+                         const guint32 *stops,
+                         const guint    count,
+                               guint8  *block) {
+
+    guint width = 0;
+
+    for (guint j = 0; j < count; j++) {
+        guint32 value = _zigzag((j > 0) ? stops[j - 1] : prev, stops[j]);
+
+        if (value > 0) { width = MAX(width, g_bit_storage(value)); }
+    }
+
+    gsize size = 1 + (((count * width) + 7) >> 3);
+
+    if (block == NULL) { return size; }
+
+    block[0] = width;
+
+    memset(block + 1, 0, size - 1);
+
+    for (guint j = 0, bit = 0; j < count; j++, bit += width) {
+        guint64 value = (guint64) _zigzag(prev, stops[j]) << (bit & 7);
+
+        for (guint8 *byte = block + 1 + (bit >> 3); value > 0; byte++) {
+            *byte |= value & 0xff;
+
+            value >>= 8;
+        }
+
+        prev = stops[j];
+    }
+
+    return size;
+}
+
+// Helper function. Walks through bus stops sequences of all routes,
+// measuring their compressed size, or compressing them into the buffer,
+// if it's given.
+static gsize _pack_routes(const ROUTES_STORE *routes,
+                                guint8       *packed,
+                                gsize        *packed_offsets) {
+
+    gsize size = 0;
+
+    for (guint i = 0; i < routes->routes_count; i++) {
+        if (packed != NULL) { packed_offsets[i] = size; }
+
+        size += pack_stops(routes->stops + routes->offsets[i],
+            routes->offsets[i + 1] - routes->offsets[i],
+            (packed != NULL) ? (packed + size) : NULL);
+    }
+
+    if (packed != NULL) { packed_offsets[routes->routes_count] = size; }
+
+    return size;
+}
+
+// Helper function. Decodes the difference at the given bit of the block.
+// Each difference is read from a 64-bit word of its own, so they all
+// get decoded independently: it's where the sequence may end,
+// hence the padding.
+static inline guint32 _get_delta(const guint8  *block,
+                                 const guint    bit,
+                                 const guint64  mask) {
+
+    guint64 word;
+
+    memcpy(&word, block + (bit >> 3), sizeof(guint64));
+
+    guint32 value = (GUINT64_FROM_LE(word) >> (bit & 7)) & mask;
+
+    return (value >> 1) ^ -(value & 1);
+}
+
+/**
+ * Compresses a bus stops sequence: the first bus stop ID is stored as is,
+ * then each next one as the zigzag-encoded difference from the previous
+ * one, bit-packed in blocks of <code>PACK_BLOCK_SIZE</code> differences.
+ * The buffer to decompress it from has to be padded
+ * by <code>sizeof(guint64)</code> bytes.
+ *
+ * @param stops  The pointer to an array of bus stop IDs.
+ * @param count  The number of bus stops in the sequence.
+ * @param packed The pointer to a buffer to compress the sequence into,
+ *               or <code>NULL</code>, to measure it only.
+ *
+ * @return The size (in bytes) of the compressed sequence.
+ */
+gsize pack_stops(const guint32 *stops, const guint count, guint8 *packed) {
+    if (count == 0) { return 0; }
+
+    // The first bus stop goes as is, differences from it go in blocks.
+    if (packed != NULL) {
+        guint32 first = GUINT32_TO_LE(stops[0]);
+
+        memcpy(packed, &first, sizeof(guint32));
+    }
+
+    gsize size = sizeof(guint32);
+
+    for (guint j = 1; j < count; j += PACK_BLOCK_SIZE) {
+        size += _pack_block(stops[j - 1], stops + j,
+            MIN(count - j, PACK_BLOCK_SIZE),
+            (packed != NULL) ? (packed + size) : NULL);
+    }
+
+    return size;
+}
+
+/**
+ * Starts decompressing a bus stops sequence, block by block,
+ * with <code>unpack_stops()</code>.
+ *
+ * @param cursor The pointer to the cursor to set up.
+ * @param packed The pointer to the compressed sequence.
+ * @param count  The number of bus stops in the sequence.
+ */
+void open_stops(      STOPS_CURSOR *cursor,
+                const guint8       *packed,
+                const guint         count) {
+
+    cursor->curr  = packed;
+    cursor->stop  = 0;
+    cursor->left  = count;
+    cursor->first = TRUE;
+}
+
+/**
+ * Decompresses the next block of a bus stops sequence.
+ *
+ * @param cursor The pointer to the cursor set up with
+ *               <code>open_stops()</code>.
+ * @param stops  The pointer to an array of <code>PACK_BLOCK_SIZE</code>
+ *               elements to put bus stop IDs into.
+ *
+ * @return The number of bus stops decompressed, 0 at the end
+ *         of the sequence.
+ */
+guint unpack_stops(STOPS_CURSOR *cursor, guint32 *stops) {
+    if (cursor->left == 0) { return 0; }
+
+    // The first bus stop comes alone, just as it is stored.
+    if (cursor->first) {
+        memcpy(&cursor->stop, cursor->curr, sizeof(guint32));
+
+        cursor->stop   = GUINT32_FROM_LE(cursor->stop);
+        cursor->curr  += sizeof(guint32);
+        cursor->first  = FALSE;
+        cursor->left--;
+
+        stops[0] = cursor->stop;
+
+        return 1;
+    }
+
+    guint   count = MIN(cursor->left, PACK_BLOCK_SIZE);
+    guint   width = *cursor->curr++;
+    guint64 mask  = (G_GUINT64_CONSTANT(1) << width) - 1;
+
+    for (guint j = 0, bit = 0; j < count; j++, bit += width) {
+        cursor->stop += _get_delta(cursor->curr, bit, mask);
+
+        stops[j] = cursor->stop;
+    }
+
+    cursor->curr += ((count * width) + 7) >> 3;
+    cursor->left -= count;
+
+    return count;
+}
+
+/**
+ * Compresses bus stops sequences of all routes: the first bus stop ID
+ * of each route is stored as is, then each next one as the zigzag-encoded
+ * difference from the previous one, bit-packed in blocks
+ * of <code>PACK_BLOCK_SIZE</code> differences, as wide as the widest
+ * difference in the block. Since routes mostly go through runs
+ * of consecutive bus stop IDs, most of them take a couple of bits
+ * instead of 32.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void pack_routes(ROUTES_STORE *routes) {
+    // Measuring the compressed sequences, to allocate them at once.
+    gsize packed_size = _pack_routes(routes, NULL, NULL);
+
+    routes->packed_size    = packed_size;
+    routes->packed         = g_new0(guint8, packed_size + sizeof(guint64));
+    routes->packed_offsets = g_new (gsize,  routes->routes_count + 1);
+
+    _pack_routes(routes, routes->packed, routes->packed_offsets);
+}
+
+/**
+ * Decompresses bus stops sequences of all routes back into an array.
+ *
+ * @param routes The pointer to the routes structure.
+ * @param stops  The pointer to an array of <code>stops_count</code>
+ *               elements to put bus stop IDs into.
+ */
+void unpack_routes(const ROUTES_STORE *routes, guint32 *stops) {
+    for (guint i = 0; i < routes->routes_count; i++) {
+        const guint8 *curr  = routes->packed + routes->packed_offsets[i];
+              guint32 *stop = stops + routes->offsets[i];
+              guint   count = routes->offsets[i + 1] - routes->offsets[i];
+
+        if (count == 0) { continue; }
+
+        memcpy(stop, curr, sizeof(guint32));
+
+        stop[0] = GUINT32_FROM_LE(stop[0]);
+        curr   += sizeof(guint32);
+
+        for (guint first = 1; first < count; first += PACK_BLOCK_SIZE) {
+            guint   block_count = MIN(count - first, PACK_BLOCK_SIZE);
+            guint   width       = *curr++;
+            guint64 mask        = (G_GUINT64_CONSTANT(1) << width) - 1;
+
+            for (guint j = first, bit = 0; j < (first + block_count);
+                j++, bit += width) {
+
+                stop[j] = stop[j - 1] + _get_delta(curr, bit, mask);
+            }
+
+            curr += ((block_count * width) + 7) >> 3;
+        }
+    }
+}
+
+/**
+ * Identifies whether the route goes from one bus stop point to another,
+ * scanning its compressed bus stops sequence and decoding bus stops
+ * on the fly, without decompressing the sequence anywhere.
+ *
+ * @param routes   The pointer to the routes structure.
+ * @param route    The index of the route.
+ * @param from     The starting bus stop point.
+ * @param to       The ending   bus stop point.
+ * @param position The pointer to a variable to put the position
+ *                 of the starting point on the route into,
+ *                 or <code>STOP_NOT_FOUND</code>, if it's not there.
+ *
+ * @return <code>TRUE</code> if the ending point follows the starting one
+ *         on the route, <code>FALSE</code> otherwise.
+ */
+gboolean find_packed_route(const ROUTES_STORE *routes,
+                           const guint         route,
+                           const guint32       from,
+                           const guint32       to,
+                                 guint        *position) {
+
+    const guint8 *curr  = routes->packed + routes->packed_offsets[route];
+          guint   count = routes->offsets[route + 1] - routes->offsets[route];
+
+    *position = STOP_NOT_FOUND;
+
+    if (count == 0) { return FALSE; }
+
+    guint32 stop;
+
+    memcpy(&stop, curr, sizeof(guint32));
+
+    stop  = GUINT32_FROM_LE(stop);
+    curr += sizeof(guint32);
+
+    // Searching for the starting bus stop point first, and then
+    // for the ending one, beginning right after the starting one.
+    guint32 wanted = from;
+
+    if (stop == from) {
+        *position = 0;
+        wanted    = to;
+    }
+
+    for (guint first = 1; first < count; first += PACK_BLOCK_SIZE) {
+        guint   block_count = MIN(count - first, PACK_BLOCK_SIZE);
+        guint   width       = *curr++;
+        guint64 mask        = (G_GUINT64_CONSTANT(1) << width) - 1;
+
+        for (guint j = 0, bit = 0; j < block_count; j++, bit += width) {
+            stop += _get_delta(curr, bit, mask);
+
+            if (stop == wanted) {
+                if (*position != STOP_NOT_FOUND) { return TRUE; }
+
+                *position = first + j;
+                wanted    = to;
+            }
+        }
+
+        curr += ((block_count * width) + 7) >> 3;
+    }
+
+    return FALSE;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,300 @@
+/*
+ * src/bus-reachable.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The one-to-many reachability module of the daemon --------------------------
+
+#include "busd.h"
+
+/**
+ * The number of bus stops, below which a set of them is sorted in place,
+ * rather than a byte at a time.
+ */
+#define RADIX_SORT_MIN 64
+
+// Helper function. Sorts bus stops index entries: short sets in place
+// (insertion sort), longer ones a byte at a time (LSD radix sort)
+// through the buffer given, for as many bytes as the widest entry takes.
+// Sets of entries are sorted by the hundred thousand at startup,
+// where qsort() spends most of the time calling the comparison function.
+static void _sort_stop_indices(      guint32 *stops,
+                                     guint32 *buff,
+                               const guint    count,
+                               const guint    width) {
+
+    if (count < RADIX_SORT_MIN) {
+        for (guint i = 1; i < count; i++) {
+            guint32 stop = stops[i];
+            guint   j    = i;
+
+            for (; (j > 0) && (stops[j - 1] > stop); j--) {
+                stops[j] = stops[j - 1];
+            }
+
+            stops[j] = stop;
+        }
+
+        return;
+    }
+
+    guint32 *from = stops;
+    guint32 *to   = buff;
+
+    for (guint shift = 0; shift < width; shift += 8) {
+        guint32 counts[256] = { 0 };
+
+        for (guint i = 0; i < count; i++) {
+            counts[(from[i] >> shift) & 0xff]++;
+        }
+
+        for (guint k = 0, sum = 0; k < 256; k++) {
+            guint32 bucket = counts[k];
+
+            counts[k] = sum;
+
+            sum += bucket;
+        }
+
+        for (guint i = 0; i < count; i++) {
+            to[counts[(from[i] >> shift) & 0xff]++] = from[i];
+        }
+
+        guint32 *sorted = to;
+
+        to   = from;
+        from = sorted;
+    }
+
+    if (from != stops) { memcpy(stops, from, count * sizeof(guint32)); }
+}
+
+// Helper function. Collects the bus stops following the given one
+// on any route, each one once, sorted by their bus stops index entries.
+// The marks keep the bus stop each bus stop has been collected for last,
+// the buffer is there to sort bus stops through (both are as long
+// as the bus stops index). Returns the number of bus stops collected.
+static guint _collect_reachable(const ROUTES_STORE *routes,
+                                const guint32       stop_idx,
+                                      guint32      *marks,
+                                      guint32      *buff,
+                                      guint32      *reachable) {
+
+    const STOP_POSTING *postings = routes->postings;
+
+    guint32 first = routes->postings_offsets[stop_idx    ];
+    guint32 last  = routes->postings_offsets[stop_idx + 1];
+
+    guint count = 0;
+
+    for (guint32 k = first; k < last; k++) {
+        guint32 route = postings[k].route;
+
+        // The stops following the bus stop on a route it is passed again
+        // by have all been collected already.
+        if ((k > first) && (postings[k - 1].route == route)) { continue; }
+
+        guint32 end = routes->offsets[route + 1];
+
+        for (guint32 i = routes->offsets[route] + postings[k].position + 1;
+            i < end; i++) {
+
+            guint32 next = routes->stop_indices[i];
+
+            if (marks[next] == stop_idx) { continue; }
+
+            marks[next]        = stop_idx;
+            reachable[count++] = next;
+        }
+    }
+
+    _sort_stop_indices(reachable, buff, count,
+        g_bit_storage(routes->stop_ids_count));
+
+    return count;
+}
+
+// Helper function. Drops whatever has been built only for the sets
+// to be collected through: the bus stops index entries of bus stops,
+// and the bus stops index itself, if the direct-route engine goes without
+// it (distinct bus stop IDs are kept along with the sets, to look them up).
+static void _unmap_stops(      ROUTES_STORE *routes,
+                         const gboolean      was_indexed,
+                         const gboolean      was_mapped,
+                         const gboolean      is_reached) {
+
+    if (!was_mapped) { g_clear_pointer(&routes->stop_indices, g_free); }
+
+    if (was_indexed) { return; }
+
+    g_clear_pointer(&routes->postings,         g_free);
+    g_clear_pointer(&routes->postings_offsets, g_free);
+
+    if (!is_reached) {
+        g_clear_pointer(&routes->stop_ids, g_free);
+
+        routes->stop_ids_count = 0;
+    }
+}
+
+/**
+ * Precomputes the sets of bus stops reachable directly from each bus stop:
+ * all the bus stops following it on any route, sorted and compressed
+ * the same way bus stops sequences of routes are, for the one-to-many
+ * reachability requests to be served without going through routes.
+ * <br />
+ * The sets are collected through the bus stops index, so all bus stops
+ * of routes are mapped to their entries in it beforehand (building
+ * the index too, if there is none yet). Whatever the sets don't need
+ * afterwards is dropped, unless the engine or transfers keep it:
+ * if the engine goes without the index, only distinct bus stop IDs stay,
+ * and count against the limit. If the limit is zero, reachable bus stops
+ * are turned off, and nothing gets built.
+ *
+ * @param routes The pointer to the routes structure.
+ * @param limit  The maximum amount of memory (in bytes) the sets
+ *               are allowed to take.
+ *
+ * @return <code>TRUE</code> if the sets are built,
+ *         <code>FALSE</code> if they are turned off or would exceed
+ *         the memory limit.
+ */
+gboolean reach_stops(ROUTES_STORE *routes, const guint64 limit) {
+    if (limit == 0) { return FALSE; }
+
+    gboolean was_indexed = (routes->postings     != NULL);
+    gboolean was_mapped  = (routes->stop_indices != NULL);
+
+    map_stops(routes);
+
+    guint stop_ids_count = routes->stop_ids_count;
+
+    guint32 *marks     = g_new(guint32, stop_ids_count);
+    guint32 *buff      = g_new(guint32, stop_ids_count);
+    guint32 *reachable = g_new(guint32, stop_ids_count);
+    guint32 *counts    = g_new(guint32, stop_ids_count);
+    gsize   *offsets   = g_new(gsize,   stop_ids_count + 1);
+
+    memset(marks, 0xff, stop_ids_count * sizeof(guint32));
+
+    // The sets go along with their offsets and sizes, and the padding
+    // needed to decompress them (and the bus stop IDs to look them up by,
+    // if those are kept for the sets only).
+    guint64 size = ((guint64) stop_ids_count * (sizeof(gsize)
+                 + sizeof(guint32) + (was_indexed ? 0 : sizeof(guint32))))
+                 + sizeof(gsize) + sizeof(guint64);
+
+    gsize   packed_size     = 0;
+    gsize   packed_capacity = stop_ids_count + sizeof(guint64);
+    guint8 *packed          = g_new(guint8, packed_capacity);
+
+    guint64 reachable_count = 0;
+
+    for (guint j = 0; j < stop_ids_count; j++) {
+        guint count = _collect_reachable(routes, j, marks, buff, reachable);
+
+        // Making room for the set compressed at its worst (all the bus stops
+        // as wide as they can be), to compress it right away.
+        gsize room = sizeof(guint32) + ((((gsize) count + PACK_BLOCK_SIZE - 1)
+                   / PACK_BLOCK_SIZE) * (1 + (PACK_BLOCK_SIZE
+                   * sizeof(guint32)))) + sizeof(guint64);
+
+        if ((packed_size + room) > packed_capacity) {
+            while ((packed_size + room) > packed_capacity) {
+                packed_capacity <<= 1;
+            }
+
+            packed = g_renew(guint8, packed, packed_capacity);
+        }
+
+        gsize bytes = pack_stops(reachable, count, packed + packed_size);
+
+        if ((size + packed_size + bytes) > limit) {
+            g_warning(ERR_REACHABLE_EXCEEDS_LIMIT, limit);
+
+            g_free(packed);
+            g_free(offsets);
+            g_free(counts);
+            g_free(reachable);
+            g_free(buff);
+            g_free(marks);
+
+            _unmap_stops(routes, was_indexed, was_mapped, FALSE);
+
+            return FALSE;
+        }
+
+        offsets[j] = packed_size;
+        counts [j] = count;
+
+        packed_size     += bytes;
+        reachable_count += count;
+    }
+
+    offsets[stop_ids_count] = packed_size;
+
+    g_free(reachable);
+    g_free(buff);
+    g_free(marks);
+
+    _unmap_stops(routes, was_indexed, was_mapped, TRUE);
+
+    routes->reachable         = g_renew(guint8, packed, packed_size
+                                                      + sizeof(guint64));
+    routes->reachable_offsets = offsets;
+    routes->reachable_counts  = counts;
+
+    // Zeroing the padding, for the sake of tidiness.
+    memset(routes->reachable + packed_size, 0, sizeof(guint64));
+
+    g_message(       MSG_STOPS_REACHED, stop_ids_count, reachable_count,
+        packed_size);
+    syslog(LOG_INFO, MSG_STOPS_REACHED, stop_ids_count, reachable_count,
+        packed_size);
+
+    return TRUE;
+}
+
+/**
+ * Finds the bus stops reachable directly from a bus stop: all the bus stops
+ * following it on any route, taking them from the precomputed sets.
+ *
+ * @param routes  The pointer to the routes structure, prepared
+ *                with <code>reach_stops()</code> beforehand.
+ * @param stop_id The bus stop ID.
+ * @param cursor  The pointer to a cursor to set up, to decompress
+ *                the bus stops index entries of reachable bus stops with,
+ *                in ascending order (hence bus stop IDs as well).
+ *
+ * @return <code>TRUE</code> if the cursor is set up,
+ *         <code>FALSE</code> if there are no sets, i.e. reachable bus stops
+ *         are turned off.
+ */
+gboolean find_reachable(const ROUTES_STORE *routes,
+                        const guint32       stop_id,
+                              STOPS_CURSOR *cursor) {
+
+    if (routes->reachable == NULL) { return FALSE; }
+
+    guint32 stop_idx = find_stop(routes, stop_id);
+
+    if (stop_idx == STOP_NOT_FOUND) {
+        open_stops(cursor, NULL, 0);
+    } else {
+        open_stops(cursor,
+            routes->reachable + routes->reachable_offsets[stop_idx],
+            routes->reachable_counts[stop_idx]);
+    }
+
+    return TRUE;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,1573 @@
+/*
+ * src/bus-routes.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The routes data store module of the daemon ---------------------------------
+
+#include "busd.h"
+
+// Helper function. Compares two bus stop IDs, for sorting.
+static int _cmp_stop_ids(const void *a, const void *b) {
+    guint32 a_ = *(const guint32 *) a;
+    guint32 b_ = *(const guint32 *) b;
+
+    return (a_ > b_) - (a_ < b_);
+}
+
+// Helper function. Compares two keys of the table of bus stop pairs.
+static int _cmp_table_keys(const void *a, const void *b) {
+    guint64 a_ = *(const guint64 *) a;
+    guint64 b_ = *(const guint64 *) b;
+
+    return (a_ > b_) - (a_ < b_);
+}
+
+// Helper function. Scans the current line of the routes data store
+// in place for the next bus stop (or route) ID: a run of digits, separated
+// from the others by whitespace. Returns 0 when the line has no more IDs,
+// or -1 when the next one is not an integer number, or is out
+// of the allowed range.
+static gint64 _next_id(const gchar **curr, const gchar *eol) {
+    const gchar *curr_ = *curr;
+
+    while ((curr_ < eol) && g_ascii_isspace(*curr_)) { curr_++; }
+
+    if (curr_ == eol) {
+        *curr = curr_;
+
+        return 0;
+    }
+
+    guint64 id = 0;
+
+    while ((curr_ < eol) && g_ascii_isdigit(*curr_)) {
+        if (id <= G_MAXINT32) { id = (id * 10) + (*curr_ - '0'); }
+
+        curr_++;
+    }
+
+    *curr = curr_;
+
+    // Signs, fractions, and any other characters stuck to the digits
+    // make the whole token invalid, rather than a separator.
+    if ((curr_ < eol) && !g_ascii_isspace(*curr_)) { return -1; }
+
+    return ((id >= 1) && (id <= G_MAXINT32)) ? (gint64) id : -1;
+}
+
+// Helper structure to hold a chunk of the routes data store, made up
+// of whole lines, along with the place its routes go to in the arrays.
+typedef struct {
+    const gchar        *buff;
+          gsize         size;
+          ROUTES_STORE *routes;
+          guint         routes_base;  // The index of its first route.
+          guint32       stops_base;   // The index of its first bus stop.
+          guint         routes_count;
+          guint32       stops_count;
+          guint         skipped_count; // Lines with invalid IDs.
+} _PARSE_CHUNK;
+
+// Helper structure to hold a slice of bus stop IDs, sorted by a thread.
+typedef struct {
+    guint32 *stop_ids;
+    guint    count;    // The number of IDs, then the one of distinct IDs.
+} _STOP_SLICE;
+
+// Helper structure to hold a range of routes, indexed by a thread.
+typedef struct {
+          ROUTES_STORE *routes;
+    const guint32      *stops;    // Bus stop IDs (maybe the same as below).
+          guint32      *stop_idx;
+          guint32      *counts;   // Postings per bus stop, then cursors.
+          guint         first;
+          guint         last;
+} _INDEX_RANGE;
+
+// Helper function. Gets the number of threads to share the work between,
+// so that each of them gets at least the given amount of it.
+static guint _get_load_threads(const guint64 work, const guint64 min_work) {
+    guint64 threads = MIN(work / min_work, MAX_LOAD_THREADS);
+
+    return CLAMP(threads, 1, g_get_num_processors());
+}
+
+// Helper function. Runs the function on each of the tasks given,
+// all of them in parallel, the first one in the calling thread.
+static void _run_tasks(const GThreadFunc  func,
+                             gpointer     tasks,
+                       const gsize        task_size,
+                       const guint        count) {
+
+    GThread **threads = g_new(GThread *, count);
+
+    for (guint t = 1; t < count; t++) {
+        threads[t] = g_thread_new(NULL, func, (gchar *) tasks
+                                            + (t * task_size));
+    }
+
+    func(tasks);
+
+    for (guint t = 1; t < count; t++) { g_thread_join(threads[t]); }
+
+    g_free(threads);
+}
+
+// Helper function. Tokenizes the chunk of the routes data store in place,
+// line by line. When the routes structure has no arrays allocated yet,
+// only counts routes and bus stops, so that the arrays can then be
+// allocated at their exact final sizes.
+static gpointer _tokenize_routes(_PARSE_CHUNK *chunk) {
+    ROUTES_STORE *routes = chunk->routes;
+
+    gboolean is_counting = (routes->offsets == NULL);
+
+    guint   routes_count = chunk->routes_base;
+    guint32 stops_count  = chunk->stops_base;
+
+    guint32 stops_end     = chunk->stops_base + chunk->stops_count;
+    guint   skipped_count = 0;
+
+    const gchar *curr = chunk->buff;
+    const gchar *end  = chunk->buff + chunk->size;
+
+    while (curr < end) {
+        const gchar *eol = memchr(curr, NEW_LINE[0], end - curr);
+
+        if (eol == NULL) { eol = end; }
+
+        // The first number in a route is always its own ID.
+        gint64 route_id = _next_id(&curr, eol);
+
+        if (route_id > 0) {
+            guint32 line_stops = stops_count;
+
+            gint64 id;
+
+            while ((id = _next_id(&curr, eol)) > 0) {
+                if ((!is_counting) && (stops_count < stops_end)) {
+                    routes->stops[stops_count] = id;
+                }
+
+                stops_count++;
+            }
+
+            // Skipping the whole line if any of its IDs is invalid, taking
+            // back its bus stops (already filled in ones are overwritten
+            // by the next line). Both passes skip the same lines, so
+            // the arrays still come out at their exact sizes, and no bus
+            // stop is put past the place of the chunk.
+            if (id < 0) {
+                stops_count = line_stops;
+
+                skipped_count++;
+            } else {
+                if (!is_counting) {
+                    routes->offsets  [routes_count] = line_stops;
+                    routes->route_ids[routes_count] = route_id;
+                }
+
+                routes_count++;
+            }
+        } else if (route_id < 0) {
+            skipped_count++;
+        }
+
+        curr = eol + 1;
+    }
+
+    chunk->routes_count  = routes_count - chunk->routes_base;
+    chunk->stops_count   = stops_count  - chunk->stops_base;
+    chunk->skipped_count = skipped_count;
+
+    return NULL;
+}
+
+/**
+ * Parses the contents of the routes data store into a compact in-memory
+ * representation: each route is turned into a sequence of integer bus stop
+ * IDs, and all the sequences are laid out contiguously in a single array
+ * (CSR-like layout: the offsets array + the stops array).
+ * <br />
+ * IDs are tokenized in place, without any intermediate string copies.
+ * A quick counting pass over the contents goes first, so that the arrays
+ * get allocated once at their exact sizes and the peak memory footprint
+ * stays at the size of the resulting structure.
+ * <br />
+ * Large data stores are split into chunks of whole lines, which are
+ * parsed on all CPU cores: each chunk is counted on its own, and then
+ * filled in right at its place in the arrays, so that the result is
+ * exactly the same as the one of a single thread.
+ *
+ * @param routes_buff The pointer to a buffer holding the routes data store
+ *                    contents (not necessarily NUL-terminated).
+ * @param data_size   The size of the buffer in bytes.
+ *
+ * @return The pointer to a newly allocated routes structure.
+ *         Should be freed with <code>free_routes()</code>.
+ */
+ROUTES_STORE *parse_routes(const gchar *routes_buff, const gsize data_size) {
+    ROUTES_STORE *routes = g_new0(ROUTES_STORE, 1);
+
+    routes->ref_count = 1;
+
+    guint threads = _get_load_threads(data_size, PARSE_CHUNK_SIZE);
+
+    _PARSE_CHUNK *chunks = g_new0(_PARSE_CHUNK, threads);
+
+    // Cutting the contents into chunks at line boundaries.
+    gsize chunk_start = 0;
+
+    for (guint t = 0; t < threads; t++) {
+        gsize chunk_end = data_size;
+
+        if (t < (threads - 1)) {
+            chunk_end = MAX(chunk_start, data_size / threads * (t + 1));
+
+            const gchar *eol = memchr(routes_buff + chunk_end, NEW_LINE[0],
+                data_size - chunk_end);
+
+            chunk_end = (eol != NULL) ? (eol - routes_buff + 1) : data_size;
+        }
+
+        chunks[t].buff   = routes_buff + chunk_start;
+        chunks[t].size   = chunk_end   - chunk_start;
+        chunks[t].routes = routes;
+
+        chunk_start = chunk_end;
+    }
+
+    // Counting routes and bus stops.
+    _run_tasks((GThreadFunc) _tokenize_routes, chunks, sizeof(_PARSE_CHUNK),
+        threads);
+
+    guint skipped_count = 0;
+
+    for (guint t = 0; t < threads; t++) {
+        chunks[t].routes_base = routes->routes_count;
+        chunks[t].stops_base  = routes->stops_count;
+
+        routes->routes_count += chunks[t].routes_count;
+        routes->stops_count  += chunks[t].stops_count;
+
+        skipped_count        += chunks[t].skipped_count;
+    }
+
+    if (skipped_count > 0) {
+        g_warning(ERR_ROUTES_LINES_SKIPPED, skipped_count);
+    }
+
+    routes->route_ids = g_new(guint32, routes->routes_count    );
+    routes->offsets   = g_new(guint32, routes->routes_count + 1);
+    routes->stops     = g_new(guint32, routes->stops_count     );
+
+    // Filling in the arrays.
+    _run_tasks((GThreadFunc) _tokenize_routes, chunks, sizeof(_PARSE_CHUNK),
+        threads);
+
+    routes->offsets[routes->routes_count] = routes->stops_count;
+
+    g_free(chunks);
+
+    return routes;
+}
+
+// Helper function. Sorts the slice of bus stop IDs in place,
+// and removes duplicates from it.
+static gpointer _sort_stop_ids(_STOP_SLICE *slice) {
+    guint32 *stop_ids = slice->stop_ids;
+
+    qsort(stop_ids, slice->count, sizeof(guint32), _cmp_stop_ids);
+
+    guint count = 0;
+
+    for (guint i = 0; i < slice->count; i++) {
+        if ((count == 0) || (stop_ids[count - 1] != stop_ids[i])) {
+            stop_ids[count++] = stop_ids[i];
+        }
+    }
+
+    slice->count = count;
+
+    return NULL;
+}
+
+// Helper function. Finds the first route starting at or after
+// the given bus stop of all routes.
+static guint _find_route_at(const ROUTES_STORE *routes, const guint32 stop) {
+    guint lo = 0, hi = routes->routes_count;
+
+    while (lo < hi) {
+        guint mid = lo + ((hi - lo) >> 1);
+
+        if (routes->offsets[mid] < stop) { lo = mid + 1; }
+        else                             { hi = mid;     }
+    }
+
+    return lo;
+}
+
+// Helper function. Maps bus stops of the range of routes to their entries
+// in the bus stops index, counting postings per bus stop on the way.
+// Bus stop IDs may be replaced with their entries in place.
+static gpointer _count_postings(_INDEX_RANGE *range) {
+    const ROUTES_STORE *routes = range->routes;
+
+    guint32 end = routes->offsets[range->last];
+
+    for (guint32 k = routes->offsets[range->first]; k < end; k++) {
+        range->stop_idx[k] = find_stop(routes, range->stops[k]);
+
+        range->counts[range->stop_idx[k]]++;
+    }
+
+    return NULL;
+}
+
+// Helper function. Fills in postings of the range of routes, route by route,
+// at the cursors the range has got in the postings of each bus stop.
+static gpointer _fill_postings(_INDEX_RANGE *range) {
+    ROUTES_STORE *routes = range->routes;
+
+    for (guint i = range->first; i < range->last; i++) {
+        guint32 start = routes->offsets[i];
+
+        for (guint32 k = start; k < routes->offsets[i + 1]; k++) {
+            STOP_POSTING *posting
+                = &routes->postings[range->counts[range->stop_idx[k]]++];
+
+            posting->route    = i;
+            posting->position = k - start;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Builds the bus stops index for the routes structure: maps each distinct
+ * bus stop ID to the list of (route, position) pairs where the stop occurs.
+ * Postings of each stop come out sorted by route (and then by position),
+ * since the routes are traversed in their natural order.
+ * <br />
+ * Large routes structures are indexed on all CPU cores: slices of bus
+ * stop IDs are sorted on their own and then merged, and postings
+ * are counting-sorted by ranges of routes, each range getting its own
+ * counts, and hence its own cursors in the postings of each bus stop.
+ * The index comes out exactly the same as the one built by a single thread.
+ * <br />
+ * Compressed routes get decompressed for that temporarily.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void index_routes(ROUTES_STORE *routes) {
+    guint stops_count = routes->stops_count;
+    guint threads     = _get_load_threads(stops_count, INDEX_SLICE_SIZE);
+
+    guint32 *stop_idx = g_new(guint32, stops_count);
+
+    // Compressed routes are decompressed right where their bus stops
+    // are going to be mapped to index entries.
+    const guint32 *stops = routes->stops;
+
+    if (stops == NULL) {
+        unpack_routes(routes, stop_idx);
+
+        stops = stop_idx;
+    }
+
+    // Collecting distinct bus stop IDs.
+    guint32 *stop_ids = g_new(guint32, stops_count);
+
+    memcpy(stop_ids, stops, stops_count * sizeof(guint32));
+
+    _STOP_SLICE *slices = g_new(_STOP_SLICE, threads);
+
+    for (guint t = 0; t < threads; t++) {
+        guint first = stops_count / threads *  t;
+        guint last  = (t < (threads - 1)) ? (stops_count / threads * (t + 1))
+                                          :  stops_count;
+
+        slices[t].stop_ids = stop_ids + first;
+        slices[t].count    = last     - first;
+    }
+
+    _run_tasks((GThreadFunc) _sort_stop_ids, slices, sizeof(_STOP_SLICE),
+        threads);
+
+    guint stop_ids_count = slices[0].count;
+
+    if (threads > 1) {
+        guint32 *merged = g_new(guint32, stops_count);
+
+        // Merging slices, taking the smallest ID of their heads at a time
+        // (bus stop IDs never exceed G_MAXINT32).
+        for (stop_ids_count = 0; TRUE; stop_ids_count++) {
+            guint32 stop_id = G_MAXUINT32;
+
+            for (guint t = 0; t < threads; t++) {
+                if ((slices[t].count > 0)
+                    && (slices[t].stop_ids[0] < stop_id)) {
+
+                    stop_id = slices[t].stop_ids[0];
+                }
+            }
+
+            if (stop_id == G_MAXUINT32) { break; }
+
+            for (guint t = 0; t < threads; t++) {
+                if ((slices[t].count > 0)
+                    && (slices[t].stop_ids[0] == stop_id)) {
+
+                    slices[t].stop_ids++;
+                    slices[t].count--;
+                }
+            }
+
+            merged[stop_ids_count] = stop_id;
+        }
+
+        g_free(stop_ids);
+
+        stop_ids = merged;
+    }
+
+    g_free(slices);
+
+    routes->stop_ids_count = stop_ids_count;
+    routes->stop_ids       = g_renew(guint32, stop_ids, stop_ids_count);
+
+    // Counting postings per bus stop (a counting sort, in fact).
+    // Each range of routes gets its own counts, so there are no more ranges
+    // than it takes for the counts not to outgrow the bus stops counted.
+    threads = MIN(threads, MAX(stops_count / MAX(stop_ids_count, 1), 1));
+
+    guint32      *counts = g_new0(guint32, (gsize) threads * stop_ids_count);
+    _INDEX_RANGE *ranges = g_new (_INDEX_RANGE, threads);
+
+    for (guint t = 0; t < threads; t++) {
+        ranges[t].routes   = routes;
+        ranges[t].stops    = stops;
+        ranges[t].stop_idx = stop_idx;
+        ranges[t].counts   = counts + ((gsize) t * stop_ids_count);
+        ranges[t].first    = _find_route_at(routes, stops_count / threads * t);
+        ranges[t].last     = (t < (threads - 1))
+            ? _find_route_at(routes, stops_count / threads * (t + 1))
+            : routes->routes_count;
+    }
+
+    _run_tasks((GThreadFunc) _count_postings, ranges, sizeof(_INDEX_RANGE),
+        threads);
+
+    // Turning counts into cursors, range after range for each bus stop.
+    guint32 *postings_offsets = g_new(guint32, stop_ids_count + 1);
+    guint32  postings_count   = 0;
+
+    for (guint j = 0; j < stop_ids_count; j++) {
+        postings_offsets[j] = postings_count;
+
+        for (guint t = 0; t < threads; t++) {
+            guint32 count = ranges[t].counts[j];
+
+            ranges[t].counts[j] = postings_count;
+
+            postings_count += count;
+        }
+    }
+
+    postings_offsets[stop_ids_count] = postings_count;
+
+    routes->postings_offsets = postings_offsets;
+    routes->postings         = g_new(STOP_POSTING, stops_count);
+
+    // Filling in postings.
+    _run_tasks((GThreadFunc) _fill_postings, ranges, sizeof(_INDEX_RANGE),
+        threads);
+
+    g_free(ranges);
+    g_free(counts);
+
+    // Keeping the bus stops index entry of each bus stop of all routes,
+    // as pruning routes and the table of bus stop pairs need them too.
+    g_free(routes->stop_indices);
+
+    routes->stop_indices = stop_idx;
+}
+
+// Helper function. Hashes the bus stops sequence of the route.
+static guint32 _hash_route(const ROUTES_STORE *routes, const guint route) {
+    guint32 hash = 2166136261U; // FNV-1a.
+
+    for (guint32 k = routes->offsets[route]; k < routes->offsets[route + 1];
+        k++) {
+
+        hash = (hash ^ routes->stops[k]) * 16777619U;
+    }
+
+    return hash;
+}
+
+// Helper function. Identifies whether two routes have the same bus stops
+// sequence.
+static gboolean _is_same_route(const ROUTES_STORE *routes,
+                               const guint         route,
+                               const guint         other) {
+
+    guint32 count       = routes->offsets[route + 1] - routes->offsets[route];
+    guint32 other_count = routes->offsets[other + 1] - routes->offsets[other];
+
+    return (count == other_count)
+        && (memcmp(routes->stops + routes->offsets[route],
+                   routes->stops + routes->offsets[other],
+                   count * sizeof(guint32)) == 0);
+}
+
+// Helper function. Identifies whether the bus stops sequence of the route
+// is an ordered (not necessarily contiguous) subsequence of the one
+// of another route.
+static gboolean _is_subsequence(const ROUTES_STORE *routes,
+                                const guint         route,
+                                const guint         other) {
+
+    const guint32 *stop       = routes->stops + routes->offsets[route    ];
+    const guint32 *end        = routes->stops + routes->offsets[route + 1];
+    const guint32 *other_stop = routes->stops + routes->offsets[other    ];
+    const guint32 *other_end  = routes->stops + routes->offsets[other + 1];
+
+    for (; (stop < end) && (other_stop < other_end); other_stop++) {
+        if (*other_stop == *stop) { stop++; }
+    }
+
+    return (stop == end);
+}
+
+// Helper function. Gets the number of postings of the bus stops index
+// entry.
+static guint32 _get_postings_count(const ROUTES_STORE *routes,
+                                   const guint32       stop_idx) {
+
+    return routes->postings_offsets[stop_idx + 1]
+         - routes->postings_offsets[stop_idx    ];
+}
+
+// Helper function. Identifies whether the route is dominated by a longer
+// one: if its bus stops sequence is a subsequence of the one of the other
+// route, any two of its bus stops are directly connected by the other route
+// as well. Only routes going through both of its two least frequent
+// bus stops (looked up in the bus stops index) are worth checking.
+static gboolean _is_dominated(const ROUTES_STORE *routes, const guint route) {
+    guint32 first = routes->offsets[route    ];
+    guint32 end   = routes->offsets[route + 1];
+
+    // Any route goes through all the bus stops of a route with no stops.
+    if (first == end) { return (routes->stops_count > 0); }
+
+    guint32 rarest = STOP_NOT_FOUND;
+    guint32 second = STOP_NOT_FOUND;
+
+    for (guint32 k = first; k < end; k++) {
+        guint32 stop_idx = routes->stop_indices[k];
+
+        if ((stop_idx == rarest) || (stop_idx == second)) { continue; }
+
+        if ((rarest == STOP_NOT_FOUND)
+            || (_get_postings_count(routes, stop_idx)
+              < _get_postings_count(routes, rarest))) {
+
+            second = rarest;
+            rarest = stop_idx;
+        } else if ((second == STOP_NOT_FOUND)
+            || (_get_postings_count(routes, stop_idx)
+              < _get_postings_count(routes, second))) {
+
+            second = stop_idx;
+        }
+    }
+
+    // The route may go through a single bus stop (maybe a few times).
+    if (second == STOP_NOT_FOUND) { second = rarest; }
+
+    const STOP_POSTING *postings = routes->postings;
+
+    const STOP_POSTING *rarest_     = postings
+                                    + routes->postings_offsets[rarest    ];
+    const STOP_POSTING *rarest_end  = postings
+                                    + routes->postings_offsets[rarest + 1];
+    const STOP_POSTING *second_     = postings
+                                    + routes->postings_offsets[second    ];
+    const STOP_POSTING *second_end  = postings
+                                    + routes->postings_offsets[second + 1];
+
+    // Merging postings of both bus stops, which are sorted by route.
+    while ((rarest_ < rarest_end) && (second_ < second_end)) {
+        if      (rarest_->route < second_->route) { rarest_++; }
+        else if (rarest_->route > second_->route) { second_++; }
+        else {
+            guint other = rarest_->route;
+
+            if (((routes->offsets[other + 1] - routes->offsets[other])
+                > (end - first)) && _is_subsequence(routes, route, other)) {
+
+                return TRUE;
+            }
+
+            while ((rarest_ < rarest_end) && (rarest_->route == other)) {
+                rarest_++;
+            }
+
+            while ((second_ < second_end) && (second_->route == other)) {
+                second_++;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Removes routes that can never change a direct-route answer from
+ * the routes structure: exact duplicates of other routes (found by hashing
+ * bus stops sequences; the first of them is kept), and routes dominated
+ * by longer ones, i.e. whose bus stops sequences are ordered subsequences
+ * of the ones of other routes. The rest of the routes keep their order.
+ * Has to be called before anything gets built upon the routes structure,
+ * since the bus stops index built here is dropped afterwards.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void prune_routes(ROUTES_STORE *routes) {
+    guint routes_count = routes->routes_count;
+
+    gboolean *is_pruned  = g_new0(gboolean, routes_count);
+    guint     duplicates = 0;
+    guint     dominated  = 0;
+
+    // Finding duplicates among routes with the same hash: sorting
+    // (hash << 32) | route keys makes the first route the one kept.
+    guint64 *keys = g_new(guint64, routes_count);
+
+    for (guint i = 0; i < routes_count; i++) {
+        keys[i] = ((guint64) _hash_route(routes, i) << 32) | i;
+    }
+
+    qsort(keys, routes_count, sizeof(guint64), _cmp_table_keys);
+
+    for (guint k = 1; k < routes_count; k++) {
+        guint route = keys[k] & G_MAXUINT32;
+
+        for (guint l = k; (l-- > 0) && ((keys[l] >> 32) == (keys[k] >> 32));) {
+            guint other = keys[l] & G_MAXUINT32;
+
+            if (!is_pruned[other] && _is_same_route(routes, route, other)) {
+                is_pruned[route] = TRUE;
+                duplicates++;
+
+                break;
+            }
+        }
+    }
+
+    g_free(keys);
+
+    // Finding dominated routes. A route dominated by a route pruned
+    // as well is dominated by the one kept in place of the latter.
+    index_routes(routes);
+
+    for (guint i = 0; i < routes_count; i++) {
+        if (!is_pruned[i] && _is_dominated(routes, i)) {
+            is_pruned[i] = TRUE;
+            dominated++;
+        }
+    }
+
+    // Dropping the bus stops index: it's built anew, if needed,
+    // upon the routes left.
+    g_clear_pointer(&routes->stop_indices,     g_free);
+    g_clear_pointer(&routes->postings,         g_free);
+    g_clear_pointer(&routes->postings_offsets, g_free);
+    g_clear_pointer(&routes->stop_ids,         g_free);
+
+    routes->stop_ids_count = 0;
+
+    // Compacting the routes left, in place.
+    guint   count       = 0;
+    guint32 stops_count = 0;
+
+    for (guint i = 0; i < routes_count; i++) {
+        if (is_pruned[i]) { continue; }
+
+        guint32 first = routes->offsets[i    ];
+        guint32 end   = routes->offsets[i + 1];
+
+        memmove(routes->stops + stops_count, routes->stops + first,
+            (end - first) * sizeof(guint32));
+
+        routes->route_ids[count] = routes->route_ids[i];
+        routes->offsets  [count] = stops_count;
+
+        stops_count += end - first;
+        count++;
+    }
+
+    routes->offsets[count] = stops_count;
+
+    routes->routes_count = count;
+    routes->stops_count  = stops_count;
+    routes->route_ids    = g_renew(guint32, routes->route_ids, count    );
+    routes->offsets      = g_renew(guint32, routes->offsets,   count + 1);
+    routes->stops        = g_renew(guint32, routes->stops,     stops_count);
+
+    g_free(is_pruned);
+
+    g_message(       MSG_ROUTES_PRUNED, duplicates, dominated, count);
+    syslog(LOG_INFO, MSG_ROUTES_PRUNED, duplicates, dominated, count);
+}
+
+/**
+ * Precomputes the table of all directly connected (ordered) bus stop pairs.
+ * Depending on which one is smaller, the table is made up either as
+ * a sorted array of 64-bit keys, or as a bitmap over the bus stops index
+ * (hence the index has to be built beforehand).
+ *
+ * @param routes The pointer to the routes structure.
+ * @param limit  The maximum amount of memory (in bytes) the table
+ *               is allowed to take.
+ *
+ * @return <code>TRUE</code> if the table is built,
+ *         <code>FALSE</code> if it would exceed the memory limit.
+ */
+gboolean tabulate_routes(ROUTES_STORE *routes, const guint64 limit) {
+    guint   routes_count = routes->routes_count;
+    guint64 keys_count   = 0;
+
+    // Estimating the size of both table layouts. The number of keys
+    // is an upper bound, since pairs may repeat across routes.
+    for (guint i = 0; i < routes_count; i++) {
+        guint64 route_len = routes->offsets[i + 1] - routes->offsets[i];
+
+        if (route_len > 1) { keys_count += route_len * (route_len - 1) / 2; }
+    }
+
+    guint   row_words   = (routes->stop_ids_count + 63) / 64;
+    guint64 keys_size   = keys_count * sizeof(guint64);
+    guint64 bitmap_size = (guint64) routes->stop_ids_count * row_words
+                        * sizeof(guint64);
+
+    gboolean is_bitmap = (bitmap_size < keys_size);
+    guint64  size      = is_bitmap ? bitmap_size : keys_size;
+
+    if (size > limit) {
+        g_warning(ERR_TABLE_EXCEEDS_LIMIT, size, limit);
+
+        return FALSE;
+    }
+
+    if (is_bitmap) {
+        guint64 *bitmap   = g_new0(guint64, (gsize) routes->stop_ids_count
+                                                  * row_words);
+        guint32 *stop_idx = routes->stop_indices;
+
+        // Routes mapped from a routes snapshot come without index entries
+        // of their bus stops.
+        if (stop_idx == NULL) {
+            stop_idx = g_new(guint32, routes->stops_count);
+
+            for (guint k = 0; k < routes->stops_count; k++) {
+                stop_idx[k] = find_stop(routes, routes->stops[k]);
+            }
+        }
+
+        for (guint i = 0; i < routes_count; i++) {
+            guint32 end = routes->offsets[i + 1];
+
+            for (guint32 j = routes->offsets[i]; j < end; j++) {
+                guint64 *row = bitmap + ((gsize) stop_idx[j] * row_words);
+
+                for (guint32 k = j + 1; k < end; k++) {
+                    row[stop_idx[k] >> 6] |= G_GUINT64_CONSTANT(1)
+                                          << (stop_idx[k] & 63);
+                }
+            }
+        }
+
+        if (stop_idx != routes->stop_indices) { g_free(stop_idx); }
+
+        routes->table_row_words = row_words;
+        routes->table_bitmap    = bitmap;
+    } else {
+        guint64 *table = g_new(guint64, keys_count);
+        gsize    count = 0;
+
+        for (guint i = 0; i < routes_count; i++) {
+            guint32 end = routes->offsets[i + 1];
+
+            for (guint32 j = routes->offsets[i]; j < end; j++) {
+                guint64 from = (guint64) routes->stops[j] << 32;
+
+                for (guint32 k = j + 1; k < end; k++) {
+                    table[count++] = from | routes->stops[k];
+                }
+            }
+        }
+
+        qsort(table, count, sizeof(guint64), _cmp_table_keys);
+
+        gsize table_count = 0;
+
+        for (gsize k = 0; k < count; k++) {
+            if ((table_count == 0) || (table[table_count - 1] != table[k])) {
+                table[table_count++] = table[k];
+            }
+        }
+
+        routes->table_count = table_count;
+        routes->table       = g_renew(guint64, table, table_count);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Prepares the routes structure to be used with the given direct-route
+ * engine: builds the bus stops index and the table of bus stop pairs,
+ * whichever is needed. Falls back to the index engine if the table
+ * would exceed its memory limit.
+ *
+ * @param routes      The pointer to the routes structure.
+ * @param engine      The direct-route engine requested.
+ * @param table_limit The maximum amount of memory (in bytes) the table
+ *                    of bus stop pairs is allowed to take.
+ */
+void set_routes_engine(      ROUTES_STORE  *routes,
+                             ROUTES_ENGINE  engine,
+                       const guint64        table_limit) {
+
+    // Routes mapped from a routes snapshot come already indexed.
+    if (((engine == ENGINE_INDEX) || (engine == ENGINE_TABLE))
+        && (routes->mapped == NULL)) {
+
+        index_routes(routes);
+    }
+
+    if ((engine == ENGINE_TABLE) && !tabulate_routes(routes, table_limit)) {
+        engine = ENGINE_INDEX;
+    }
+
+    // No engine looks up bus stops of routes through their index entries:
+    // they are mapped anew, only if transfers or reachability need them.
+    g_clear_pointer(&routes->stop_indices, g_free);
+
+    routes->engine = engine;
+
+    if (engine == ENGINE_PACKED) {
+        pack_routes(routes);
+
+        // The plain bus stops sequences are no longer needed, unless
+        // they are mapped from a routes snapshot.
+        if (routes->mapped == NULL) {
+            g_free(routes->stops);
+
+            routes->stops = NULL;
+        }
+
+        g_message(       MSG_ROUTES_PACKED, routes->stops_count,
+            routes->packed_size);
+        syslog(LOG_INFO, MSG_ROUTES_PACKED, routes->stops_count,
+            routes->packed_size);
+
+        return;
+    }
+
+    if (engine == ENGINE_SIMD) {
+        const gchar *kernel_name;
+
+        routes->search_stop = get_stop_search(&kernel_name);
+
+        g_message(       MSG_SIMD_KERNEL, kernel_name);
+        syslog(LOG_INFO, MSG_SIMD_KERNEL, kernel_name);
+
+        return;
+    }
+
+    g_message(       MSG_ROUTES_ENGINE, get_engine_name(engine));
+    syslog(LOG_INFO, MSG_ROUTES_ENGINE, get_engine_name(engine));
+}
+
+/**
+ * Gets the name of the direct-route engine, as used in daemon settings.
+ *
+ * @param engine The direct-route engine.
+ *
+ * @return The name of the direct-route engine.
+ */
+const gchar *get_engine_name(const ROUTES_ENGINE engine) {
+    switch (engine) {
+    case ENGINE_INDEX:  return ENGINE_INDEX_NAME;
+    case ENGINE_TABLE:  return ENGINE_TABLE_NAME;
+    case ENGINE_SIMD:   return ENGINE_SIMD_NAME;
+    case ENGINE_PACKED: return ENGINE_PACKED_NAME;
+    default:            return ENGINE_SCAN_NAME;
+    }
+}
+
+/**
+ * Looks up a bus stop ID in the bus stops index.
+ *
+ * @param routes  The pointer to the routes structure.
+ * @param stop_id The bus stop ID to look up.
+ *
+ * @return The index of the bus stop in the <code>stop_ids</code> array
+ *         or <code>STOP_NOT_FOUND</code>, if there is no such stop.
+ */
+guint find_stop(const ROUTES_STORE *routes, const guint32 stop_id) {
+    guint lo = 0, hi = routes->stop_ids_count;
+
+    while (lo < hi) {
+        guint mid = lo + ((hi - lo) >> 1);
+
+        if (routes->stop_ids[mid] < stop_id) { lo = mid + 1; }
+        else                                 { hi = mid;     }
+    }
+
+    if ((lo < routes->stop_ids_count) && (routes->stop_ids[lo] == stop_id)) {
+        return lo;
+    }
+
+    return STOP_NOT_FOUND;
+}
+
+/**
+ * Maps all bus stops of routes to their entries in the bus stops index,
+ * so that routes can be followed stop by stop through the index.
+ * Builds the bus stops index beforehand, if there is none yet.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void map_stops(ROUTES_STORE *routes) {
+    // Building the bus stops index maps bus stops along the way.
+    if (routes->postings == NULL) { index_routes(routes); }
+
+    // The index of a routes snapshot is mapped as is, without them,
+    // and so is the one built for compressed routes, kept for transfers.
+    if (routes->stop_indices == NULL) {
+        guint32 *stop_idx = g_new(guint32, routes->stops_count);
+
+        // Compressed routes are decompressed right in place.
+        const guint32 *stops = routes->stops;
+
+        if (stops == NULL) {
+            unpack_routes(routes, stop_idx);
+
+            stops = stop_idx;
+        }
+
+        for (guint i = 0; i < routes->stops_count; i++) {
+            stop_idx[i] = find_stop(routes, stops[i]);
+        }
+
+        routes->stop_indices = stop_idx;
+    }
+}
+
+/**
+ * Estimates the amount of memory <code>map_stops()</code> is going to take
+ * for the routes structure, beyond what is there already, to be kept
+ * for transfers: the bus stops index, if the direct-route engine goes
+ * without one, and the index entries of all bus stops of routes, unless
+ * the routes are compressed (those are decompressed on the fly then).
+ * As distinct bus stops aren't known before the index is built,
+ * the estimate is an upper bound.
+ *
+ * @param routes The pointer to the routes structure.
+ *
+ * @return The amount of memory (in bytes).
+ */
+guint64 get_mapping_size(const ROUTES_STORE *routes) {
+    guint64 size = 0;
+
+    if (routes->postings == NULL) {
+        size += ((guint64) routes->stops_count * (sizeof(STOP_POSTING)
+             + (sizeof(guint32) * 2))) + sizeof(guint32);
+    }
+
+    if ((routes->stop_indices == NULL) && (routes->stops != NULL)) {
+        size += (guint64) routes->stops_count * sizeof(guint32);
+    }
+
+    return size;
+}
+
+/**
+ * Frees the routes structure previously created by <code>parse_routes()</code>.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void free_routes(ROUTES_STORE *routes) {
+    if (routes == NULL) { return; }
+
+    g_free(routes->reachable_counts );
+    g_free(routes->reachable_offsets);
+    g_free(routes->reachable        );
+    g_free(routes->packed_offsets  );
+    g_free(routes->packed          );
+    g_free(routes->stop_indices    );
+    g_free(routes->transfers_back  );
+    g_free(routes->transfers       );
+    g_free(routes->table_bitmap    );
+    g_free(routes->table           );
+
+    // Routes mapped from a routes snapshot are released
+    // along with the mapping itself.
+    if (routes->mapped != NULL) {
+        g_mapped_file_unref(routes->mapped);
+    } else {
+        g_free(routes->postings        );
+        g_free(routes->postings_offsets);
+        g_free(routes->stop_ids        );
+        g_free(routes->stops           );
+        g_free(routes->offsets         );
+        g_free(routes->route_ids       );
+    }
+
+    g_free(routes);
+}
+
+// Helper function. Calculates the size of the arrays following
+// the header of a routes snapshot.
+static guint64 _get_snapshot_data_size(const guint64 routes_count,
+                                       const guint64 stops_count,
+                                       const guint64 stop_ids_count) {
+
+    return sizeof(guint32) * ((routes_count   * 2) + 1  // Routes.
+                           +  (stops_count    * 3)      // Stops, postings.
+                           +  (stop_ids_count * 2) + 1);
+}
+
+// Helper function. Checks whether the arrays mapped from a routes snapshot
+// are consistent, so that no lookup could ever go out of their bounds.
+static gboolean _is_snapshot_consistent(const ROUTES_STORE *routes) {
+    guint routes_count   = routes->routes_count;
+    guint stops_count    = routes->stops_count;
+    guint stop_ids_count = routes->stop_ids_count;
+
+    if ((routes->offsets[0] != 0)
+        || (routes->offsets[routes_count] != stops_count)
+        || (routes->postings_offsets[0] != 0)
+        || (routes->postings_offsets[stop_ids_count] != stops_count)) {
+
+        return FALSE;
+    }
+
+    for (guint i = 0; i < routes_count; i++) {
+        if (routes->offsets[i] > routes->offsets[i + 1]) { return FALSE; }
+    }
+
+    for (guint j = 0; j < stop_ids_count; j++) {
+        if (routes->postings_offsets[j] > routes->postings_offsets[j + 1]) {
+            return FALSE;
+        }
+
+        if ((j > 0) && (routes->stop_ids[j - 1] >= routes->stop_ids[j])) {
+            return FALSE;
+        }
+    }
+
+    for (guint k = 0; k < stops_count; k++) {
+        STOP_POSTING posting = routes->postings[k];
+
+        if ((posting.route >= routes_count)
+            || (posting.position >= (routes->offsets[posting.route + 1]
+                                   - routes->offsets[posting.route]))) {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// Helper function. Maps the routes structure onto the routes snapshot
+// as is, without any parsing or indexing, after verifying its header
+// and checksum. Returns NULL if the routes snapshot cannot be used.
+static ROUTES_STORE *_map_routes(      GMappedFile *data,
+                                 const gchar       *datastore) {
+
+    const gchar *snapshot      = g_mapped_file_get_contents(data);
+    gsize        snapshot_size = g_mapped_file_get_length  (data);
+
+    if (G_BYTE_ORDER != G_LITTLE_ENDIAN) {
+        g_warning(ERR_SNAPSHOT_BYTE_ORDER);
+
+        return NULL;
+    }
+
+    if (snapshot_size < sizeof(SNAPSHOT_HEADER)) {
+        g_warning(ERR_SNAPSHOT_CORRUPTED, datastore);
+
+        return NULL;
+    }
+
+    SNAPSHOT_HEADER header;
+
+    memcpy(&header, snapshot, sizeof(SNAPSHOT_HEADER));
+
+    if (header.version != SNAPSHOT_VERSION) {
+        g_warning(ERR_SNAPSHOT_VERSION, header.version, SNAPSHOT_VERSION);
+
+        return NULL;
+    }
+
+    const gchar *data_      = snapshot      + sizeof(SNAPSHOT_HEADER);
+    guint64      data_size  = snapshot_size - sizeof(SNAPSHOT_HEADER);
+
+    if ((header.data_size != data_size)
+        || (data_size != _get_snapshot_data_size(header.routes_count,
+                                                 header.stops_count,
+                                                 header.stop_ids_count))) {
+
+        g_warning(ERR_SNAPSHOT_CORRUPTED, datastore);
+
+        return NULL;
+    }
+
+    // Verifying the checksum of the arrays.
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    guint8 digest[sizeof(header.checksum)];
+    gsize  digest_size = sizeof(digest);
+
+    g_checksum_update(checksum, (const guchar *) data_, data_size);
+    g_checksum_get_digest(checksum, digest, &digest_size);
+    g_checksum_free(checksum);
+
+    if (memcmp(digest, header.checksum, sizeof(digest)) != 0) {
+        g_warning(ERR_SNAPSHOT_CORRUPTED, datastore);
+
+        return NULL;
+    }
+
+    // Laying out the arrays right over the mapping.
+    guint32 *words = (guint32 *) data_;
+
+    ROUTES_STORE *routes = g_new0(ROUTES_STORE, 1);
+
+    routes->ref_count        = 1;
+    routes->routes_count     = header.routes_count;
+    routes->stops_count      = header.stops_count;
+    routes->stop_ids_count   = header.stop_ids_count;
+
+    routes->route_ids        = words; words += header.routes_count;
+    routes->offsets          = words; words += header.routes_count   + 1;
+    routes->stops            = words; words += header.stops_count;
+    routes->stop_ids         = words; words += header.stop_ids_count;
+    routes->postings_offsets = words; words += header.stop_ids_count + 1;
+    routes->postings         = (STOP_POSTING *) words;
+
+    routes->mapped = g_mapped_file_ref(data);
+
+    if (!_is_snapshot_consistent(routes)) {
+        g_warning(ERR_SNAPSHOT_CORRUPTED, datastore);
+
+        free_routes(routes);
+
+        return NULL;
+    }
+
+    return routes;
+}
+
+/**
+ * Maps and parses the routes data store, and prepares the routes
+ * structure to be used with the given direct-route engine.
+ * <br />
+ * The routes data store may also be a routes snapshot compiled
+ * by the <code>busc</code> tool: it is detected by its header,
+ * and mapped into memory as is, without any parsing or indexing.
+ *
+ * @param datastore   The path and filename of the routes data store.
+ * @param prune       Whether duplicate and dominated routes have to be
+ *                    removed from the routes data store (not applicable
+ *                    to routes snapshots, which are mapped as is).
+ * @param engine      The direct-route engine requested.
+ * @param table_limit The maximum amount of memory (in bytes) the table
+ *                    of bus stop pairs is allowed to take.
+ *
+ * @return The pointer to a newly allocated routes structure
+ *         or <code>NULL</code>, if the data store cannot be read.
+ */
+ROUTES_STORE *load_routes(const gchar         *datastore,
+                          const gboolean       prune,
+                                ROUTES_ENGINE  engine,
+                          const guint64        table_limit) {
+
+    gint64 load_start = g_get_monotonic_time();
+
+    // Mapping the routes data store into memory rather than reading it
+    // into a buffer: its pages are backed by the file itself and are
+    // released right after parsing.
+    GMappedFile *data = g_mapped_file_new(datastore, FALSE, NULL);
+
+    if (data == NULL) { return NULL; }
+
+    const gchar *routes_buff = g_mapped_file_get_contents(data);
+    gsize        data_size   = g_mapped_file_get_length  (data);
+
+    ROUTES_STORE *routes_store;
+
+    if ((data_size >= sizeof(SNAPSHOT_MAGIC))
+        && (memcmp(routes_buff, SNAPSHOT_MAGIC,
+                   sizeof(SNAPSHOT_MAGIC)) == 0)) {
+
+        // The routes snapshot keeps the mapping referenced.
+        routes_store = _map_routes(data, datastore);
+
+        g_mapped_file_unref(data);
+
+        if (routes_store == NULL) { return NULL; }
+    } else {
+        // The routes data store is going to be read sequentially,
+        // front to back.
+        if (data_size > 0) {
+            posix_madvise((void *) routes_buff, data_size,
+                POSIX_MADV_SEQUENTIAL);
+        }
+
+        // Parsing routes into a compact array of bus stop IDs.
+        routes_store = parse_routes(routes_buff, data_size);
+
+        // The raw routes data is no longer needed after parsing.
+        g_mapped_file_unref(data);
+
+        // Leaving out routes that can't change any answer, so that
+        // whatever the direct-route engine builds is built without them.
+        if (prune) { prune_routes(routes_store); }
+    }
+
+    gint64 index_start = g_get_monotonic_time();
+
+    // Building the bus stops index and/or the table of bus stop pairs,
+    // whichever the direct-route engine needs.
+    set_routes_engine(routes_store, engine, table_limit);
+
+    routes_store->load_duration  = index_start - load_start;
+    routes_store->index_duration = g_get_monotonic_time() - index_start;
+
+    return routes_store;
+}
+
+// Helper function. Feeds the array of words to the checksum and/or writes
+// it out to the routes snapshot, in little-endian byte order.
+static gboolean _write_words(      GOutputStream *snapshot,
+                                   GChecksum     *checksum,
+                             const guint32       *words,
+                             const gsize          count,
+                                   GError       **error) {
+
+    guint32 chunk[1024];
+
+    for (gsize i = 0; i < count; i += G_N_ELEMENTS(chunk)) {
+        gsize chunk_count = MIN(count - i, G_N_ELEMENTS(chunk));
+
+        for (gsize j = 0; j < chunk_count; j++) {
+            chunk[j] = GUINT32_TO_LE(words[i + j]);
+        }
+
+        gsize chunk_size = chunk_count * sizeof(guint32);
+
+        if (checksum != NULL) {
+            g_checksum_update(checksum, (const guchar *) chunk, chunk_size);
+        }
+
+        if ((snapshot != NULL) && !g_output_stream_write_all(snapshot,
+            chunk, chunk_size, NULL, NULL, error)) {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// Helper function. Feeds all the arrays of the routes structure
+// to the checksum and/or writes them out to the routes snapshot.
+static gboolean _write_arrays(      GOutputStream  *snapshot,
+                                    GChecksum      *checksum,
+                              const ROUTES_STORE   *routes,
+                                    GError        **error) {
+
+    return _write_words(snapshot, checksum, routes->route_ids,
+               routes->routes_count,            error)
+        && _write_words(snapshot, checksum, routes->offsets,
+               routes->routes_count + 1,        error)
+        && _write_words(snapshot, checksum, routes->stops,
+               routes->stops_count,             error)
+        && _write_words(snapshot, checksum, routes->stop_ids,
+               routes->stop_ids_count,          error)
+        && _write_words(snapshot, checksum, routes->postings_offsets,
+               routes->stop_ids_count + 1,      error)
+        && _write_words(snapshot, checksum, (guint32 *) routes->postings,
+               routes->stops_count * 2,         error);
+}
+
+/**
+ * Writes the routes structure (along with its bus stops index) out
+ * as a routes snapshot, to be mapped into memory by the daemon as is.
+ * An existing routes snapshot gets replaced atomically, so that the daemon
+ * never sees (and reloads) a partially written one.
+ *
+ * @param routes   The pointer to the routes structure. It has to be indexed.
+ * @param snapshot The path and filename of the routes snapshot.
+ *
+ * @return <code>TRUE</code> if the routes snapshot is written successfully,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean save_routes(const ROUTES_STORE *routes, const gchar *snapshot) {
+    SNAPSHOT_HEADER header;
+
+    memset(&header, 0, sizeof(SNAPSHOT_HEADER));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+    header.version        = GUINT32_TO_LE(SNAPSHOT_VERSION);
+    header.routes_count   = GUINT32_TO_LE(routes->routes_count);
+    header.stops_count    = GUINT32_TO_LE(routes->stops_count);
+    header.stop_ids_count = GUINT32_TO_LE(routes->stop_ids_count);
+    header.data_size      = GUINT64_TO_LE(_get_snapshot_data_size(
+        routes->routes_count, routes->stops_count, routes->stop_ids_count));
+
+    // Checksumming the arrays before anything gets written out.
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    gsize digest_size = sizeof(header.checksum);
+
+    _write_arrays(NULL, checksum, routes, NULL);
+    g_checksum_get_digest(checksum, header.checksum, &digest_size);
+    g_checksum_free(checksum);
+
+    GFile        *file        = g_file_new_for_path(snapshot);
+    GCancellable *cancellable = g_cancellable_new();
+    GError       *error       = NULL;
+
+    GFileOutputStream *out = g_file_replace(file, NULL, FALSE,
+        G_FILE_CREATE_REPLACE_DESTINATION, NULL, &error);
+
+    gboolean is_written = (out != NULL)
+        && g_output_stream_write_all((GOutputStream *) out, &header,
+               sizeof(SNAPSHOT_HEADER), NULL, NULL, &error)
+        && _write_arrays((GOutputStream *) out, NULL, routes, &error);
+
+    if (out != NULL) {
+        // Discarding a partially written routes snapshot.
+        if (!is_written) { g_cancellable_cancel(cancellable); }
+
+        is_written = g_output_stream_close((GOutputStream *) out,
+            cancellable, is_written ? &error : NULL) && is_written;
+
+        g_object_unref(out);
+    }
+
+    if (!is_written) {
+        g_warning(ERR_CANNOT_SAVE_SNAPSHOT, (error != NULL)
+            ? error->message : snapshot);
+
+        g_clear_error(&error);
+    }
+
+    g_object_unref(cancellable);
+    g_object_unref(file);
+
+    return is_written;
+}
+
+/**
+ * Acquires a reference to the routes structure.
+ *
+ * @param routes The pointer to the routes structure.
+ *
+ * @return The same pointer to the routes structure.
+ */
+ROUTES_STORE *ref_routes(ROUTES_STORE *routes) {
+    g_atomic_int_inc(&routes->ref_count);
+
+    return routes;
+}
+
+/**
+ * Releases a reference to the routes structure. The structure is freed
+ * when the last reference to it is released.
+ *
+ * @param routes The pointer to the routes structure.
+ */
+void unref_routes(ROUTES_STORE *routes) {
+    if (routes == NULL) { return; }
+
+    if (g_atomic_int_dec_and_test(&routes->ref_count)) {
+        free_routes(routes);
+    }
+}
+
+/**
+ * Acquires a reference to the current snapshot of routes. Never blocks:
+ * while the snapshot pointer is being read and referenced, the reader
+ * is registered in the holder, so that a concurrent publisher waits
+ * for it before releasing the previous snapshot.
+ *
+ * @param routes_holder The pointer to the routes holder.
+ *
+ * @return The pointer to the current snapshot of routes. Has to be
+ *         released with <code>unref_routes()</code> once it is no longer
+ *         needed.
+ */
+ROUTES_STORE *acquire_routes(ROUTES_HOLDER *routes_holder) {
+    g_atomic_int_inc(&routes_holder->readers);
+
+    ROUTES_STORE *routes
+        = ref_routes(g_atomic_pointer_get(&routes_holder->routes));
+
+    g_atomic_int_add(&routes_holder->readers, -1);
+
+    return routes;
+}
+
+/**
+ * Publishes a new snapshot of routes, replacing the current one.
+ * Readers that have already acquired the previous snapshot keep working
+ * on it; it is freed when the last of them releases it.
+ * Has to be called by a single publisher at a time.
+ *
+ * @param routes_holder The pointer to the routes holder.
+ * @param routes        The pointer to the new snapshot of routes.
+ *                      The holder takes over its reference.
+ */
+void publish_routes(ROUTES_HOLDER *routes_holder, ROUTES_STORE *routes) {
+    routes->generation = ++routes_holder->generation;
+
+    ROUTES_STORE *prev_routes = g_atomic_pointer_get(&routes_holder->routes);
+
+    g_atomic_pointer_set(&routes_holder->routes, routes);
+
+    // Waiting for readers that might have fetched the previous snapshot
+    // pointer, but haven't referenced it yet.
+    while (g_atomic_int_get(&routes_holder->readers) > 0) {
+        g_thread_yield();
+    }
+
+    unref_routes(prev_routes);
+
+    g_message(       MSG_ROUTES_LOADED, routes->routes_count,
+        routes->stops_count, routes->generation);
+    syslog(LOG_INFO, MSG_ROUTES_LOADED, routes->routes_count,
+        routes->stops_count, routes->generation);
+}
+
+// Helper function. The routes reloader thread: loads the routes data store
+// and publishes a new snapshot of routes, for as long as reloads keep
+// being requested.
+static gpointer _reload_routes(ROUTES_HOLDER *routes_holder) {
+    do {
+        g_atomic_int_set(&routes_holder->reload_state, RELOAD_RUNNING);
+
+        ROUTES_STORE *routes = load_routes(routes_holder->datastore,
+            routes_holder->prune, routes_holder->engine,
+            routes_holder->table_limit);
+
+        if (routes != NULL) {
+            link_routes(routes, routes_holder->transfers_limit);
+            reach_stops(routes, routes_holder->reachable_limit);
+
+            publish_routes(routes_holder, routes);
+        } else {
+            g_warning(ERR_CANNOT_RELOAD_ROUTES);
+        }
+    } while (!g_atomic_int_compare_and_exchange(&routes_holder->reload_state,
+        RELOAD_RUNNING, RELOAD_IDLE));
+
+    return NULL;
+}
+
+/**
+ * Reloads the routes data store in the background, without blocking
+ * the main loop. If a reload is already in progress, another one
+ * is scheduled to run right after it. Gets called on <code>SIGHUP</code>
+ * and on data store changes.
+ *
+ * @param routes_holder The pointer to the routes holder.
+ *
+ * @return <code>G_SOURCE_CONTINUE</code>, to keep the signal handler.
+ */
+gboolean reload_routes(ROUTES_HOLDER *routes_holder) {
+    gint *reload_state = &routes_holder->reload_state;
+
+    while (TRUE) {
+        if (g_atomic_int_compare_and_exchange(reload_state,
+            RELOAD_IDLE, RELOAD_RUNNING)) {
+
+            g_thread_unref(g_thread_new(NULL, (GThreadFunc) _reload_routes,
+                routes_holder));
+
+            break;
+        }
+
+        if (g_atomic_int_compare_and_exchange(reload_state,
+            RELOAD_RUNNING, RELOAD_PENDING)) {
+
+            break;
+        }
+
+        if (g_atomic_int_get(reload_state) == RELOAD_PENDING) { break; }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+// Helper function. The routes data store monitor callback.
+// Reloads routes once the data store file is completely rewritten
+// or replaced.
+static void _datastore_changed(GFileMonitor      *monitor,
+                               GFile             *file,
+                               GFile             *other_file,
+                               GFileMonitorEvent  event,
+                               ROUTES_HOLDER     *routes_holder) {
+
+    if ((event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+        || (event == G_FILE_MONITOR_EVENT_CREATED)) {
+
+        reload_routes(routes_holder);
+    }
+}
+
+/**
+ * Starts monitoring the routes data store for changes, to reload it
+ * each time it gets changed.
+ *
+ * @param routes_holder The pointer to the routes holder.
+ */
+void monitor_routes(ROUTES_HOLDER *routes_holder) {
+    GError *error = NULL;
+
+    GFile *data = g_file_new_for_path(routes_holder->datastore);
+
+    routes_holder->monitor = g_file_monitor_file(data, G_FILE_MONITOR_NONE,
+        NULL, &error);
+
+    if (routes_holder->monitor != NULL) {
+        g_signal_connect(routes_holder->monitor, "changed",
+            G_CALLBACK(_datastore_changed), routes_holder);
+    } else {
+        g_warning(ERR_CANNOT_MONITOR_DATASTORE, error->message);
+
+        g_clear_error(&error);
+    }
+
+    g_object_unref(data);
+}
+
+// vim:set nu et ts=4 sw=4:
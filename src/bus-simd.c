@@ -0,0 +1,160 @@
+/*
+ * src/bus-simd.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The vectorized bus stops search module of the daemon -----------------------
+
+#include "busd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SIMD_X86_64
+#endif
+
+// Helper function. Searches for the bus stop one by one.
+static gsize _search_stop_scalar(const guint32 *stops,
+                                 const gsize    count,
+                                 const guint32  stop) {
+
+    gsize i = 0;
+
+    while ((i < count) && (stops[i] != stop)) { i++; }
+
+    return i;
+}
+
+#ifdef SIMD_X86_64
+// Helper function. Searches for the bus stop 16 stops at a time, comparing
+// them in 4-stop SSE2 vectors (SSE2 is there on any x86-64 CPU).
+static gsize _search_stop_sse2(const guint32 *stops,
+                               const gsize    count,
+                               const guint32  stop) {
+
+    const __m128i needle = _mm_set1_epi32((gint) stop);
+
+    gsize i = 0;
+
+    for (; (i + 16) <= count; i += 16) {
+        const __m128i *block = (const __m128i *) (stops + i);
+
+        __m128i eq0 = _mm_cmpeq_epi32(_mm_loadu_si128(block    ), needle);
+        __m128i eq1 = _mm_cmpeq_epi32(_mm_loadu_si128(block + 1), needle);
+        __m128i eq2 = _mm_cmpeq_epi32(_mm_loadu_si128(block + 2), needle);
+        __m128i eq3 = _mm_cmpeq_epi32(_mm_loadu_si128(block + 3), needle);
+
+        // Checking all the 16 stops at once, and pinning in the match
+        // only if there is one.
+        __m128i any = _mm_or_si128(_mm_or_si128(eq0, eq1),
+                                   _mm_or_si128(eq2, eq3));
+
+        if (_mm_movemask_epi8(any) != 0) {
+            guint mask = (guint) _mm_movemask_ps(_mm_castsi128_ps(eq0))
+                      | ((guint) _mm_movemask_ps(_mm_castsi128_ps(eq1)) << 4)
+                      | ((guint) _mm_movemask_ps(_mm_castsi128_ps(eq2)) << 8)
+                      | ((guint) _mm_movemask_ps(_mm_castsi128_ps(eq3)) << 12);
+
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + _search_stop_scalar(stops + i, count - i, stop);
+}
+
+// Helper function. Searches for the bus stop 32 stops at a time, comparing
+// them in 8-stop AVX2 vectors.
+__attribute__((target("avx2")))
+static gsize _search_stop_avx2(const guint32 *stops,
+                               const gsize    count,
+                               const guint32  stop) {
+
+    const __m256i needle = _mm256_set1_epi32((gint) stop);
+
+    gsize i = 0;
+
+    for (; (i + 32) <= count; i += 32) {
+        const __m256i *block = (const __m256i *) (stops + i);
+
+        __m256i eq0 = _mm256_cmpeq_epi32(_mm256_loadu_si256(block    ), needle);
+        __m256i eq1 = _mm256_cmpeq_epi32(_mm256_loadu_si256(block + 1), needle);
+        __m256i eq2 = _mm256_cmpeq_epi32(_mm256_loadu_si256(block + 2), needle);
+        __m256i eq3 = _mm256_cmpeq_epi32(_mm256_loadu_si256(block + 3), needle);
+
+        __m256i any = _mm256_or_si256(_mm256_or_si256(eq0, eq1),
+                                      _mm256_or_si256(eq2, eq3));
+
+        if (!_mm256_testz_si256(any, any)) {
+            guint mask =
+                  (guint) _mm256_movemask_ps(_mm256_castsi256_ps(eq0))
+               | ((guint) _mm256_movemask_ps(_mm256_castsi256_ps(eq1)) <<  8)
+               | ((guint) _mm256_movemask_ps(_mm256_castsi256_ps(eq2)) << 16)
+               | ((guint) _mm256_movemask_ps(_mm256_castsi256_ps(eq3)) << 24);
+
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + _search_stop_sse2(stops + i, count - i, stop);
+}
+
+// Helper function. Identifies whether the CPU supports AVX2, and the OS
+// saves AVX registers across context switches. Queries CPUID right away,
+// rather than through __builtin_cpu_supports(), which needs libgcc
+// at link time.
+static gboolean _is_avx2_supported(void) {
+    guint eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+        || ((ecx & bit_OSXSAVE) == 0) || ((ecx & bit_AVX) == 0)) {
+
+        return FALSE;
+    }
+
+    // Both the SSE and the AVX state have to be enabled in XCR0.
+    guint xcr0_lo, xcr0_hi;
+
+    __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+
+    if ((xcr0_lo & 0x6) != 0x6) { return FALSE; }
+
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+        && ((ebx & bit_AVX2) != 0);
+}
+#endif
+
+/**
+ * Picks the fastest bus stops search kernel the CPU supports.
+ *
+ * @param kernel_name The pointer to a variable to put the name
+ *                    of the kernel picked into.
+ *
+ * @return The pointer to the bus stops search kernel.
+ */
+STOP_SEARCH get_stop_search(const gchar **kernel_name) {
+#ifdef SIMD_X86_64
+    if (_is_avx2_supported()) {
+        *kernel_name = SIMD_KERNEL_AVX2;
+
+        return _search_stop_avx2;
+    }
+
+    *kernel_name = SIMD_KERNEL_SSE2;
+
+    return _search_stop_sse2;
+#else
+    *kernel_name = SIMD_KERNEL_SCALAR;
+
+    return _search_stop_scalar;
+#endif
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,607 @@
+/*
+ * src/bus-transfers.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The transfer-aware routing module of the daemon ----------------------------
+
+#include "busd.h"
+
+/** The label link value meaning "no label". */
+#define LABEL_NIL G_MAXUINT32
+
+/**
+ * The share of all routes (1 / N), which a level of the transfers graph
+ * search has to stay within, to go on with the next one: denser levels
+ * cost more to build than they save.
+ */
+#define TRANSFERS_DENSE 64
+
+// Helper structure. A label of the transfers search: a route boarded
+// after a number of transfers, at the earliest position known so far.
+typedef struct {
+    guint32 route;  // The route ridden.
+    guint32 board;  // The position the route is boarded at.
+    guint32 parent; // The label of the route ridden before (or LABEL_NIL).
+    guint32 alight; // The position the route ridden before is left at.
+} _LABEL;
+
+// Helper structure. The state of the transfers search.
+typedef struct {
+    const ROUTES_STORE *routes;
+          guint32       to_first; // The postings of the ending bus stop.
+          guint32       to_last;
+          guint64      *to_stops; // Bus stops it's directly reached from.
+          guint64      *seen;     // Bus stops transferred at in a round.
+          guint32      *best;     // The earliest boarding of each route.
+          guint32      *label_of; // The label of each route boarded.
+          GArray       *labels;   // Labels, round after round.
+          guint32      *stops;    // A route decompressed (packed engine).
+          guint         capacity; // The number of stops it has room for.
+} _SEARCH;
+
+/**
+ * Precomputes the route-to-route transfers graph: a bitmap of
+ * <code>routes_count</code> rows, where the bit <code>(i, j)</code> is set
+ * if a rider can get off the route <code>i</code> at a bus stop and get on
+ * the route <code>j</code> there, to ride it further on. Along with it,
+ * its transpose is kept, to search the graph backwards.
+ * <br />
+ * Transfers are searched through the bus stops index, so all bus stops
+ * of routes are mapped to their entries in it beforehand (building
+ * the index too, if there is none yet), unless the routes are compressed:
+ * those are decompressed and mapped on the fly. That memory counts against
+ * the limit as well: if it alone would exceed the limit, or the limit
+ * is zero, transfers are turned off, and nothing gets built.
+ *
+ * @param routes The pointer to the routes structure.
+ * @param limit  The maximum amount of memory (in bytes) the graph,
+ *               along with the mapping of bus stops, is allowed to take.
+ *
+ * @return <code>TRUE</code> if transfers can be searched (with the graph
+ *         or without it), <code>FALSE</code> if they are turned off.
+ */
+gboolean link_routes(ROUTES_STORE *routes, const guint64 limit) {
+    if (limit == 0) { return FALSE; }
+
+    guint64 mapping_size = get_mapping_size(routes);
+
+    if (mapping_size > limit) {
+        g_warning(ERR_TRANSFERS_INDEX_EXCEEDS_LIMIT, mapping_size, limit);
+
+        return FALSE;
+    }
+
+    // Transfers are looked up through the bus stops index, whichever
+    // the direct-route engine is.
+    map_stops(routes);
+
+    // Compressed bus stops sequences are decompressed on the fly
+    // by the search instead.
+    if (routes->stops == NULL) {
+        g_clear_pointer(&routes->stop_indices, g_free);
+    }
+
+    routes->transferable = TRUE;
+
+    guint   routes_count = routes->routes_count;
+    guint   row_words    = (routes_count + 63) / 64;
+    guint64 size         = ((guint64) routes_count * row_words
+                         * sizeof(guint64) * 2) + mapping_size;
+
+    if (size > limit) {
+        g_warning(ERR_TRANSFERS_EXCEEDS_LIMIT, size, limit);
+
+        return TRUE;
+    }
+
+    guint64 *transfers      = g_new0(guint64, (gsize) routes_count
+                                                      * row_words);
+    guint64 *transfers_back = g_new0(guint64, (gsize) routes_count
+                                                      * row_words);
+
+    const STOP_POSTING *postings = routes->postings;
+    const guint32      *offsets  = routes->offsets;
+
+    guint64 transfers_count = 0;
+
+    // Linking all the routes serving each bus stop to one another.
+    for (guint j = 0; j < routes->stop_ids_count; j++) {
+        guint32 end = routes->postings_offsets[j + 1];
+
+        for (guint32 k = routes->postings_offsets[j]; k < end; k++) {
+            guint32 from = postings[k].route;
+
+            // The first bus stop of a route cannot be got off at.
+            if (postings[k].position == 0) { continue; }
+
+            guint64 *row = transfers + ((gsize) from * row_words);
+
+            for (guint32 l = routes->postings_offsets[j]; l < end; l++) {
+                guint32 to = postings[l].route;
+
+                // The last bus stop of a route leads nowhere further.
+                if ((to == from) || ((postings[l].position + 1)
+                    >= (offsets[to + 1] - offsets[to]))) {
+
+                    continue;
+                }
+
+                guint64 bit = G_GUINT64_CONSTANT(1) << (to & 63);
+
+                if ((row[to >> 6] & bit) != 0) { continue; }
+
+                row[to >> 6] |= bit;
+
+                transfers_back[((gsize) to * row_words) + (from >> 6)]
+                    |= G_GUINT64_CONSTANT(1) << (from & 63);
+
+                transfers_count++;
+            }
+        }
+    }
+
+    routes->transfers_words = row_words;
+    routes->transfers       = transfers;
+    routes->transfers_back  = transfers_back;
+
+    g_message(       MSG_TRANSFERS_LINKED, routes_count, transfers_count);
+    syslog(LOG_INFO, MSG_TRANSFERS_LINKED, routes_count, transfers_count);
+
+    return TRUE;
+}
+
+// Helper function. Gets the last position of the bus stop on the route
+// given, out of the postings of the bus stop. Returns LABEL_NIL
+// if the bus stop isn't there.
+static guint32 _last_position(const STOP_POSTING *postings,
+                              const guint32       first,
+                              const guint32       last,
+                              const guint32       route) {
+
+    guint32 lo = first, hi = last;
+
+    // Looking for the first posting past the route.
+    while (lo < hi) {
+        guint32 mid = lo + ((hi - lo) >> 1);
+
+        if (postings[mid].route <= route) { lo = mid + 1; }
+        else                              { hi = mid;     }
+    }
+
+    if ((lo == first) || (postings[lo - 1].route != route)) {
+        return LABEL_NIL;
+    }
+
+    return postings[lo - 1].position;
+}
+
+// Helper function. Gets the bus stops index entries of the bus stops
+// of the route given, as mapped, or decompressed from the compressed
+// bus stops sequence (packed engine) and looked up in the index
+// into the buffer of the search, valid until the next call.
+static const guint32 *_get_route_stops(      _SEARCH *search,
+                                       const guint32  route) {
+
+    const ROUTES_STORE *routes = search->routes;
+
+    guint32 first = routes->offsets[route];
+
+    if (routes->stop_indices != NULL) { return routes->stop_indices + first; }
+
+    guint count = routes->offsets[route + 1] - first;
+
+    if (count > search->capacity) {
+        search->capacity = count;
+        search->stops    = g_renew(guint32, search->stops, count);
+    }
+
+    STOPS_CURSOR cursor;
+
+    open_stops(&cursor, routes->packed + routes->packed_offsets[route],
+        count);
+
+    for (guint k = 0; (k += unpack_stops(&cursor, search->stops + k))
+        < count;) {}
+
+    for (guint k = 0; k < count; k++) {
+        search->stops[k] = find_stop(routes, search->stops[k]);
+    }
+
+    return search->stops;
+}
+
+// Helper function. Counts the bits set in the word, bit-parallel:
+// __builtin_popcountll() needs libgcc at link time on CPUs without POPCNT.
+static inline guint _count_bits(guint64 word) {
+    word =  word - ((word >> 1) & G_GUINT64_CONSTANT(0x5555555555555555));
+    word = (word & G_GUINT64_CONSTANT(0x3333333333333333))
+        + ((word >> 2) & G_GUINT64_CONSTANT(0x3333333333333333));
+    word = (word + (word >> 4)) & G_GUINT64_CONSTANT(0x0f0f0f0f0f0f0f0f);
+
+    return (guint) ((word * G_GUINT64_CONSTANT(0x0101010101010101)) >> 56);
+}
+
+// Helper function. Checks whether the bit of the bitmap is set.
+static inline gboolean _is_set(const guint64 *bitmap, const guint32 bit) {
+    return (bitmap[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// Helper function. Sets the bit of the bitmap.
+static inline void _set(guint64 *bitmap, const guint32 bit) {
+    bitmap[bit >> 6] |= G_GUINT64_CONSTANT(1) << (bit & 63);
+}
+
+// Helper function. Searches the transfers graph backwards, level by level,
+// from the routes serving the ending bus stop point: the level `j` holds
+// all the routes the ending point can be reached from within `j` transfers
+// (as if routes could be got on anywhere). Each level is built for all
+// the routes at once, OR-ing whole rows of the transposed graph
+// for the routes newly reached. Stops at a level reaching too many routes
+// to bound anything, and returns the number of levels built.
+static guint _reach_back(const ROUTES_STORE *routes,
+                         const guint         depth,
+                               guint64      *levels) {
+
+    guint row_words = routes->transfers_words;
+
+    for (guint j = 1; j <= depth; j++) {
+        const guint64 *prev  = levels + ((gsize) (j - 1) * row_words);
+              guint64 *level = levels + ((gsize)  j      * row_words);
+
+        // Only the routes the previous level has added have new rows to OR.
+        const guint64 *seen = (j > 1) ? (prev - row_words) : NULL;
+
+        guint reached = 0;
+
+        for (guint w = 0; w < row_words; w++) {
+            reached += _count_bits(prev[w]);
+        }
+
+        if ((reached * TRANSFERS_DENSE) > routes->routes_count) {
+            return j - 1;
+        }
+
+        memcpy(level, prev, row_words * sizeof(guint64));
+
+        for (guint w = 0; w < row_words; w++) {
+            guint64 bits = prev[w] & ((seen != NULL) ? ~seen[w]
+                                                     : G_MAXUINT64);
+
+            while (bits != 0) {
+                guint route = (w << 6) + __builtin_ctzll(bits);
+
+                const guint64 *row = routes->transfers_back
+                                   + ((gsize) route * row_words);
+
+                for (guint v = 0; v < row_words; v++) { level[v] |= row[v]; }
+
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    return depth;
+}
+
+// Helper function. Boards the route at the position given, if it's not
+// boarded that early yet, labeling it as boarded by the label given.
+// A route already boarded in the current round keeps its label.
+static void _board(      _SEARCH *search,
+                   const guint32  route,
+                   const guint32  position,
+                   const guint32  parent,
+                   const guint32  alight,
+                   const guint    round_start) {
+
+    _LABEL label = { route, position, parent, alight };
+
+    guint32 *label_of = &search->label_of[route];
+
+    if ((search->best[route] != LABEL_NIL) && (*label_of >= round_start)) {
+        g_array_index(search->labels, _LABEL, *label_of) = label;
+    } else {
+        *label_of = search->labels->len;
+
+        g_array_append_val(search->labels, label);
+    }
+
+    search->best[route] = position;
+}
+
+// Helper function. Looks for a bus stop past the boarding one on any route
+// boarded in the round given, where a route going on to the ending bus stop
+// point can be transferred to. Returns the label of that route,
+// or LABEL_NIL if there is no such bus stop.
+static guint32 _transfer_to_end(      _SEARCH *search,
+                                const guint    start,
+                                const guint    end) {
+
+    const ROUTES_STORE *routes = search->routes;
+
+    for (guint l = start; l < end; l++) {
+        _LABEL label = g_array_index(search->labels, _LABEL, l);
+
+        guint32 count = routes->offsets[label.route + 1]
+                      - routes->offsets[label.route    ];
+
+        const guint32 *stops = _get_route_stops(search, label.route);
+
+        for (guint32 i = label.board + 1; i < count; i++) {
+            guint32 stop_idx = stops[i];
+
+            if (!_is_set(search->to_stops, stop_idx)) { continue; }
+
+            for (guint32 k = routes->postings_offsets[stop_idx];
+                k < routes->postings_offsets[stop_idx + 1]; k++) {
+
+                STOP_POSTING posting = routes->postings[k];
+
+                guint32 position = _last_position(routes->postings,
+                    search->to_first, search->to_last, posting.route);
+
+                if ((posting.route != label.route) && (position != LABEL_NIL)
+                    && (position > posting.position)) {
+
+                    _board(search, posting.route, posting.position, l, i,
+                        end);
+
+                    return search->labels->len - 1;
+                }
+            }
+        }
+    }
+
+    return LABEL_NIL;
+}
+
+// Helper function. Transfers from the routes boarded in the round given
+// at each bus stop past the boarding one, to the routes not yet boarded
+// as early as that, and allowed by the bound given (if any). Transfers
+// are made at each bus stop once per round, as it leads to the same routes.
+static void _transfer(      _SEARCH *search,
+                      const guint    start,
+                      const guint    end,
+                      const guint64 *allowed) {
+
+    const ROUTES_STORE *routes  = search->routes;
+    const guint32      *offsets = routes->offsets;
+
+    memset(search->seen, 0, ((routes->stop_ids_count + 63) / 64)
+                            * sizeof(guint64));
+
+    for (guint l = start; l < end; l++) {
+        _LABEL label = g_array_index(search->labels, _LABEL, l);
+
+        guint32 count = offsets[label.route + 1]
+                      - offsets[label.route    ];
+
+        const guint32 *stops = _get_route_stops(search, label.route);
+
+        for (guint32 i = label.board + 1; i < count; i++) {
+            guint32 stop_idx = stops[i];
+
+            if (_is_set(search->seen, stop_idx)) { continue; }
+
+            _set(search->seen, stop_idx);
+
+            for (guint32 k = routes->postings_offsets[stop_idx];
+                k < routes->postings_offsets[stop_idx + 1]; k++) {
+
+                guint32 route    = routes->postings[k].route;
+                guint32 position = routes->postings[k].position;
+
+                // The last bus stop of a route leads nowhere further.
+                if ((route == label.route)
+                    || (position >= search->best[route])
+                    || ((position + 1) >= (offsets[route + 1]
+                                         - offsets[route]))
+                    || ((allowed != NULL) && !_is_set(allowed, route))) {
+
+                    continue;
+                }
+
+                _board(search, route, position, l, i, end);
+            }
+        }
+    }
+}
+
+/**
+ * Finds the minimal number of transfers needed to get from one bus stop
+ * point to another, along with an itinerary that makes it, one leg
+ * per route ridden. Each round of the search boards new routes
+ * at the earliest bus stops they can be transferred to, from the routes
+ * boarded in the round before, so that the first round reaching
+ * the ending point gives the minimal number of transfers.
+ * <br />
+ * If the route-to-route transfers graph is there, it bounds the search:
+ * routes that cannot lead to the ending point within the transfers left
+ * (even if they could be got on at their first bus stops) are never
+ * boarded.
+ *
+ * @param routes The pointer to the routes structure. It has to be linked
+ *               with <code>link_routes()</code> beforehand, and transfers
+ *               shouldn't be turned off by that.
+ * @param from   The starting bus stop point.
+ * @param to     The ending   bus stop point.
+ * @param max    The maximum number of transfers allowed.
+ * @param legs   The array to put legs of the itinerary into
+ *               (at least <code>max + 1</code> elements).
+ *
+ * @return The minimal number of transfers
+ *         or <code>TRANSFERS_NOT_FOUND</code>, if there is no itinerary
+ *         within the maximum number of transfers.
+ */
+guint find_transfers(const ROUTES_STORE *routes,
+                     const guint32       from,
+                     const guint32       to,
+                     const guint         max,
+                           TRANSFER_LEG *legs) {
+
+    // Two bus stop points in a route cannot point up to the same value.
+    if (from == to) { return TRANSFERS_NOT_FOUND; }
+
+    guint from_idx = find_stop(routes, from);
+    guint to_idx   = find_stop(routes, to  );
+
+    if ((from_idx == STOP_NOT_FOUND) || (to_idx == STOP_NOT_FOUND)) {
+        return TRANSFERS_NOT_FOUND;
+    }
+
+    const STOP_POSTING *postings = routes->postings;
+    const guint32      *offsets  = routes->offsets;
+
+    guint routes_count = routes->routes_count;
+    guint row_words    = routes->transfers_words;
+    guint stop_words   = (routes->stop_ids_count + 63) / 64;
+
+    _SEARCH search = {
+        routes,
+        routes->postings_offsets[to_idx    ],
+        routes->postings_offsets[to_idx + 1],
+        NULL,
+        NULL,
+        g_new(guint32, routes_count),
+        g_new(guint32, routes_count),
+        g_array_new(FALSE, FALSE, sizeof(_LABEL)),
+        NULL,
+        0
+    };
+
+    memset(search.best, 0xff, routes_count * sizeof(guint32));
+
+    // Bounding the search by the levels of the transfers graph
+    // searched backwards from the ending bus stop point. The last transfer
+    // is made right to the routes serving the ending point, so it needs
+    // no bound.
+    guint64 *levels = NULL;
+    guint    depth  = 0;
+
+    if ((routes->transfers != NULL) && (max > 1)) {
+        levels = g_new0(guint64, (gsize) max * row_words);
+
+        for (guint32 k = search.to_first; k < search.to_last; k++) {
+            if (postings[k].position > 0) { _set(levels, postings[k].route); }
+        }
+
+        depth = _reach_back(routes, max - 1, levels);
+    }
+
+    // Boarding the routes serving the starting bus stop point
+    // (postings of a route go in the order of positions).
+    for (guint32 k = routes->postings_offsets[from_idx];
+        k < routes->postings_offsets[from_idx + 1]; k++) {
+
+        guint32 route    = postings[k].route;
+        guint32 position = postings[k].position;
+
+        if ((search.best[route] == LABEL_NIL)
+            && ((position + 1) < (offsets[route + 1] - offsets[route]))) {
+
+            _board(&search, route, position, LABEL_NIL, 0, 0);
+        }
+    }
+
+    guint   transfers = TRANSFERS_NOT_FOUND;
+    guint32 found     = LABEL_NIL;
+
+    // Looking for a direct route first.
+    for (guint l = 0; (l < search.labels->len) && (found == LABEL_NIL); l++) {
+        const _LABEL *label = &g_array_index(search.labels, _LABEL, l);
+
+        guint32 position = _last_position(postings, search.to_first,
+            search.to_last, label->route);
+
+        if ((position != LABEL_NIL) && (position > label->board)) {
+            found     = l;
+            transfers = 0;
+        }
+    }
+
+    if ((found == LABEL_NIL) && (max > 0)) {
+        search.to_stops = g_new0(guint64, stop_words);
+        search.seen     = g_new (guint64, stop_words);
+
+        // Marking the bus stops the ending point can be reached from
+        // directly.
+        for (guint32 k = search.to_first; k < search.to_last; k++) {
+            guint32 route = postings[k].route;
+
+            if ((k + 1 < search.to_last) && (postings[k + 1].route == route)) {
+                continue;
+            }
+
+            const guint32 *stops = _get_route_stops(&search, route);
+
+            for (guint32 i = 0; i < postings[k].position; i++) {
+                _set(search.to_stops, stops[i]);
+            }
+        }
+
+        guint start = 0;
+
+        for (guint j = 0; j < max; j++) {
+            guint end = search.labels->len;
+
+            if (start == end) { break; }
+
+            found = _transfer_to_end(&search, start, end);
+
+            if (found != LABEL_NIL) { transfers = j + 1; break; }
+
+            if ((j + 1) == max) { break; }
+
+            // Routes boarded next have to lead to the ending point
+            // within the transfers left, if it's known.
+            _transfer(&search, start, end, ((max - j - 1) <= depth)
+                ? (levels + ((gsize) (max - j - 1) * row_words)) : NULL);
+
+            start = end;
+        }
+    }
+
+    // Laying out the itinerary, from the last leg back to the first one.
+    if (transfers != TRANSFERS_NOT_FOUND) {
+        guint32 alight_stop = to;
+
+        for (guint32 l = found, leg = transfers + 1; l != LABEL_NIL;) {
+            const _LABEL *label = &g_array_index(search.labels, _LABEL, l);
+
+            legs[--leg].route = routes->route_ids[label->route];
+            legs[  leg].from  = routes->stop_ids[
+                _get_route_stops(&search, label->route)[label->board]];
+            legs[  leg].to    = alight_stop;
+
+            if (label->parent != LABEL_NIL) {
+                const _LABEL *parent = &g_array_index(search.labels, _LABEL,
+                    label->parent);
+
+                alight_stop = routes->stop_ids[
+                    _get_route_stops(&search, parent->route)[label->alight]];
+            }
+
+            l = label->parent;
+        }
+    }
+
+    g_array_free(search.labels, TRUE);
+    g_free(search.stops   );
+    g_free(search.label_of);
+    g_free(search.best    );
+    g_free(search.seen    );
+    g_free(search.to_stops);
+    g_free(levels);
+
+    return transfers;
+}
+
+// vim:set nu et ts=4 sw=4:
@@ -0,0 +1,255 @@
+/*
+ * src/bus-workload.c
+ * ============================================================================
+ * Urban bus routing microservice prototype (C port). Version 0.3.1
+ * ============================================================================
+ * A daemon written in C (GNOME/libsoup), designed and intended to be run
+ * as a microservice, implementing a simple urban bus routing prototype.
+ * ============================================================================
+ * Copyright (C) 2023-2026 Radislav (Radicchio) Golubtsov
+ *
+ * (See the LICENSE file at the top of the source tree.)
+ */
+
+// The synthetic workload module of benchmarks --------------------------------
+
+#include "busd.h"
+
+// Helper function. Draws a bus stop ID out of the universe of bus stops.
+// Bus stops are ranked by their popularity, following the Zipf-like
+// distribution with the skew given (0 is uniform), so that low IDs
+// become hubs shared by many routes. Ranks are drawn through
+// the inverse of the continuous distribution function.
+static guint32 _draw_stop(      GRand   *rand,
+                          const guint32  universe,
+                          const gdouble  skew) {
+
+    if (skew <= 0) { return g_rand_int_range(rand, 1, universe + 1); }
+
+    gdouble u = g_rand_double(rand);
+    gdouble n = (gdouble) universe + 1;
+
+    gdouble rank = (skew == 1) ? exp(u * log(n))
+        : pow(((pow(n, 1 - skew) - 1) * u) + 1, 1 / (1 - skew));
+
+    return (guint32) CLAMP(rank, 1, universe);
+}
+
+/**
+ * Generates a synthetic routes data store and writes it out,
+ * in the same format as the routes data store file. Bus stops of a route
+ * are all distinct, unless there are too few popular ones to draw from.
+ *
+ * @param stream          The output stream to write routes to.
+ * @param routes_count    The number of routes to generate.
+ * @param stops_per_route The number of bus stops in each route.
+ * @param universe        The number of distinct bus stop IDs to draw from.
+ * @param skew            The skew of the distribution of bus stops
+ *                        among routes (0 is uniform; the higher it is,
+ *                        the more routes share hub bus stops).
+ * @param seed            The seed of the random number generator.
+ * @param error           The pointer to a variable to put an error into.
+ *
+ * @return <code>TRUE</code> if the routes are written successfully,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean generate_routes(      GOutputStream  *stream,
+                         const guint           routes_count,
+                         const guint           stops_per_route,
+                         const guint32         universe,
+                         const gdouble         skew,
+                         const guint32         seed,
+                               GError        **error) {
+
+    GRand   *rand        = g_rand_new_with_seed(seed);
+    GString *routes_buff = g_string_sized_new(GEN_BUFF_SIZE + RESP_BUFF_SIZE);
+    guint32 *route       = g_new(guint32, stops_per_route);
+
+    gboolean is_written = TRUE;
+
+    for (guint i = 0; (i < routes_count) && is_written; i++) {
+        g_string_append_printf(routes_buff, UINT_FORMAT, (i + 1));
+
+        for (guint j = 0; j < stops_per_route; j++) {
+            guint k, tries = 0;
+
+            // Redrawing bus stops already visited by the route.
+            do {
+                route[j] = _draw_stop(rand, universe, skew);
+
+                for (k = 0; (k < j) && (route[k] != route[j]); k++);
+            } while ((k < j) && (++tries < GEN_MAX_TRIES));
+
+            g_string_append_printf(routes_buff, SPACE UINT_FORMAT, route[j]);
+        }
+
+        g_string_append_c(routes_buff, '\n');
+
+        // Writing routes out in batches.
+        if (routes_buff->len >= GEN_BUFF_SIZE) {
+            is_written = g_output_stream_write_all(stream, routes_buff->str,
+                routes_buff->len, NULL, NULL, error);
+
+            g_string_truncate(routes_buff, 0);
+        }
+    }
+
+    if (is_written && (routes_buff->len > 0)) {
+        is_written = g_output_stream_write_all(stream, routes_buff->str,
+            routes_buff->len, NULL, NULL, error);
+    }
+
+    g_free(route);
+    g_string_free(routes_buff, TRUE);
+    g_rand_free(rand);
+
+    return is_written;
+}
+
+// Helper function. Draws a query with a direct route: both bus stops
+// are taken from the same route, in order.
+static gboolean _draw_hit(      GRand        *rand,
+                          const ROUTES_STORE *routes,
+                                guint32      *from,
+                                guint32      *to) {
+
+    guint route = g_rand_int_range(rand, 0, routes->routes_count);
+    guint first = routes->offsets[route    ];
+    guint last  = routes->offsets[route + 1];
+
+    if ((last - first) < 2) { return FALSE; }
+
+    guint from_ = g_rand_int_range(rand, first,     last - 1);
+    guint to_   = g_rand_int_range(rand, from_ + 1, last    );
+
+    *from = routes->stops[from_];
+    *to   = routes->stops[to_  ];
+
+    return TRUE;
+}
+
+// Helper function. Draws a query with no direct route: two random
+// bus stops (taken from any routes) that are checked not to be connected.
+static gboolean _draw_miss(      GRand        *rand,
+                           const ROUTES_STORE *routes,
+                                 guint32      *from,
+                                 guint32      *to) {
+
+    *from = routes->stops[g_rand_int_range(rand, 0, routes->stops_count)];
+    *to   = routes->stops[g_rand_int_range(rand, 0, routes->stops_count)];
+
+    return !find_direct_route(routes, *from, *to);
+}
+
+/**
+ * Creates a workload of direct-route queries against the given routes,
+ * with the given share of queries having direct routes (hits), spread
+ * evenly over the workload. Hits take both bus stops from the same route,
+ * in order; misses take two random bus stops that aren't connected.
+ *
+ * @param routes    The pointer to the routes structure. It has to be set up
+ *                  with a direct-route engine.
+ * @param count     The number of queries to create.
+ * @param hit_ratio The share of queries having direct routes (0 .. 1).
+ * @param seed      The seed of the random number generator.
+ *
+ * @return The pointer to a newly allocated workload structure.
+ *         Should be freed with <code>free_workload()</code>.
+ */
+QUERY_WORKLOAD *new_workload(const ROUTES_STORE *routes,
+                             const guint         count,
+                             const gdouble       hit_ratio,
+                             const guint32       seed) {
+
+    QUERY_WORKLOAD *workload = g_new0(QUERY_WORKLOAD, 1);
+
+    workload->count = count;
+    workload->from  = g_new(guint32, count);
+    workload->to    = g_new(guint32, count);
+
+    GRand *rand = g_rand_new_with_seed(seed);
+
+    for (guint i = 0; i < count; i++) {
+        guint32 *from = &workload->from[i];
+        guint32 *to   = &workload->to  [i];
+
+        // An empty data store can only be queried for random bus stops.
+        if (routes->stops_count == 0) {
+            *from = g_rand_int_range(rand, 1, G_MAXINT32);
+            *to   = g_rand_int_range(rand, 1, G_MAXINT32);
+
+            continue;
+        }
+
+        gboolean is_hit = (guint64) ((i + 1) * hit_ratio)
+                        > (guint64) ( i      * hit_ratio);
+
+        // Giving up after a number of tries, if the routes are such
+        // that hits (or misses) are hard to come by.
+        guint tries = 0;
+
+        while (!(is_hit ? _draw_hit (rand, routes, from, to)
+                        : _draw_miss(rand, routes, from, to))
+               && (++tries < GEN_MAX_TRIES));
+    }
+
+    g_rand_free(rand);
+
+    return workload;
+}
+
+/**
+ * Writes the workload of queries out, one query per line:
+ * the starting and the ending bus stop points, separated by a space.
+ *
+ * @param stream   The output stream to write queries to.
+ * @param workload The pointer to the workload structure.
+ * @param error    The pointer to a variable to put an error into.
+ *
+ * @return <code>TRUE</code> if the queries are written successfully,
+ *         <code>FALSE</code> otherwise.
+ */
+gboolean write_workload(      GOutputStream   *stream,
+                        const QUERY_WORKLOAD  *workload,
+                              GError         **error) {
+
+    GString *queries_buff = g_string_sized_new(GEN_BUFF_SIZE + RESP_BUFF_SIZE);
+
+    gboolean is_written = TRUE;
+
+    for (guint i = 0; (i < workload->count) && is_written; i++) {
+        g_string_append_printf(queries_buff, UINT_FORMAT SPACE UINT_FORMAT
+            NEW_LINE, workload->from[i], workload->to[i]);
+
+        if (queries_buff->len >= GEN_BUFF_SIZE) {
+            is_written = g_output_stream_write_all(stream, queries_buff->str,
+                queries_buff->len, NULL, NULL, error);
+
+            g_string_truncate(queries_buff, 0);
+        }
+    }
+
+    if (is_written && (queries_buff->len > 0)) {
+        is_written = g_output_stream_write_all(stream, queries_buff->str,
+            queries_buff->len, NULL, NULL, error);
+    }
+
+    g_string_free(queries_buff, TRUE);
+
+    return is_written;
+}
+
+/**
+ * Frees the workload structure.
+ *
+ * @param workload The pointer to the workload structure.
+ */
+void free_workload(QUERY_WORKLOAD *workload) {
+    if (workload == NULL) { return; }
+
+    g_free(workload->to  );
+    g_free(workload->from);
+    g_free(workload);
+}
+
+// vim:set nu et ts=4 sw=4:
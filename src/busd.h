@@ -14,8 +14,23 @@
 #ifndef BUSD_H
 #define BUSD_H
 
+// Exposing POSIX/BSD extensions (like `SO_REUSEPORT`) hidden by C99.
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <syslog.h>
+#include <sys/socket.h> // <== Needs this for `SO_REUSEPORT`.
+#include <sys/un.h>     // <== Needs this for `struct sockaddr_un`.
+#include <sys/stat.h>   // <== Needs this for `lstat()` and `chmod()`.
+#include <unistd.h>     // <== Needs this for `chown()` and `unlink()`.
+#include <errno.h>      // <== Needs this for `errno`.
+#include <pwd.h>        // <== Needs this for `getpwnam()`.
+#include <grp.h>        // <== Needs this for `getgrnam()`.
+#include <netinet/in.h> // <== Needs this for `IPV6_V6ONLY`.
+#include <netinet/tcp.h> // <== Needs this for `TCP_NODELAY`.
+#include <sys/mman.h>   // <== Needs this for `posix_madvise()`.
+#include <time.h>       // <== Needs this for `clock_gettime()`.
+#include <math.h>       // <== Needs this for `pow()`.
 
 #define G_LOG_USE_STRUCTURED // <== To use structured logging.
 
@@ -44,11 +59,149 @@
 #define ERR_REQ_PARAMS_MUST_BE_POSITIVE_INTS "Request parameters must take " \
     "positive integer values, in the range 1 .. 2,147,483,647. " \
     "Please check your inputs."
+#define ERR_WORKERS_VALID_MUST_BE_POSITIVE_INT "Valid number of server " \
+    "workers must be a non-negative integer value, in the range 0 .. 256 " \
+    "(0 means one worker per CPU). The default value of 1 will be used " \
+    "instead."
+#define ERR_CANNOT_START_WORKER "Cannot start server worker: " LOG_FORMAT
+#define ERR_CANNOT_LISTEN_UNIX_SOCKET "Cannot listen on Unix domain " \
+    "socket " LOG_FORMAT ": " LOG_FORMAT
+#define ERR_UNIX_SOCKET_IN_USE "Unix domain socket is in use by another " \
+    "process"
+#define ERR_UNIX_SOCKET_NOT_SOCKET "File exists and is not a socket"
+#define ERR_UNIX_SOCKET_PATH_TOO_LONG "Path is too long"
+#define ERR_UNKNOWN_USER  "Unknown user: "  LOG_FORMAT
+#define ERR_UNKNOWN_GROUP "Unknown group: " LOG_FORMAT
+#define ERR_UNIX_SOCKET_MODE_VALID_MUST_BE_OCTAL "Valid Unix domain " \
+    "socket file mode must be an octal value, in the range 0 .. 0777. " \
+    "The default value of 0660 will be used instead."
+#define ERR_TABLE_EXCEEDS_LIMIT "Direct-route table would take %" \
+    G_GUINT64_FORMAT " bytes, which exceeds the memory limit of %" \
+    G_GUINT64_FORMAT " bytes. Falling back to the index engine..."
+#define ERR_TRANSFERS_EXCEEDS_LIMIT "Route transfers graph would take %" \
+    G_GUINT64_FORMAT " bytes, which exceeds the memory limit of %" \
+    G_GUINT64_FORMAT " bytes. Transfers will be searched without it..."
+#define ERR_TRANSFERS_INDEX_EXCEEDS_LIMIT "Bus stops index for transfers " \
+    "would take %" G_GUINT64_FORMAT " bytes, which exceeds the memory " \
+    "limit of %" G_GUINT64_FORMAT " bytes. Transfers are turned off..."
+#define ERR_REQ_MAX_TRANSFERS_MUST_BE_INT "Request parameter max must " \
+    "take a non-negative integer value, in the range 0 .. " \
+    G_STRINGIFY(MAX_TRANSFERS) ". Please check your inputs."
+#define ERR_REQ_LIMIT_MUST_BE_POSITIVE_INT "Request parameter limit " \
+    "must take a positive integer value, in the range 1 .. " \
+    "2,147,483,647. Please check your inputs."
+#define ERR_REACHABLE_EXCEEDS_LIMIT "Reachable bus stops sets would take " \
+    "more than the memory limit of %" G_GUINT64_FORMAT " bytes. " \
+    "Reachable bus stops are turned off..."
+#define ERR_BATCH_MUST_BE_ARRAY_OF_PAIRS "Request body must be a JSON " \
+    "array of bus stop pairs, given either as [from, to] arrays " \
+    "or as {from, to} objects, with positive integer values, " \
+    "in the range 1 .. 2,147,483,647. Please check your inputs."
+#define ERR_BATCH_TOO_LARGE "Request body must contain no more than " \
+    G_STRINGIFY(MAX_BATCH_PAIRS) " bus stop pairs, and take no more than " \
+    G_STRINGIFY(MAX_BATCH_BODY_SIZE) " bytes."
+#define ERR_ROUTES_LINES_SKIPPED "Routes data store: %u lines skipped, " \
+    "having bus stop (or route) IDs other than integer numbers " \
+    "in the range 1 .. 2,147,483,647."
+#define ERR_CANNOT_RELOAD_ROUTES "Cannot reload routes: data store " \
+    "file cannot be read. Keeping the current routes..."
+#define ERR_CANNOT_MONITOR_DATASTORE "Cannot monitor the data store " \
+    "file: " LOG_FORMAT
+#define ERR_CACHE_VALID_MUST_BE_POSITIVE_INT "Valid response cache " \
+    "capacity must be a non-negative integer value, in the range " \
+    "0 .. 1048576 (0 disables the cache). The cache will be disabled."
+#define ERR_LOG_BUFFER_VALID_MUST_BE_POSITIVE_INT "Valid log buffer " \
+    "size must be a positive integer value, in the range 1 .. 1048576. " \
+    "The default value of 4096 will be used instead."
+#define ERR_OFFLOAD_POOL_VALID_MUST_BE_POSITIVE_INT "Valid offload pool " \
+    "size must be a non-negative integer value, in the range 0 .. 256 " \
+    "(0 disables offloading). Offloading will be disabled."
+#define ERR_OFFLOAD_QUEUE_VALID_MUST_BE_POSITIVE_INT "Valid offload queue " \
+    "depth must be a positive integer value, in the range 1 .. 1048576. " \
+    "The default value of 1024 will be used instead."
+#define ERR_CANNOT_START_OFFLOAD_POOL "Cannot start offload pool: " \
+    LOG_FORMAT
+#define ERR_ADMISSION_VALID_MUST_BE_POSITIVE_INT "Valid admission " \
+    "control setting " LOG_FORMAT " must be a non-negative integer " \
+    "value. The default value of %u will be used instead."
+#define ERR_SLOW_REQUEST_VALID_MUST_BE_POSITIVE_INT "Valid slow request " \
+    "threshold must be a non-negative integer value (0 disables logging " \
+    "slow requests). Slow requests will not be logged."
+#define ERR_ACCESS_SAMPLE_RATE_MUST_BE_FRACTION "Valid access log " \
+    "sample rate must be a value in the range 0 .. 1. All requests " \
+    "will be logged instead."
+#define ERR_ACCESS_VALID_MUST_BE_POSITIVE_INT "Valid access log " \
+    "setting " LOG_FORMAT " must be a non-negative integer value. " \
+    "The default value of %u will be used instead."
+#define ERR_CANNOT_OPEN_ACCESS_LOG "Cannot open the access log file: " \
+    LOG_FORMAT ". Requests will not be logged."
+#define ERR_LOG_ENTRIES_DROPPED "Log entries dropped due to log buffer " \
+    "overflow: %u"
+#define ERR_SNAPSHOT_CORRUPTED "Routes snapshot is truncated or corrupted: " \
+    LOG_FORMAT
+#define ERR_SNAPSHOT_VERSION "Routes snapshot version %u is not supported " \
+    "(expected version %u)"
+#define ERR_SNAPSHOT_BYTE_ORDER "Routes snapshots can only be mapped " \
+    "on little-endian hosts"
+#define ERR_CANNOT_SAVE_SNAPSHOT "Cannot write routes snapshot: " LOG_FORMAT
+#define ERR_COMPILER_USAGE "Usage: busc <routes data store> <routes snapshot>"
+#define ERR_BENCH_USAGE "Usage: busbench [routes [stops per route " \
+    "[distinct bus stops [queries [seed]]]]]"
+#define ERR_LOAD_USAGE "Usage: busload [connections [seconds " \
+    "[routes data store]]]"
+#define ERR_CANNOT_WRITE_FILE "Cannot write " LOG_FORMAT ": " LOG_FORMAT
+#define ERR_CONNECTION_FAILED "Connection to the daemon on port %u " \
+    "failed: " LOG_FORMAT
 #define ERR_EADDRINUSE_CODE 33
 
 // Common notification messages.
+#define MSG_ROUTES_ENGINE  "Direct-route engine: " LOG_FORMAT
+#define MSG_SIMD_KERNEL    "Direct-route engine: " ENGINE_SIMD_NAME \
+    " (" LOG_FORMAT ")"
+#define MSG_ROUTES_PACKED  "Direct-route engine: " ENGINE_PACKED_NAME \
+    " (%u bus stops in %" G_GSIZE_FORMAT " bytes)"
+#define MSG_TRANSFERS_LINKED "Route transfers graph: %u routes, %" \
+    G_GUINT64_FORMAT " transfers"
+#define MSG_STOPS_REACHED "Reachable bus stops sets: %u bus stops, %" \
+    G_GUINT64_FORMAT " reachable bus stops in %" G_GSIZE_FORMAT " bytes"
+#define MSG_ROUTES_LOADED  "Routes loaded: %u routes, %u bus stops " \
+    "(snapshot %u)"
+#define MSG_ROUTES_PRUNED  "Routes pruned: %u duplicate and %u dominated " \
+    "routes removed, %u routes left"
+#define MSG_ROUTES_COMPILED "Routes compiled: %u routes, %u bus stops, " \
+    "%u distinct bus stops"
+#define MSG_CACHE_STATS "Response cache: %" G_GUINT64_FORMAT " hits, %" \
+    G_GUINT64_FORMAT " misses (hit rate %.1f%%), %" G_GUINT64_FORMAT \
+    " evictions, %" G_GUINT64_FORMAT " invalidations"
 #define MSG_SERVER_STARTED "Server started on port %u"
+#define MSG_UNIX_SOCKET_STARTED "Server started on Unix domain socket " \
+    LOG_FORMAT
+#define MSG_WORKERS_STARTED "Server workers started: %u"
+#define MSG_OFFLOAD_STARTED "Offload pool started: %u threads, " \
+    "queue depth %u"
+#define MSG_ADMISSION_ENABLED "Admission control: %u requests in flight, " \
+    "%u ms of queue wait (0 means no limit)"
+#define MSG_TRACING_ENABLED "Request tracing: Server-Timing header %s, " \
+    "requests slower than %u ms logged (0 means none)"
+#define MSG_SLOW_REQUEST "Slow request: " LOG_FORMAT " (status %u): " \
+    LOG_FORMAT
+#define MSG_ACCESS_LOG_ENABLED "Access log: %.3f of requests sampled, " \
+    "%u per second at most, in bursts of %u (0 means no limit)"
+#define MSG_ACCESS_LOG_CLOSED "Access log: %u requests logged, " \
+    "%u over the rate limit, %u dropped due to log buffer overflow"
 #define MSG_SERVER_STOPPED "Server stopped"
+#define MSG_BENCH_ROUTES "Benchmarking %u routes, %u bus stops, " \
+    "%u queries"
+#define MSG_BENCH_HEADER "%-8s %12s %12s %12s %12s %10s\n"
+#define MSG_BENCH_RESULT "%-8s %12.1f %12" G_GUINT64_FORMAT " %12" \
+    G_GUINT64_FORMAT " %12.2f %10u\n"
+#define MSG_ROUTES_GENERATED "Routes generated: %u routes, %u bus stops, " \
+    "%u distinct bus stops, %u queries"
+#define MSG_LOAD_STARTED "Loading the daemon on port %u: %u connections, " \
+    "%u seconds"
+#define MSG_LOAD_RESULT "%" G_GUINT64_FORMAT " requests (%" \
+    G_GUINT64_FORMAT " failed) in %.2f s: %.1f requests/s\n" \
+    "Latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n"
 
 /** The path and filename of the daemon settings. */
 #define SETTINGS "./etc/settings.conf"
@@ -65,22 +218,229 @@
 /** The default server port number. */
 #define DEF_PORT 8080
 
+/** The default number of server workers. */
+#define DEF_WORKERS 1
+
+/** The maximum number of server workers allowed. */
+#define MAX_WORKERS 256
+
+// Default parameters of the synthetic network of the micro-benchmark.
+#define DEF_BENCH_ROUTES          1000
+#define DEF_BENCH_STOPS_PER_ROUTE 50
+#define DEF_BENCH_UNIVERSE        100000
+#define DEF_BENCH_QUERIES         100000
+#define DEF_BENCH_SEED            1
+#define DEF_BENCH_SKEW            0.0
+#define DEF_BENCH_HIT_RATIO       0.5
+
+// Default parameters of the synthetic routes data store generator.
+#define DEF_GEN_ROUTES          100000
+#define DEF_GEN_STOPS_PER_ROUTE 50
+#define DEF_GEN_UNIVERSE        1000000
+#define DEF_GEN_SKEW            0.8
+#define DEF_GEN_QUERIES         100000
+#define DEF_GEN_HIT_RATIO       0.5
+#define DEF_GEN_SEED            1
+
+// Command-line options of the synthetic routes data store generator.
+#define GEN_USAGE "<routes data store> <query workload>"
+#define GEN_OPT_N "N"
+#define GEN_OPT_X "X"
+#define GEN_OPT_ROUTES         "routes"
+#define GEN_OPT_ROUTES_HELP    "The number of routes (default: " \
+    G_STRINGIFY(DEF_GEN_ROUTES) ")"
+#define GEN_OPT_STOPS          "stops"
+#define GEN_OPT_STOPS_HELP     "The number of bus stops per route " \
+    "(default: " G_STRINGIFY(DEF_GEN_STOPS_PER_ROUTE) ")"
+#define GEN_OPT_UNIVERSE       "universe"
+#define GEN_OPT_UNIVERSE_HELP  "The number of distinct bus stop IDs " \
+    "to draw from (default: " G_STRINGIFY(DEF_GEN_UNIVERSE) ")"
+#define GEN_OPT_SKEW           "skew"
+#define GEN_OPT_SKEW_HELP      "The skew of bus stops shared by routes: " \
+    "0 is uniform, 1 and more make a few hubs (default: " \
+    G_STRINGIFY(DEF_GEN_SKEW) ")"
+#define GEN_OPT_QUERIES        "queries"
+#define GEN_OPT_QUERIES_HELP   "The number of queries (default: " \
+    G_STRINGIFY(DEF_GEN_QUERIES) ")"
+#define GEN_OPT_HIT_RATIO      "hit-ratio"
+#define GEN_OPT_HIT_RATIO_HELP "The share of queries having direct " \
+    "routes, 0 .. 1 (default: " G_STRINGIFY(DEF_GEN_HIT_RATIO) ")"
+#define GEN_OPT_SEED           "seed"
+#define GEN_OPT_SEED_HELP      "The seed of the random number generator " \
+    "(default: " G_STRINGIFY(DEF_GEN_SEED) ")"
+
+/** The size of a batch of lines written out at once by the generator. */
+#define GEN_BUFF_SIZE 65536
+
+/** The number of tries to draw a distinct bus stop, a hit, or a miss. */
+#define GEN_MAX_TRIES 64
+
+// Default parameters of the HTTP load generator.
+#define DEF_LOAD_CONNECTIONS 16
+#define DEF_LOAD_SECONDS     10
+#define DEF_LOAD_QUERIES     65536
+
+/** The size of a buffer to receive HTTP responses into. */
+#define LOAD_BUFF_SIZE 4096
+
+/** The value returned by the bus stops index lookup for an unknown stop. */
+#define STOP_NOT_FOUND G_MAXUINT
+
 // Daemon settings keys for the server port number.
-#define SERVER_GROUP "Server"
-#define SERVER_PORT  "port"
+#define SERVER_GROUP   "Server"
+#define SERVER_PORT    "port"
+#define SERVER_WORKERS "workers"
+#define UNIX_SOCKET_PATH  "unix.socket.path"
+#define UNIX_SOCKET_MODE  "unix.socket.mode"
+#define UNIX_SOCKET_OWNER "unix.socket.owner"
+#define UNIX_SOCKET_ONLY  "unix.socket.only"
 
 // Daemon settings keys for the logger.
 #define LOGGER_GROUP "Logger"
 #define LOG_ENABLED  "debug.enabled"
+#define LOG_BUFFER   "async.buffer.size"
+#define LOG_OVERFLOW_POLICY "async.overflow"
+
+// Names of the log buffer overflow policies to be used in daemon settings.
+#define LOG_OVERFLOW_DROP_NAME  "drop"
+#define LOG_OVERFLOW_BLOCK_NAME "block"
+
+// Daemon settings keys for the access log.
+#define ACCESS_GROUP       "AccessLog"
+#define ACCESS_ENABLED     "enabled"
+#define ACCESS_SAMPLE_RATE "sample.rate"
+#define ACCESS_RATE_LIMIT  "rate.limit"
+#define ACCESS_RATE_BURST  "rate.burst"
+
+// Daemon settings keys for the response cache.
+#define CACHE_GROUP    "Cache"
+#define CACHE_CAPACITY "capacity"
+
+// Daemon settings keys for the offload pool.
+#define OFFLOAD_GROUP       "Offload"
+#define OFFLOAD_POOL_SIZE   "pool.size"
+#define OFFLOAD_QUEUE_DEPTH "queue.depth"
+
+// Daemon settings keys for the request tracing.
+#define TRACING_GROUP  "Tracing"
+#define SERVER_TIMING  "server.timing"
+#define SLOW_THRESHOLD "slow.request.threshold"
+
+// Daemon settings keys for the admission control.
+#define ADMISSION_GROUP "Admission"
+#define MAX_IN_FLIGHT   "max.in.flight"
+#define MAX_QUEUE_WAIT  "max.queue.wait"
+#define RETRY_AFTER     "retry.after"
 
 // Daemon settings keys for the routes data store.
 #define ROUTES_GROUP "Routes"
 #define PATH_PREFIX  "datastore.path.prefix"
 #define PATH_DIR     "datastore.path.dir"
 #define FILENAME     "datastore.filename"
+#define MONITOR      "datastore.monitor"
+#define PRUNE        "datastore.prune"
+#define ENGINE       "engine"
+#define TABLE_LIMIT  "engine.table.memory.limit"
+#define TRANSFERS_LIMIT "transfers.memory.limit"
+#define REACHABLE_LIMIT "reachable.memory.limit"
+
+// Names of the direct-route engines to be used in daemon settings.
+#define ENGINE_SCAN_NAME   "scan"
+#define ENGINE_INDEX_NAME  "index"
+#define ENGINE_TABLE_NAME  "table"
+#define ENGINE_SIMD_NAME   "simd"
+#define ENGINE_PACKED_NAME "packed"
+
+// Names of the bus stops search kernels of the SIMD engine.
+#define SIMD_KERNEL_AVX2   "avx2"
+#define SIMD_KERNEL_SSE2   "sse2"
+#define SIMD_KERNEL_SCALAR "scalar"
+
+/** The default file mode of the Unix domain socket file. */
+#define DEF_UNIX_SOCKET_MODE 0660
+
+/**
+ * The default memory limit (in MiB) for the precomputed table
+ * of directly connected bus stops.
+ */
+#define DEF_TABLE_LIMIT 64
+
+/**
+ * The default memory limit (in MiB) for the precomputed route-to-route
+ * transfers graph.
+ */
+#define DEF_TRANSFERS_LIMIT 64
+
+/**
+ * The default memory limit (in MiB) for the precomputed sets of bus stops
+ * reachable directly from each bus stop.
+ */
+#define DEF_REACHABLE_LIMIT 64
+
+/** The default maximum number of transfers in a transfers request. */
+#define DEF_MAX_TRANSFERS 2
+
+/** The maximum number of transfers allowed in a transfers request. */
+#define MAX_TRANSFERS 4
+
+/** The value returned by the transfers search when there is no itinerary. */
+#define TRANSFERS_NOT_FOUND G_MAXUINT
+
+/**
+ * The minimum size (in bytes) of a chunk of the routes data store
+ * worth parsing in a thread of its own.
+ */
+#define PARSE_CHUNK_SIZE 1048576
+
+/** The minimum number of bus stops worth indexing in a thread of its own. */
+#define INDEX_SLICE_SIZE 262144
+
+/** The number of bus stops per block of compressed routes. */
+#define PACK_BLOCK_SIZE 16
+
+/** The maximum number of threads parsing and indexing routes. */
+#define MAX_LOAD_THREADS 64
+
+/** The maximum number of threads in the offload pool. */
+#define MAX_OFFLOAD_POOL_SIZE 256
+
+/**
+ * The default number of direct-route lookups allowed to wait
+ * in the offload pool queue.
+ */
+#define DEF_OFFLOAD_QUEUE_DEPTH 1024
+
+/**
+ * The maximum number of direct-route lookups allowed to wait
+ * in the offload pool queue.
+ */
+#define MAX_OFFLOAD_QUEUE_DEPTH 1048576
+
+/**
+ * The default number of seconds clients are told to wait before retrying
+ * requests shed by the admission control.
+ */
+#define DEF_RETRY_AFTER 1
+
+// The routes snapshot format identification.
+#define SNAPSHOT_MAGIC   "BUSSNAP"
+#define SNAPSHOT_VERSION 1
+
+/**
+ * The maximum number of bus stop pairs the response cache
+ * of a server worker is allowed to hold.
+ */
+#define MAX_CACHE_CAPACITY 1048576
+
+/** The LRU list link value meaning "no cache entry". */
+#define CACHE_NIL G_MAXUINT32
+
+/** The bit of a cache key holding the cached direct-route lookup result. */
+#define CACHE_DIRECT (G_GUINT64_CONSTANT(1) << 63)
 
 #define LOG_DIR "./log/"
 #define LOGFILE "bus.log"
+#define ACCESS_LOGFILE "access.log"
 
 #define LOG_KEY_MESSAGE "MESSAGE"
 
@@ -88,48 +448,635 @@
 #define LOG_LEVEL_DEBUG "DEBUG"
 #define LOG_LEVEL_INFO  "INFO"
 
+/** The default number of entries in the log buffer. */
+#define DEF_LOG_BUFFER_SIZE 4096
+
+/** The maximum number of entries in the log buffer. */
+#define MAX_LOG_BUFFER_SIZE 1048576
+
+/** The maximum length of the text of a log entry (longer ones get cut). */
+#define LOG_SLOT_SIZE 512
+
+/** The size of the timestamp prefix of log lines. */
+#define LOG_PREFIX_SIZE 32
+
+/** The maximum length of a log line, including its prefixes. */
+#define LOG_LINE_SIZE (LOG_PREFIX_SIZE + 16 + LOG_SLOT_SIZE)
+
+/** The size of a batch of log lines written out at once. */
+#define LOG_BATCH_SIZE 65536
+
+/** The maximum interval (in microseconds) between log buffer flushes. */
+#define LOG_FLUSH_INTERVAL 10000
+
+/**
+ * The maximum length of the request path (escaped) in access log lines,
+ * so that they never get cut.
+ */
+#define ACCESS_PATH_SIZE 256
+
+/** The maximum length of the request method in access log lines. */
+#define ACCESS_METHOD_SIZE 16
+
+/** The size of a buffer to render a bus stop ID into. */
+#define ACCESS_STOP_SIZE 16
+
+// The access log line format (JSON Lines): the time (Unix time
+// in milliseconds), method, path, bus stop IDs, status, lookup result,
+// duration (in milliseconds), and response body size (in bytes).
+#define ACCESS_LINE_FORMAT "{\"time\":%" G_GINT64_FORMAT ",\"method\":" \
+    "\"%s\",\"path\":\"%s\",\"from\":%s,\"to\":%s,\"status\":%u," \
+    "\"result\":%s,\"duration\":%.3f,\"bytes\":%" G_GOFFSET_FORMAT "}"
+
 #define DTM_FORMAT "%02u"
 #define LOG_FORMAT "%s"
 #define INT_FORMAT "%d"
+#define UINT_FORMAT "%u"
+
+#define LOG_PREFIX_FORMAT "[" DTM_FORMAT "-" DTM_FORMAT "-" DTM_FORMAT \
+                         "][" DTM_FORMAT ":" DTM_FORMAT ":" DTM_FORMAT "]"
 
 // Allowed HTTP methods.
 #define HTTP_HEAD "HEAD"
 #define HTTP_GET  "GET"
+#define HTTP_POST "POST"
 
 // REST URI path-related constants.
 #define REST_PREFIX "route"
 #define REST_DIRECT "direct"
+#define REST_BATCH  "batch"
+#define REST_METRICS "metrics"
+#define REST_TRANSFERS "transfers"
+#define REST_REACHABLE "reachable"
 
 // HTTP response-related constants.
 #define MIME_TYPE                "application/json"
+#define MIME_TYPE_METRICS        "text/plain; version=0.0.4; charset=utf-8"
 #define HDR_SERVER_P             "server-header"
 #define HDR_ALLOW_N              "Allow"
 #define HDR_ALLOW_V              "GET, HEAD"
+#define HDR_ALLOW_V_BATCH        "POST"
+#define HDR_RETRY_AFTER_N        "Retry-After"
+#define HDR_SERVER_TIMING_N      "Server-Timing"
+
+// Soup web server signals.
+#define REQUEST_STARTED "request-started"
+#define GOT_HEADERS     "got-headers"
+#define GOT_CHUNK       "got-chunk"
+#define WROTE_CHUNK     "wrote-chunk"
 #define ERROR_JSON_KEY           "error"
 #define ERROR_JSON_VAL_NOT_FOUND "404 Not Found."
+#define ERROR_JSON_VAL_UNAVAILABLE "503 Service Unavailable. " \
+    "The server is overloaded, please retry later."
 
-// HTTP request parameter names.
-#define FROM "from"
-#define TO   "to"
+// Prerendered response bodies and templates, to avoid building
+// JSON objects on every request.
+#define JSON_TRUE  "true"
+#define JSON_FALSE "false"
+#define RESP_NOT_FOUND     "{\"" ERROR_JSON_KEY "\":\"" \
+    ERROR_JSON_VAL_NOT_FOUND "\"}"
+#define RESP_UNAVAILABLE   "{\"" ERROR_JSON_KEY "\":\"" \
+    ERROR_JSON_VAL_UNAVAILABLE "\"}"
+#define RESP_BAD_REQUEST   "{\"" ERROR_JSON_KEY "\":\"" \
+    ERR_REQ_PARAMS_MUST_BE_POSITIVE_INTS "\"}"
+#define RESP_BATCH_MALFORMED "{\"" ERROR_JSON_KEY "\":\"" \
+    ERR_BATCH_MUST_BE_ARRAY_OF_PAIRS "\"}"
+#define RESP_BATCH_TOO_LARGE "{\"" ERROR_JSON_KEY "\":\"" \
+    ERR_BATCH_TOO_LARGE "\"}"
+#define RESP_DIRECT_FORMAT "{\"" FROM "\":%u,\"" TO "\":%u,\"" \
+    REST_DIRECT "\":%s}"
+#define RESP_BAD_MAX_TRANSFERS "{\"" ERROR_JSON_KEY "\":\"" \
+    ERR_REQ_MAX_TRANSFERS_MUST_BE_INT "\"}"
+#define JSON_NULL "null"
+#define RESP_TRANSFERS_FORMAT "{\"" FROM "\":%u,\"" TO "\":%u,\"" \
+    REST_TRANSFERS "\":"
+#define RESP_ITINERARY "\"" ITINERARY "\":["
+#define RESP_LEG_FORMAT "{\"" ROUTE "\":%u,\"" FROM "\":%u,\"" TO "\":%u}"
+#define RESP_BAD_LIMIT "{\"" ERROR_JSON_KEY "\":\"" \
+    ERR_REQ_LIMIT_MUST_BE_POSITIVE_INT "\"}"
+#define RESP_REACHABLE_FORMAT "{\"" FROM "\":%u,\"" REST_REACHABLE "\":["
 
-/**
- * The regex pattern for the element to be excluded from a bus stops sequence:
- * it is an arbitrary identifier of a route, which is not used
- * in the routes processing anyhow.
- */
-#define ROUTE_ID_REGEX "^\\d+"
+/** The maximum number of bus stop pairs in a batch request. */
+#define MAX_BATCH_PAIRS 10000
 
 /**
- * The regex pattern for the leading part of a bus stops sequence,
- * before the matching element.
+ * The maximum size (in bytes) of the body of a batch request:
+ * 64 bytes per bus stop pair, as many pairs as allowed.
  */
-#define SEQ1_REGEX ".*\\s"
+#define MAX_BATCH_BODY_SIZE 640000
+
+/** The size of a buffer to render response bodies into. */
+#define RESP_BUFF_SIZE 128
+
+/** The size of a chunk of streamed response bodies. */
+#define RESP_CHUNK_SIZE 16384
+
+/** The size of a buffer to render request phase timings into. */
+#define SERVER_TIMING_SIZE 256
+
+// The request phase timing format of the Server-Timing header
+// (durations are in milliseconds).
+#define SERVER_TIMING_FORMAT "%s%s;dur=%.3f"
+#define SERVER_TIMING_SEP    ", "
+#define SERVER_TIMING_TOTAL  "total"
+
+/** The initial size of a buffer to render metrics into. */
+#define METRICS_BUFF_SIZE 4096
 
 /**
- * The regex pattern for the trailing part of a bus stops sequence,
- * after the matching element.
+ * The number of latency histogram buckets. Bucket bounds are powers
+ * of two (in nanoseconds), starting from 2^HIST_MIN_SHIFT,
+ * i.e. 256 ns .. ~2.1 s.
  */
-#define SEQ2_REGEX "\\s.*"
+#define HIST_BUCKETS   24
+#define HIST_MIN_SHIFT 8
+
+/** The number of HTTP status codes requests are counted by (+ others). */
+#define STATUS_CODES 6
+
+// Single-writer metrics: each server worker updates its own ones only,
+// by relaxed atomic loads and stores (plain moves on x86-64, with no bus
+// locking), while the /metrics handler reads them from any worker.
+#define METRIC_GET(metric) __atomic_load_n(&(metric), __ATOMIC_RELAXED)
+#define METRIC_ADD(metric, value) __atomic_store_n(&(metric), \
+    METRIC_GET(metric) + (value), __ATOMIC_RELAXED)
+
+// Metrics names, help texts, and their Prometheus text exposition format.
+#define METRIC_REQUESTS "busd_http_requests_total"
+#define METRIC_REQUESTS_HELP "HTTP requests handled, by status code."
+#define METRIC_SHED "busd_http_requests_shed_total"
+#define METRIC_SHED_HELP "HTTP requests shed by the admission control, " \
+    "by reason."
+#define METRIC_REQUEST_DURATION "busd_http_request_duration_seconds"
+#define METRIC_REQUEST_DURATION_HELP "Time spent in the request handler."
+#define METRIC_LOOKUP_DURATION "busd_direct_route_lookup_duration_seconds"
+#define METRIC_LOOKUP_DURATION_HELP "Time spent in direct-route lookups " \
+    "(response cache misses only)."
+#define METRIC_ROUTES "busd_routes"
+#define METRIC_ROUTES_HELP "Routes loaded."
+#define METRIC_STOPS "busd_bus_stops"
+#define METRIC_STOPS_HELP "Bus stops in all routes loaded."
+#define METRIC_STOPS_INDEXED "busd_bus_stops_indexed"
+#define METRIC_STOPS_INDEXED_HELP "Distinct bus stops indexed."
+#define METRIC_SNAPSHOT "busd_routes_snapshot"
+#define METRIC_SNAPSHOT_HELP "The number of the current snapshot of routes."
+#define METRIC_LOAD_DURATION "busd_datastore_load_duration_seconds"
+#define METRIC_LOAD_DURATION_HELP "Time spent loading (parsing or mapping) " \
+    "the routes data store."
+#define METRIC_INDEX_DURATION "busd_datastore_index_duration_seconds"
+#define METRIC_INDEX_DURATION_HELP "Time spent building what " \
+    "the direct-route engine needs."
+
+#define METRICS_TYPE_COUNTER   "counter"
+#define METRICS_TYPE_GAUGE     "gauge"
+#define METRICS_TYPE_HISTOGRAM "histogram"
+
+#define METRICS_HELP_FORMAT  "# HELP %s %s\n"
+#define METRICS_TYPE_FORMAT  "# TYPE %s %s\n"
+#define METRICS_VALUE_FORMAT "%s %.9g\n"
+#define METRICS_CODE_FORMAT  "%s{code=\"%u\"} %" G_GUINT64_FORMAT "\n"
+#define METRICS_REASON_FORMAT "%s{reason=\"%s\"} %" G_GUINT64_FORMAT "\n"
+#define METRICS_OTHER_CODE_FORMAT "%s{code=\"other\"} %" \
+    G_GUINT64_FORMAT "\n"
+#define METRICS_BUCKET_FORMAT "%s_bucket{le=\"%.9g\"} %" \
+    G_GUINT64_FORMAT "\n"
+#define METRICS_INF_BUCKET_FORMAT "%s_bucket{le=\"+Inf\"} %" \
+    G_GUINT64_FORMAT "\n"
+#define METRICS_SUM_FORMAT   "%s_sum %.9g\n"
+#define METRICS_COUNT_FORMAT "%s_count %" G_GUINT64_FORMAT "\n"
+
+// HTTP request parameter names.
+#define FROM "from"
+#define TO   "to"
+#define MAX_ "max"
+#define LIMIT "limit"
+
+// HTTP response field names.
+#define ITINERARY "itinerary"
+#define ROUTE     "route"
+
+// The structure to hold a single entry of the bus stops index:
+// a route that serves a bus stop, and the position of that stop
+// in the route.
+typedef struct {
+    guint32 route;
+    guint32 position;
+} STOP_POSTING;
+
+// Reload states of the routes data store.
+typedef enum {
+    RELOAD_IDLE,      // No reload is in progress.
+    RELOAD_RUNNING,   // A reload is in progress.
+    RELOAD_PENDING    // Another reload has been requested meanwhile.
+} RELOAD_STATE;
+
+// Direct-route engines.
+typedef enum {
+    ENGINE_SCAN,  // Scans bus stops sequences of all routes.
+    ENGINE_INDEX, // Merges postings from the bus stops index.
+    ENGINE_TABLE, // Looks up the precomputed table of bus stop pairs.
+    ENGINE_SIMD,  // Scans all bus stops at once, in SIMD vectors.
+    ENGINE_PACKED // Scans compressed bus stops sequences of all routes.
+} ROUTES_ENGINE;
+
+// The function searching for a bus stop in an array of bus stops.
+// Returns the index of its first occurrence, or the array size,
+// if there is none.
+typedef gsize (*STOP_SEARCH)(const guint32 *, const gsize, const guint32);
+
+// The header of a routes snapshot: a binary image of the routes structure
+// (along with its bus stops index), compiled from the routes data store
+// by the `busc` tool. All fields are stored in little-endian byte order.
+// The header is followed by the arrays `route_ids`, `offsets`, `stops`,
+// `stop_ids`, `postings_offsets`, and `postings`, in that order,
+// which are mapped into memory as is.
+typedef struct {
+    gchar   magic[8];       // SNAPSHOT_MAGIC, NUL-padded.
+    guint32 version;        // SNAPSHOT_VERSION.
+    guint32 routes_count;   // The number of routes.
+    guint32 stops_count;    // The number of bus stops in all routes.
+    guint32 stop_ids_count; // The number of distinct bus stops.
+    guint64 data_size;      // The size of the arrays following the header.
+    guint8  checksum[32];   // The SHA-256 digest of the arrays.
+} SNAPSHOT_HEADER;
+
+// The structure to hold all available routes, parsed from the routes
+// data store. Bus stops of all routes are laid out contiguously
+// in the `stops` array; the stops of the route `i` are located
+// at indices `offsets[i]` .. `offsets[i + 1] - 1`.
+//
+// The (optional) bus stops index maps each distinct bus stop ID
+// `stop_ids[j]` to the list of its postings, located at indices
+// `postings_offsets[j]` .. `postings_offsets[j + 1] - 1`
+// of the `postings` array, and sorted by route.
+//
+// The (optional) table of directly connected bus stop pairs is either
+// a sorted array of `(from << 32) | to` keys, or a bitmap of
+// `stop_ids_count` rows by `table_row_words` 64-bit words, where the bit
+// `(j, k)` is set if the stop `stop_ids[k]` follows `stop_ids[j]`.
+//
+// The (optional) route-to-route transfers graph is a bitmap of
+// `routes_count` rows by `transfers_words` 64-bit words, where the bit
+// `(i, j)` is set if the route `j` can be got on at a bus stop where
+// the route `i` can be got off; `transfers_back` is its transpose.
+//
+// The (optional) compressed bus stops sequences replace the `stops` array
+// with the packed engine: the stops of the route `i` are located at bytes
+// `packed_offsets[i]` .. `packed_offsets[i + 1] - 1` of the `packed` array.
+// The first stop of a route is stored as is, then the zigzag-encoded
+// differences between consecutive stops follow, bit-packed in blocks
+// of `PACK_BLOCK_SIZE`, each block prefixed by its width in bits.
+//
+// The (optional) sets of bus stops reachable directly from each bus stop
+// are compressed the same way: the sorted bus stops index entries
+// of the stops following `stop_ids[j]` on any route are located at bytes
+// `reachable_offsets[j]` .. `reachable_offsets[j + 1] - 1`
+// of the `reachable` array, `reachable_counts[j]` of them.
+typedef struct {
+    gint          ref_count;        // The number of references held.
+    guint         generation;       // The (1-based) number of the snapshot.
+    ROUTES_ENGINE engine;           // The direct-route engine to be used.
+    guint         routes_count;     // The number of routes.
+    guint         stops_count;      // The number of bus stops in all routes.
+    guint32      *route_ids;        // Route IDs   (routes_count     elements).
+    guint32      *offsets;          // Route starts (routes_count + 1 elements).
+    guint32      *stops;            // Bus stop IDs (stops_count      elements).
+    guint         stop_ids_count;   // The number of distinct bus stops.
+    guint32      *stop_ids;         // Sorted distinct bus stop IDs.
+    guint32      *postings_offsets; // Postings starts (stop_ids_count + 1).
+    STOP_POSTING *postings;         // Postings (stops_count elements).
+    gsize         table_count;      // The number of table keys.
+    guint64      *table;            // Sorted table keys.
+    guint         table_row_words;  // The number of words per bitmap row.
+    guint64      *table_bitmap;     // Bitmap table rows.
+    guint32      *stop_indices;     // Bus stops index entries of stops.
+    gboolean      transferable;     // Whether transfers can be searched.
+    guint         transfers_words;  // The number of words per graph row.
+    guint64      *transfers;        // Transfers graph rows.
+    guint64      *transfers_back;   // Transposed transfers graph rows.
+    GMappedFile  *mapped;           // The routes snapshot mapping (if any).
+    STOP_SEARCH   search_stop;      // The bus stops search kernel (SIMD).
+    gsize         packed_size;      // The size of compressed sequences.
+    guint8       *packed;           // Compressed bus stops sequences.
+    gsize        *packed_offsets;   // Sequence starts (routes_count + 1).
+    guint8       *reachable;        // Compressed reachable bus stops sets.
+    gsize        *reachable_offsets; // Set starts (stop_ids_count + 1).
+    guint32      *reachable_counts; // Set sizes (stop_ids_count elements).
+    guint64       load_duration;    // Parsing/mapping time (microseconds).
+    guint64       index_duration;   // Engine building time (microseconds).
+} ROUTES_STORE;
+
+// Picks the fastest bus stops search kernel the CPU supports.
+STOP_SEARCH get_stop_search(const gchar **);
+
+// The cursor to decompress a bus stops sequence with, block by block.
+typedef struct {
+    const guint8   *curr;  // The next block of differences to decode.
+          guint32   stop;  // The bus stop decoded last.
+          guint     left;  // The number of bus stops left to decode.
+          gboolean  first; // Whether the first bus stop is still to come.
+} STOPS_CURSOR;
+
+// Compresses a bus stops sequence.
+gsize pack_stops(const guint32 *, const guint, guint8 *);
+
+// Starts decompressing a bus stops sequence.
+void open_stops(STOPS_CURSOR *, const guint8 *, const guint);
+
+// Decompresses the next block of a bus stops sequence.
+guint unpack_stops(STOPS_CURSOR *, guint32 *);
+
+// Compresses bus stops sequences of all routes.
+void pack_routes(ROUTES_STORE *);
+
+// Decompresses bus stops sequences of all routes back into an array.
+void unpack_routes(const ROUTES_STORE *, guint32 *);
+
+// Identifies whether the route goes from one bus stop point to another,
+// scanning its compressed bus stops sequence.
+gboolean find_packed_route(const ROUTES_STORE *,
+                           const guint,
+                           const guint32,
+                           const guint32,
+                                 guint *);
+
+// Gets the name of the direct-route engine.
+const gchar *get_engine_name(const ROUTES_ENGINE);
+
+// Parses the contents of the routes data store into a routes structure.
+ROUTES_STORE *parse_routes(const gchar *, const gsize);
+
+// Builds the bus stops index for the routes structure.
+void index_routes(ROUTES_STORE *);
+
+// Precomputes the table of directly connected bus stop pairs.
+gboolean tabulate_routes(ROUTES_STORE *, const guint64);
+
+// Prepares the routes structure to be used with the given engine.
+void set_routes_engine(ROUTES_STORE *, ROUTES_ENGINE, const guint64);
+
+// Looks up a bus stop ID in the bus stops index.
+guint find_stop(const ROUTES_STORE *, const guint32);
+
+// Maps all bus stops of routes to their entries in the bus stops index.
+void map_stops(ROUTES_STORE *);
+
+// Estimates the memory mapping bus stops to the bus stops index takes.
+guint64 get_mapping_size(const ROUTES_STORE *);
+
+// Frees the routes structure.
+void free_routes(ROUTES_STORE *);
+
+// Removes duplicate and dominated routes from the routes structure.
+void prune_routes(ROUTES_STORE *);
+
+// Reads and parses the routes data store (or maps the routes snapshot),
+// and prepares the routes structure to be used with the given engine.
+ROUTES_STORE *load_routes(const gchar *,
+                          const gboolean,
+                                ROUTES_ENGINE,
+                          const guint64);
+
+// Writes the routes structure out as a routes snapshot.
+gboolean save_routes(const ROUTES_STORE *, const gchar *);
+
+// Acquires a reference to the routes structure.
+ROUTES_STORE *ref_routes(ROUTES_STORE *);
+
+// Releases a reference to the routes structure.
+void unref_routes(ROUTES_STORE *);
+
+// A leg of an itinerary: the route ridden, and the bus stops it is
+// got on and got off at.
+typedef struct {
+    guint32 route;
+    guint32 from;
+    guint32 to;
+} TRANSFER_LEG;
+
+// Precomputes the route-to-route transfers graph.
+gboolean link_routes(ROUTES_STORE *, const guint64);
+
+// Finds the minimal number of transfers between two bus stops,
+// along with an itinerary.
+guint find_transfers(const ROUTES_STORE *,
+                     const guint32,
+                     const guint32,
+                     const guint,
+                           TRANSFER_LEG *);
+
+// Precomputes the sets of bus stops reachable directly from each bus stop.
+gboolean reach_stops(ROUTES_STORE *, const guint64);
+
+// Finds the bus stops reachable directly from a bus stop.
+gboolean find_reachable(const ROUTES_STORE *, const guint32, STOPS_CURSOR *);
+
+// The structure to hold the current snapshot of routes, shared by all
+// server workers, along with everything needed to reload it
+// from the routes data store.
+typedef struct {
+    ROUTES_STORE  *routes;       // The current snapshot.
+    gint           readers;      // The number of readers acquiring it.
+    guint          generation;   // The number of snapshots published.
+    gint           reload_state; // Whether a reload is in progress/pending.
+    gchar         *datastore;    // The routes data store path and filename.
+    gboolean       prune;        // Whether routes are to be pruned.
+    ROUTES_ENGINE  engine;       // The direct-route engine to be used.
+    guint64        table_limit;  // The memory limit for the engine's table.
+    guint64        transfers_limit; // The one for the transfers graph.
+    guint64        reachable_limit; // The one for reachable bus stops.
+    GFileMonitor  *monitor;      // The routes data store monitor (if any).
+} ROUTES_HOLDER;
+
+// Acquires a reference to the current snapshot of routes.
+ROUTES_STORE *acquire_routes(ROUTES_HOLDER *);
+
+// Publishes a new snapshot of routes, replacing the current one.
+void publish_routes(ROUTES_HOLDER *, ROUTES_STORE *);
+
+// Reloads the routes data store in the background.
+gboolean reload_routes(ROUTES_HOLDER *);
+
+// Starts monitoring the routes data store for changes, to reload it.
+void monitor_routes(ROUTES_HOLDER *);
+
+// The structure to hold a single entry of the response cache: a bus stop
+// pair, along with the result of its direct-route lookup, linked into
+// the LRU list of entries.
+typedef struct {
+    guint64 key;  // `(from << 32) | to` plus `CACHE_DIRECT`, 0 if empty.
+    guint32 prev; // The more recently used entry (or CACHE_NIL).
+    guint32 next; // The less recently used entry (or CACHE_NIL).
+} CACHE_ENTRY;
+
+// The structure to hold the response cache of a server worker:
+// a fixed-size open-addressing (linear probing) table of bus stop pairs,
+// evicting the least recently used entries. The cache is bound
+// to the snapshot of routes it was filled from.
+typedef struct {
+    guint        capacity;      // The maximum number of entries.
+    guint        mask;          // The number of slots - 1 (a power of two).
+    guint        count;         // The number of entries.
+    guint        generation;    // The snapshot of routes the entries are of.
+    guint32      head;          // The most  recently used entry.
+    guint32      tail;          // The least recently used entry.
+    guint64      hits;          // The number of lookups found in the cache.
+    guint64      misses;        // The number of lookups not found.
+    guint64      evictions;     // The number of entries evicted.
+    guint64      invalidations; // The number of times the cache is dropped.
+    CACHE_ENTRY *entries;       // The slots table.
+} ROUTES_CACHE;
+
+// Creates a new response cache for direct-route lookups.
+ROUTES_CACHE *new_cache(const guint);
+
+// Looks up the cached result of a direct-route lookup.
+gboolean find_cached_route(ROUTES_CACHE *,
+                           const guint,
+                           const guint32,
+                           const guint32,
+                           gboolean *);
+
+// Puts the result of a direct-route lookup into the cache.
+void cache_route(ROUTES_CACHE *,
+                 const guint,
+                 const guint32,
+                 const guint32,
+                 const gboolean);
+
+// Logs the hits, misses, evictions, and invalidations of the cache.
+void report_cache(const ROUTES_CACHE *);
+
+// Frees the cache structure.
+void free_cache(ROUTES_CACHE *);
+
+// Log buffer overflow policies.
+typedef enum {
+    LOG_OVERFLOW_DROP, // Drops new log entries (and counts them).
+    LOG_OVERFLOW_BLOCK // Waits for the log buffer to get some room.
+} LOG_OVERFLOW;
+
+// The structure to hold a single entry of the log ring.
+typedef struct {
+    gint           sequence;            // The position it is free/ready at.
+    GLogLevelFlags level;               // The log level (0 for a raw line).
+    gint64         time;                // The Unix time (in seconds).
+    gsize          length;              // The length of the text.
+    gchar          text[LOG_SLOT_SIZE]; // The text (not NUL-terminated).
+} LOG_SLOT;
+
+// The structure to hold a log ring: a bounded lock-free multi-producer
+// single-consumer queue of preallocated log entries. Each entry carries
+// a sequence number telling producers and the consumer whose turn it is.
+typedef struct {
+    gint      tail;    // The next position to be taken by producers.
+    gint      head;    // The next position to be consumed.
+    guint     mask;    // The number of entries - 1 (a power of two).
+    gint      dropped; // The number of entries dropped due to overflow.
+    LOG_SLOT *slots;   // The entries.
+    GMutex    mutex;   // Guards waking up the consumer.
+    GCond     cond;    // Signals the consumer to wake up.
+    gboolean  wakeup;  // Whether the consumer has to wake up.
+} LOG_RING;
+
+// The structure to hold a log sink: the log ring flushed in batches
+// by a background thread to the output stream (and to the console).
+typedef struct {
+    GOutputStream *stream;                  // The output stream.
+    gboolean       console;                 // Echo to stdout/stderr or not.
+    LOG_RING      *ring;                    // The log ring (if started).
+    LOG_OVERFLOW   overflow;                // The log ring overflow policy.
+    GThread       *thread;                  // The background flush thread.
+    gint           running;                 // Whether the sink is started.
+    gint           writers;                 // Producers being in progress.
+    GMutex         mutex;                   // Serializes writing out.
+    gint64         prefix_time;             // The time of the cached prefix.
+    gsize          prefix_length;           // The length of the prefix.
+    gchar          prefix[LOG_PREFIX_SIZE]; // The cached timestamp prefix.
+    gboolean       raw;                     // Raw lines only (no reports).
+} LOG_SINK;
+
+// Creates a new log ring.
+LOG_RING *new_log_ring(const guint);
+
+// Puts an entry into the log ring.
+gboolean push_log_ring(LOG_RING *,
+                       const LOG_OVERFLOW,
+                       const GLogLevelFlags,
+                       const gchar *,
+                       const gsize);
+
+// Gets the entry at the head of the log ring.
+LOG_SLOT *peek_log_ring(LOG_RING *);
+
+// Releases the entry at the head of the log ring.
+void release_log_ring(LOG_RING *);
+
+// Waits for the log ring to get filled up, or for the timeout to expire.
+void wait_log_ring(LOG_RING *, const gint64);
+
+// Frees the log ring.
+void free_log_ring(LOG_RING *);
+
+// Creates a new log sink.
+LOG_SINK *new_log_sink(GOutputStream *, const gboolean);
+
+// Starts writing log entries out asynchronously.
+void start_log_sink(LOG_SINK *, const guint, const LOG_OVERFLOW);
+
+// Writes a log entry out to the log sink.
+gboolean write_log_sink(LOG_SINK *,
+                        const GLogLevelFlags,
+                        const gchar *,
+                        const gsize);
+
+// Stops writing log entries out asynchronously.
+void stop_log_sink(LOG_SINK *);
+
+// The structure to hold the access log: sampled requests written out
+// as JSON Lines through a log sink of its own, rate limited by a token
+// bucket shared by all server workers. The token bucket is kept
+// as the time it gets full again, so that a token is taken with a single
+// compare-and-swap.
+typedef struct {
+    GFile             *file;
+    GFileOutputStream *stream;
+    LOG_SINK          *sink;
+    guint64            sample_threshold; // Sampled below it (out of 2^32).
+    guint64            interval;  // Between tokens (ns), 0 means no limit.
+    guint64            tolerance; // The bucket depth less a token (ns).
+    guint64            refilled;  // When the bucket gets full again (ns).
+    gint               logged;    // The number of requests logged.
+    gint               limited;   // The number of ones over the rate limit.
+} ACCESS_LOG;
+
+// The structure to hold details of the request being logged.
+typedef struct {
+    guint32      from;   // The starting bus stop point (0 if none).
+    guint32      to;     // The ending   bus stop point (0 if none).
+    const gchar *result; // The direct-route lookup result (a JSON value).
+} ACCESS_ENTRY;
+
+// Creates a new access log.
+ACCESS_LOG *new_access_log(const gdouble,
+                           const guint,
+                           const guint,
+                           const guint);
+
+// Identifies whether the request is to be written to the access log.
+gboolean sample_access(ACCESS_LOG *, guint32 *);
+
+// Writes the request out to the access log.
+void log_access(      ACCESS_LOG        *,
+                const ACCESS_ENTRY      *,
+                      SoupServerMessage *,
+                const guint64);
+
+// Flushes the access log and closes its file.
+void close_access_log(ACCESS_LOG *);
+
+// Frees the access log structure.
+void free_access_log(ACCESS_LOG *);
 
 // The log writer callback. Gets called on every message logging attempt.
 GLogWriterOutput log_writer(      GLogLevelFlags,
@@ -140,33 +1087,322 @@ GLogWriterOutput log_writer(      GLogLevelFlags,
 // Retrieves the port number used to run the server, from daemon settings.
 gushort get_server_port(GKeyFile *);
 
+// Retrieves the number of server workers to run, from daemon settings.
+guint get_server_workers(GKeyFile *);
+
+// Retrieves the path of the Unix domain socket to listen on,
+// from daemon settings.
+gchar *get_unix_socket_path(GKeyFile *);
+
+// Retrieves the file mode of the Unix domain socket file,
+// from daemon settings.
+guint get_unix_socket_mode(GKeyFile *);
+
+// Retrieves the owner of the Unix domain socket file, from daemon settings.
+gchar *get_unix_socket_owner(GKeyFile *);
+
+// Identifies whether the server listens on the Unix domain socket only
+// by retrieving the corresponding setting from daemon settings.
+gboolean is_unix_socket_only(GKeyFile *);
+
 // Identifies whether debug logging is enabled by retrieving
 // the corresponding setting from daemon settings.
 gboolean is_debug_log_enabled(GKeyFile *);
 
+// Retrieves the number of entries in the log buffer, from daemon settings.
+guint get_log_buffer_size(GKeyFile *);
+
+// Identifies whether requests are written to the access log
+// by retrieving the corresponding setting from daemon settings.
+gboolean is_access_log_enabled(GKeyFile *);
+
+// Retrieves the share of requests written to the access log,
+// from daemon settings.
+gdouble get_access_sample_rate(GKeyFile *);
+
+// Retrieves the maximum number of requests written to the access log
+// per second, from daemon settings.
+guint get_access_rate_limit(GKeyFile *);
+
+// Retrieves the maximum number of requests written to the access log
+// in a burst, from daemon settings.
+guint get_access_rate_burst(GKeyFile *);
+
+// Retrieves the log buffer overflow policy, from daemon settings.
+LOG_OVERFLOW get_log_overflow_policy(GKeyFile *);
+
 // Retrieves the path and filename of the routes data store
 // from daemon settings.
 gchar *get_routes_datastore(GKeyFile *);
 
+// Identifies whether the routes data store has to be monitored
+// for changes, by retrieving the corresponding setting
+// from daemon settings.
+gboolean is_datastore_monitored(GKeyFile *);
+
+// Identifies whether duplicate and dominated routes have to be pruned
+// while loading the routes data store, by retrieving the corresponding
+// setting from daemon settings.
+gboolean is_datastore_pruned(GKeyFile *);
+
+// Retrieves the direct-route engine to be used, from daemon settings.
+ROUTES_ENGINE get_routes_engine(GKeyFile *);
+
+// Retrieves the memory limit for the precomputed table of directly
+// connected bus stops, from daemon settings.
+guint64 get_table_memory_limit(GKeyFile *);
+
+// Retrieves the memory limit for the route-to-route transfers graph,
+// from daemon settings.
+guint64 get_transfers_memory_limit(GKeyFile *);
+
+// Retrieves the memory limit for the reachable bus stops sets,
+// from daemon settings.
+guint64 get_reachable_memory_limit(GKeyFile *);
+
+// Identifies whether request phase timings are to be sent back
+// in the Server-Timing header.
+gboolean is_server_timing_enabled(GKeyFile *);
+
+// Retrieves the threshold of request handling time, over which requests
+// are logged as slow, from daemon settings.
+guint get_slow_request_threshold(GKeyFile *);
+
+// Retrieves the capacity of the response cache, from daemon settings.
+guint get_cache_capacity(GKeyFile *);
+
+// Retrieves the maximum number of requests in flight, from daemon settings.
+guint get_max_in_flight(GKeyFile *);
+
+// Retrieves the maximum time (in milliseconds) a request is allowed to wait
+// to be handled, from daemon settings.
+guint get_max_queue_wait(GKeyFile *);
+
+// Retrieves the number of seconds clients are told to wait before retrying
+// requests shed, from daemon settings.
+guint get_retry_after(GKeyFile *);
+
+// Retrieves the number of threads in the offload pool, from daemon settings.
+guint get_offload_pool_size(GKeyFile *);
+
+// Retrieves the depth of the offload pool queue, from daemon settings.
+guint get_offload_queue_depth(GKeyFile *);
+
+// The structure to hold a latency histogram: counts of durations
+// observed, falling into log-scale (powers of two) buckets.
+typedef struct {
+    guint64 buckets[HIST_BUCKETS + 1]; // The last one is for the rest.
+    guint64 count;                     // The number of durations observed.
+    guint64 sum;                       // Their sum (in nanoseconds).
+} LATENCY_HISTOGRAM;
+
+// Reasons for requests to be shed by the admission control.
+typedef enum {
+    SHED_IN_FLIGHT,  // Too many requests in flight in all server workers.
+    SHED_QUEUE_WAIT, // The request has waited too long to be handled.
+    SHED_REASONS
+} SHED_REASON;
+
+// The structure to hold metrics of a server worker. Updated
+// by the server worker itself only (see `METRIC_ADD()`).
+typedef struct {
+    guint64           requests[STATUS_CODES + 1]; // Requests by status code.
+    LATENCY_HISTOGRAM request_duration;           // Request handler time.
+    LATENCY_HISTOGRAM lookup_duration;            // Direct-route lookup time.
+    guint64           shed[SHED_REASONS];         // Requests shed, by reason.
+} SERVER_METRICS;
+
+// The structure to hold metrics of all server workers.
+typedef struct {
+    guint            workers_count;
+    SERVER_METRICS **workers;
+} METRICS_REGISTRY;
+
+// Phases of request handling timed by the request tracing.
+typedef enum {
+    PHASE_LOG,    // Debug logging of the request.
+    PHASE_PARSE,  // Parsing and validating the request.
+    PHASE_CACHE,  // Consulting and updating the response cache.
+    PHASE_QUEUE,  // Waiting for the offload pool.
+    PHASE_LOOKUP, // Performing the routes processing.
+    PHASE_RENDER, // Rendering the response body.
+    TRACE_PHASES
+} TRACE_PHASE;
+
+// The structure to hold request tracing settings, shared by all server
+// workers.
+typedef struct {
+    gboolean server_timing;  // Whether the Server-Timing header is sent.
+    guint64  slow_threshold; // In nanoseconds, 0 means none are logged.
+} REQUEST_TRACING;
+
+// The structure to hold timings of the request being traced.
+typedef struct {
+    guint64 start;                // When the request handling started.
+    guint64 last;                 // When the phase before ended.
+    guint64 phases[TRACE_PHASES]; // Time spent in each phase (nanoseconds).
+} REQUEST_TRACE;
+
+// Ends the current phase of the request handling, if the request is being
+// traced at all (there is no trace otherwise), so that there is no cost
+// to it, save for a check, when tracing is disabled.
+#define TRACE(trace, phase) do { \
+    if ((trace) != NULL) { trace_phase((trace), (phase)); } \
+} while (0)
+
+// Gets the current time of the monotonic clock (in nanoseconds).
+guint64 get_time_ns();
+
+// Creates a new request tracing settings structure.
+REQUEST_TRACING *new_tracing(const gboolean, const guint);
+
+// Starts tracing the request.
+void start_trace(REQUEST_TRACE *, const guint64);
+
+// Ends the current phase of the request handling.
+void trace_phase(REQUEST_TRACE *, const TRACE_PHASE);
+
+// Finishes tracing the request: sends phase timings back
+// in the Server-Timing header, and logs the request if it is slow.
+void finish_trace(const REQUEST_TRACING *, REQUEST_TRACE *,
+                  SoupServerMessage *);
+
+// Frees the request tracing settings structure.
+void free_tracing(REQUEST_TRACING *);
+
+// Creates a new registry of metrics of all server workers.
+METRICS_REGISTRY *new_metrics(const guint);
+
+// Counts the request by its HTTP status code.
+void count_request(SERVER_METRICS *, const guint);
+
+// Puts the duration observed into the latency histogram.
+void observe_latency(LATENCY_HISTOGRAM *, const guint64);
+
+// Renders all the metrics in the Prometheus text exposition format.
+GString *render_metrics(const METRICS_REGISTRY *, const ROUTES_STORE *);
+
+// Frees the registry of metrics.
+void free_metrics(METRICS_REGISTRY *);
+
+// The structure to hold a workload of direct-route queries:
+// the starting and the ending bus stop points of each query.
+typedef struct {
+    guint    count;
+    guint32 *from;
+    guint32 *to;
+} QUERY_WORKLOAD;
+
+// Generates a synthetic routes data store and writes it out.
+gboolean generate_routes(      GOutputStream *,
+                         const guint,
+                         const guint,
+                         const guint32,
+                         const gdouble,
+                         const guint32,
+                               GError **);
+
+// Creates a workload of direct-route queries against the given routes.
+QUERY_WORKLOAD *new_workload(const ROUTES_STORE *,
+                             const guint,
+                             const gdouble,
+                             const guint32);
+
+// Writes the workload of queries out, one query per line.
+gboolean write_workload(GOutputStream *, const QUERY_WORKLOAD *, GError **);
+
+// Frees the workload structure.
+void free_workload(QUERY_WORKLOAD *);
+
+// The structure to hold admission control limits, shared by all server
+// workers, along with the number of requests in flight in all of them.
+typedef struct {
+    gint     in_flight;      // Updated atomically by all server workers.
+    guint    max_in_flight;  // 0 means no limit.
+    guint64  max_queue_wait; // In nanoseconds, 0 means no limit.
+    gchar   *retry_after;    // The prerendered Retry-After header value.
+} ADMISSION_CONTROL;
+
+// The structure to hold request handler payload data
+// to pass to the default request handler callback.
+typedef struct {
+    gboolean           debug_log_enabled;
+    ROUTES_HOLDER     *routes_holder;
+    ROUTES_CACHE      *routes_cache;     // The worker's own cache (if enabled).
+    SERVER_METRICS    *metrics;          // The worker's own metrics.
+    METRICS_REGISTRY  *metrics_registry; // Metrics of all the workers.
+    GThreadPool       *offload_pool;     // Shared by all the workers.
+    guint              offload_queue_depth;
+    ADMISSION_CONTROL *admission;        // Shared by all the workers.
+    REQUEST_TRACING   *tracing;          // Shared by all the workers.
+    ACCESS_LOG        *access_log;       // Shared by all the workers.
+    guint32            access_seed;      // The worker's own sampling state.
+} HANDLER_PAYLOAD;
+
+// Creates a new admission control structure.
+ADMISSION_CONTROL *new_admission(const guint, const guint, const guint);
+
+// The request started signal callback. Used to admit the incoming request,
+// or to shed it right away.
+void admit_request(SoupServer *, SoupServerMessage *, gpointer);
+
+// Identifies whether the request has waited too long to be handled.
+gboolean is_wait_exceeded(const ADMISSION_CONTROL *,
+                                SoupServerMessage *,
+                          const guint64);
+
+// Responds to the request with a prerendered 503 Service Unavailable
+// response, and counts it as shed.
+void shed_request(SoupServerMessage *, HANDLER_PAYLOAD *, const SHED_REASON);
+
+// Frees the admission control structure.
+void free_admission(ADMISSION_CONTROL *);
+
+// The structure to hold a server worker: a Soup web server
+// run by its own main loop in its own thread, and listening
+// on its own socket bound to the shared server port.
+typedef struct {
+    GThread         *thread;
+    GMainContext    *context;
+    GMainLoop       *loop;
+    GSocket         *socket;
+    HANDLER_PAYLOAD *handler_payload;
+} SERVER_WORKER;
+
+// The structure to hold settings of the Unix domain socket listener.
+typedef struct {
+    gchar    *path;  // The socket file (NULL means there is no listener).
+    guint     mode;  // The file mode of the socket file.
+    gchar    *owner; // The owner of the socket file: "user[:group]".
+    gboolean  only;  // Whether TCP interfaces are not listened on.
+} UNIX_LISTENER;
+
 // Helper structure to hold args for the `_cleanup()` helper function.
 typedef struct {
     GFileOutputStream *log_stream;
+    LOG_SINK          *log_sink;
     GFile             *logfile;
+    ACCESS_LOG        *access_log;
     GMainLoop         *loop;
+    HANDLER_PAYLOAD   *handler_payload;
+    SERVER_WORKER     *workers;
+    guint              workers_count;
+    const gchar       *unix_socket_path; // The socket file to remove.
 } _CLEANUP_ARGS;
 
 // Starts up the Soup web server and the main loop.
 GMainLoop *startup(const gushort,
+                   const guint,
                    const gboolean,
-                         GPtrArray *,
-                         _CLEANUP_ARGS *);
-
-// The structure to hold request handler payload data
-// to pass to the default request handler callback.
-typedef struct {
-    gboolean   debug_log_enabled;
-    GPtrArray *routes_list;
-} HANDLER_PAYLOAD;
+                   const guint,
+                   const guint,
+                   const guint,
+                         ADMISSION_CONTROL *,
+                         REQUEST_TRACING   *,
+                         ACCESS_LOG        *,
+                   const UNIX_LISTENER     *,
+                         ROUTES_HOLDER     *,
+                         _CLEANUP_ARGS     *);
 
 // The default request handler callback. Used to process the incoming request.
 void request_handler(      SoupServer *,
@@ -175,12 +1411,27 @@ void request_handler(      SoupServer *,
                            GHashTable *,
                            gpointer);
 
+// The request started signal callback. Used to reject the incoming batch
+// request as soon as its body exceeds the allowed size.
+void cap_request_body(SoupServer *, SoupServerMessage *, gpointer);
+
+// The offload pool thread function. Used to perform the direct-route lookup
+// of a paused request, and to resume the request afterwards.
+void offload_handler(gpointer, gpointer);
+
 // Performs the routes processing to identify and return whether a particular
 // interval between two bus stop points given is direct, or not.
-gboolean find_direct_route(const gboolean,
-                           const GPtrArray *,
-                           const gchar *,
-                           const gchar *);
+gboolean find_direct_route(const ROUTES_STORE *,
+                           const guint32,
+                           const guint32);
+
+// Performs the routes processing to identify whether each one
+// of the given intervals between two bus stop points is direct, or not.
+void find_direct_routes(const ROUTES_STORE *,
+                        const guint32 *,
+                        const guint32 *,
+                        const guint,
+                              gboolean *);
 
 // Helper protos.
 GKeyFile *_get_settings();